@@ -5,13 +5,24 @@
 
 #include "gg_flash_mgr.h"
 #include "gg_flash_mgr_config.h"
+#include "gg_flash_mgr_raw.h"
+#include "gg_flash_mgr_queue.h"
+#include "gg_flash_mgr_index.h"
+#include "gg_flash_mgr_rollup.h"
+#include "gg_flash_mgr_crc.h"
+#include "gg_flash_mgr_delta.h"
+#include "gg_flash_mgr_blob.h"
+#include "gg_flash_mgr_record.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdlib.h>
+#include <dirent.h>
+#include <stdatomic.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
@@ -23,6 +34,11 @@
 #include "hal/spi_flash_types.h"
 #include "hal/spi_types.h"
 #include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = FLASH_MGR_LOG_TAG;
 
@@ -39,37 +55,556 @@ typedef struct __attribute__((packed)) {
     uint32_t next_id;           ///< Next entry ID
     uint32_t deleted_from_start; ///< How many entries deleted from start
     uint32_t magic;             ///< Magic number for validation
+    uint32_t head_offset;        ///< Deleted entries still physically at the start of the log
 } flash_mgr_metadata_t;
 
+// Metadata files from before the slots hold only the fields up to magic
+#define FLASH_MGR_LEGACY_METADATA_SIZE offsetof(flash_mgr_metadata_t, head_offset)
+
 #define FLASH_MGR_METADATA_MAGIC 0xFEEDC0DE
 
 /**
-* @brief Internal state structure
+* @brief Read position of a named consumer, saved with the metadata
+*/
+typedef struct __attribute__((packed)) {
+    char name[FLASH_MGR_CONSUMER_NAME_LEN]; ///< NUL padded, empty = free slot
+    uint32_t cursor;                        ///< Id of the next entry to hand out
+} flash_mgr_consumer_t;
+
+/**
+* @brief One of the two slots of the metadata file
+* 
+* Saves alternate between the slots and overwrite the older one in place, so
+* a reset during a save leaves the newer one intact. Load takes the valid slot
+* with the higher seq. Files from before the slots (the counters and magic of
+* the original layout) still load.
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             ///< FLASH_MGR_META_SLOT_MAGIC
+    uint32_t seq;               ///< Save count; slot seq & 1
+    flash_mgr_metadata_t meta;
+    flash_mgr_consumer_t consumers[FLASH_MGR_MAX_CONSUMERS];
+    uint32_t crc;               ///< CRC-32 of everything before it
+} flash_mgr_meta_slot_t;
+
+#define FLASH_MGR_META_SLOT_MAGIC 0x4154454D // "META"
+
+/**
+* @brief Header at the start of a RING data file
+* 
+* Slot n holds ids base_id + n, base_id + n + slots, ... so any entry's slot
+* follows from its id, and the tail is where that sequence breaks.
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             ///< FLASH_MGR_RING_MAGIC
+    uint32_t slots;             ///< Entry slots following the header
+    uint32_t base_id;           ///< Id written to slot 0 on the first lap
+    uint32_t reserved;          ///< Pads the header to one slot
+} flash_mgr_ring_header_t;
+
+#define FLASH_MGR_RING_MAGIC 0x474E4952 // "RING"
+
+/**
+* @brief Data file kept open between reads
+*/
+typedef struct {
+    FILE *f;                ///< NULL when closed
+    uint32_t segment;       ///< Segment f belongs to (SEGMENTED mode)
+    uint8_t *packed;        ///< Encoded block of a sealed segment, allocated on first use
+    uint32_t packed_block;  ///< Block held in packed plus one, 0 = none
+    uint32_t packed_len;    ///< Bytes in packed
+    uint32_t packed_entries; ///< Entries in f's sealed segment, from its header
+} flash_mgr_read_handle_t;
+
+/**
+* @brief Read-ahead window for reads without a cursor (backends with read_cached)
+* 
+* Holds entries [first_id, first_id + count) as read from flash in one go.
+* An id's entry doesn't change while its file exists, so the window stays
+* valid until release_read_handles(). Visitors borrow the buffer in every
+* layout (count stays 0 without read_cached).
+*/
+typedef struct {
+    SemaphoreHandle_t lock;         ///< Taken without waiting; while it's busy readers read directly
+    flash_mgr_read_handle_t handle;
+    flash_mgr_entry_t *entries;     ///< chunk_buffer_size bytes, NULL when there is no window
+    uint32_t capacity;              ///< Entries that fit in entries
+    uint32_t first_id;
+    uint32_t count;
+} flash_mgr_read_ahead_t;
+
+/**
+* @brief Read cursor (flash_mgr_iter_t)
+*/
+struct flash_mgr_iter {
+    struct flash_mgr_log *mgr;          ///< Log the cursor reads
+    uint32_t next_id;                   ///< Id of the next entry to return
+    flash_mgr_read_handle_t handle;
+    struct flash_mgr_iter *next;        ///< Open cursor list, so the writer can close their files
+};
+
+/**
+* @brief One log of a merged cursor, with the entries read ahead from it
+*/
+typedef struct {
+    flash_mgr_iter_t *iter;
+    flash_mgr_entry_t entries[FLASH_MGR_MERGE_READ_ENTRIES];
+    uint32_t pos;                       ///< Next entry of entries to return
+    uint32_t count;                     ///< Entries read ahead
+} flash_mgr_merge_source_t;
+
+/**
+* @brief Merged read cursor (flash_mgr_merge_t)
+*/
+struct flash_mgr_merge {
+    uint32_t count;                     ///< Sources in use: the log, then its streams
+    flash_mgr_merge_source_t sources[1 + FLASH_MGR_MAX_STREAMS];
+};
+
+/**
+* @brief Record file of one schema (flash_mgr_records_t)
+*/
+struct flash_mgr_records {
+    struct flash_mgr_log *mgr;          ///< Log the file lives next to
+    flash_mgr_record_file_t file;
+    char *path;
+    uint8_t schema_id;
+    uint32_t record_size;
+    uint32_t slots;                     ///< Slots asked for, taken when format re-creates the file
+    uint8_t *buffer;                    ///< batch slots an append fills and writes at once
+    uint32_t batch;
+    struct flash_mgr_records *next;     ///< Open record files of the log
+};
+
+/**
+* @brief State of one open log (flash_mgr_handle_t)
+*/
+typedef struct flash_mgr_log flash_mgr_state_t;
+
+/**
+* @brief Physical storage backend for the entry log
+* 
+* Entry ids are contiguous, so an id doubles as the entry's position in the log.
+* A backend holds the ids [deleted_from_start, next_id) minus whatever is still
+* staged, only ever appends at the tail and only ever drops from the head.
+*/
+typedef struct {
+    const char *name;
+    bool head_recoverable;  ///< recover() finds the head without the metadata checkpoint
+    bool overwrites_live;   ///< append() may overwrite entries readers can still see, so it can't run beside them
+    
+    /** Find the id range physically present, repairing a torn tail (empty log: first == end) */
+    esp_err_t (*recover)(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id);
+    /** Append entries at the tail; written reports how many made it even on failure */
+    esp_err_t (*append)(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count, uint32_t *written);
+    /** Read count entries starting at id; entries_read may be short on error */
+    esp_err_t (*read)(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                      uint32_t *entries_read);
+    /** read() through a file kept open in handle (NULL: cursors use read()) */
+    esp_err_t (*read_cached)(flash_mgr_state_t *mgr, flash_mgr_read_handle_t *handle, uint32_t id,
+                             flash_mgr_entry_t *buffer, uint32_t count, uint32_t *entries_read);
+    /** Drop the count oldest entries */
+    esp_err_t (*drop_head)(flash_mgr_state_t *mgr, uint32_t count);
+    /** Remove all data */
+    void (*erase)(flash_mgr_state_t *mgr);
+    /** Physically free the head_offset dead entries (NULL if drop_head already does) */
+    esp_err_t (*reclaim)(flash_mgr_state_t *mgr);
+    /** Cut the log back to end_id after a partly written batch, putting back any entries it overwrote */
+    esp_err_t (*truncate)(flash_mgr_state_t *mgr, uint32_t end_id);
+} flash_mgr_backend_t;
+
+/**
+* @brief Counters behind flash_mgr_get_status()
+*/
+typedef struct {
+    atomic_uint total_entries;
+    atomic_uint active_entries;
+    atomic_uint deleted_entries;
+    atomic_uint pending_entries;
+    atomic_uint used_bytes;
+} flash_mgr_status_counters_t;
+
+/**
+* @brief Lock-free status snapshot
+* 
+* The writer fills the slot readers aren't using and then bumps seq, which
+* selects the current slot. The publish after that refills the slot a reader
+* may still be copying, so a reader retries if seq moved at all. A preempted
+* writer never stalls a reader.
 */
 typedef struct {
+    atomic_uint seq;                      ///< Publish count, slots[seq & 1] is current
+    flash_mgr_status_counters_t slots[2];
+} flash_mgr_status_snapshot_t;
+
+/**
+* @brief Internal state structure, one per open log
+*/
+struct flash_mgr_log {
     flash_mgr_config_t config;
     flash_mgr_metadata_t meta;
+    flash_mgr_consumer_t consumers[FLASH_MGR_MAX_CONSUMERS]; ///< Saved with meta
+    bool cleanup_held;           ///< Auto-cleanup last stopped short at an entry a consumer hasn't acked
+    uint32_t meta_seq;           ///< seq of the newest metadata slot on flash
     esp_flash_t *ext_flash;
+    const flash_mgr_backend_t *backend;
     bool initialized;
-} flash_mgr_state_t;
+    
+    // Segment table (SEGMENTED mode): segments [seg_first, seg_first + seg_count)
+    uint32_t seg_entries;        ///< Entries per segment file
+    uint32_t seg_first;          ///< Index of the oldest segment file
+    uint32_t seg_count;          ///< Number of segment files on flash
+    uint32_t seg_sealed;         ///< Segments below this one are delta encoded (compress_segments)
+    uint32_t seg_bytes;          ///< Size of all segment files
+    
+    // Ring file (RING mode)
+    uint32_t ring_slots;         ///< Entry slots in the ring, 0 in other modes
+    uint32_t ring_base_id;       ///< Id stored in slot 0 on the first lap
+    bool ring_ready;             ///< Ring file exists and is pre-allocated
+    flash_mgr_entry_t *ring_undo; ///< What the slots of the last append held, for truncate
+    uint32_t ring_undo_id;       ///< Id the last append started at
+    uint32_t ring_undo_count;    ///< Slots saved in ring_undo
+    uint32_t ring_undo_capacity;
+    
+    // Raw flash log (RAW mode), in a region at the top of the chip outside LittleFS
+    flash_mgr_raw_log_t raw;
+    uint32_t raw_region_size;    ///< Bytes reserved for the raw log, 0 in other modes
+    
+    uint32_t fixed_capacity;     ///< Entries kept before the oldest is overwritten (RING/RAW), 0 if the log grows
+    
+    // Write staging buffer (entries accepted but not yet on flash)
+    flash_mgr_entry_t *staging;  ///< Staged entries, oldest first
+    uint32_t staging_capacity;   ///< Staging buffer size in entries
+    uint32_t staged_count;       ///< Entries currently staged
+    int64_t staged_since_us;     ///< esp_timer time when the oldest staged entry was added
+    
+    // Metadata checkpointing
+    uint32_t entries_since_checkpoint; ///< Entries flushed since metadata was last saved
+    int64_t last_checkpoint_us;        ///< esp_timer time of the last metadata save
+    
+    // Mutators serialize on lock (recursive) and hold read_gate while they change what
+    // readers see; readers share read_gate, the first one in takes it for all of them
+    SemaphoreHandle_t lock;
+    uint32_t lock_depth;                 ///< state_lock() nesting of the lock owner
+    SemaphoreHandle_t read_gate;         ///< Binary: owned by the writer or by the readers
+    SemaphoreHandle_t reader_mutex;      ///< Guards reader_count
+    uint32_t reader_count;
+    flash_mgr_status_snapshot_t status;
+    struct flash_mgr_iter *iterators;    ///< Open read cursors (changed under lock)
+    struct flash_mgr_records *records;   ///< Open record files (changed under lock)
+    flash_mgr_read_ahead_t read_ahead;   ///< Shared by reads without a cursor
+    
+    // Asynchronous writer (async_writer): producers only touch the queue
+    flash_mgr_queue_t queue;
+    flash_mgr_queue_slot_t *queue_slots; ///< NULL when async_writer is off
+    TaskHandle_t writer_task;
+    SemaphoreHandle_t writer_done;       ///< Given by the writer task just before it exits
+    volatile bool writer_stop;
+    
+    // ISR append queue (isr_queue_entries), drained by the flush path
+    flash_mgr_queue_t isr_queue;
+    flash_mgr_queue_slot_t *isr_queue_slots; ///< NULL when disabled
+    
+    // Time index and zone maps (time_index_block > 0): records of closed blocks
+    // live in index, the block still filling is summarized in index_open
+    flash_mgr_index_t index;             ///< fd < 0 when there is no index
+    flash_mgr_index_rec_t index_open;    ///< .block is the block the next flushed entry belongs to
+    uint32_t index_count;                ///< Flushed entries of index_open.block seen so far
+    uint32_t index_run_max_ts;           ///< run_max_ts of the last closed block
+    
+    // Rollups (rollup_types > 0): fed with every flushed entry, see gg_flash_mgr_rollup.h
+    flash_mgr_rollups_t rollups;         ///< fd < 0 when disabled
+    
+    // Blob payloads (blob_file set), see gg_flash_mgr_blob.h
+    flash_mgr_blobs_t blobs;             ///< fd < 0 when disabled
+    
+    // Streams (config.streams): sub-logs keeping the entries of one type each
+    struct flash_mgr_log *streams[FLASH_MGR_MAX_STREAMS]; ///< In config order
+    uint32_t stream_count;               ///< Streams open
+    struct flash_mgr_log *parent;        ///< Log this one is a stream of, NULL if it isn't
+    char *stream_files[5];               ///< Stream: names behind its data, meta, index, rollup and blob file
+    
+    struct flash_mgr_log *next_log;      ///< Open logs sharing the mount (s_mount.logs)
+};
+
+/**
+* @brief LittleFS mount shared by all open logs
+* 
+* The first log opened brings up the SPI flash and mounts LittleFS with its
+* configuration, the others reuse both. The last one closed unmounts.
+*/
+typedef struct {
+    bool mounted;
+    esp_flash_t *ext_flash;
+    const char *mount_point;
+    const char *partition_label;
+    uint32_t raw_region_size;            ///< Top of the chip kept out of LittleFS for a RAW log
+    uint32_t users;                      ///< Open logs
+    struct flash_mgr_log *logs;          ///< Open logs, newest first
+} flash_mgr_mount_t;
 
 // =============================================================================
 // GLOBAL STATE
 // =============================================================================
 
-static flash_mgr_state_t g_state = {0};
+static flash_mgr_mount_t s_mount = {0};
+
+// Log behind the flash_mgr_* calls without a handle
+static flash_mgr_state_t s_default = {0};
 
 // =============================================================================
 // INTERNAL FUNCTION DECLARATIONS
 // =============================================================================
 
-static esp_err_t init_external_flash(void);
-static esp_err_t init_littlefs(void);
-static esp_err_t load_metadata(void);
-static esp_err_t save_metadata(void);
-static uint32_t calculate_max_entries(void);
-static esp_err_t perform_auto_cleanup(void);
-static uint32_t get_current_timestamp(void);
+static esp_err_t open_log(flash_mgr_state_t *mgr, const flash_mgr_config_t *config);
+static esp_err_t close_log(flash_mgr_state_t *mgr);
+static void release_log(flash_mgr_state_t *mgr);
+static esp_err_t abandon_open(flash_mgr_state_t *mgr, esp_err_t ret);
+static bool mount_compatible(const flash_mgr_state_t *mgr);
+static esp_err_t open_streams(flash_mgr_state_t *mgr);
+static esp_err_t append_routed(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                               bool stamp_now);
+static esp_err_t init_external_flash(flash_mgr_state_t *mgr);
+static esp_err_t init_littlefs(flash_mgr_state_t *mgr);
+static esp_err_t load_metadata(flash_mgr_state_t *mgr);
+static esp_err_t save_metadata(flash_mgr_state_t *mgr);
+static bool meta_slot_valid(const flash_mgr_meta_slot_t *slot);
+static bool slowest_cursor(flash_mgr_state_t *mgr, uint32_t *cursor);
+static void consumers_skip_to(flash_mgr_state_t *mgr, uint32_t head_id);
+static esp_err_t consumers_reclaim(flash_mgr_state_t *mgr, bool force);
+static uint32_t protected_room(flash_mgr_state_t *mgr);
+static esp_err_t checkpoint_metadata(flash_mgr_state_t *mgr, bool force);
+static esp_err_t recover_from_data_file(flash_mgr_state_t *mgr);
+static esp_err_t file_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id);
+static esp_err_t file_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                     uint32_t *written);
+static esp_err_t file_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                   uint32_t *entries_read);
+static esp_err_t file_backend_read_cached(flash_mgr_state_t *mgr, flash_mgr_read_handle_t *handle, uint32_t id,
+                                          flash_mgr_entry_t *buffer, uint32_t count, uint32_t *entries_read);
+static esp_err_t file_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count);
+static void file_backend_erase(flash_mgr_state_t *mgr);
+static esp_err_t file_backend_reclaim(flash_mgr_state_t *mgr);
+static esp_err_t file_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id);
+static esp_err_t file_compact(flash_mgr_state_t *mgr, uint32_t skip_entries, uint32_t keep_entries);
+static esp_err_t trim_torn_tail(flash_mgr_state_t *mgr, const char *path, uint32_t *entries);
+static esp_err_t segment_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id);
+static esp_err_t segment_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                        uint32_t *written);
+static esp_err_t segment_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                      uint32_t *entries_read);
+static esp_err_t segment_backend_read_cached(flash_mgr_state_t *mgr, flash_mgr_read_handle_t *handle, uint32_t id,
+                                             flash_mgr_entry_t *buffer, uint32_t count, uint32_t *entries_read);
+static esp_err_t segment_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count);
+static void segment_backend_erase(flash_mgr_state_t *mgr);
+static esp_err_t segment_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id);
+static esp_err_t seal_segments(flash_mgr_state_t *mgr);
+static esp_err_t ring_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id);
+static esp_err_t ring_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                     uint32_t *written);
+static esp_err_t ring_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                   uint32_t *entries_read);
+static esp_err_t ring_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count);
+static void ring_backend_erase(flash_mgr_state_t *mgr);
+static esp_err_t ring_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id);
+static esp_err_t init_raw_log(flash_mgr_state_t *mgr);
+static esp_err_t raw_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id);
+static esp_err_t raw_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                    uint32_t *written);
+static esp_err_t raw_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                  uint32_t *entries_read);
+static esp_err_t raw_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count);
+static void raw_backend_erase(flash_mgr_state_t *mgr);
+static esp_err_t raw_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id);
+static uint32_t calculate_max_entries(flash_mgr_state_t *mgr);
+static uint32_t used_space_bytes(flash_mgr_state_t *mgr);
+static esp_err_t perform_auto_cleanup(flash_mgr_state_t *mgr);
+static uint32_t get_current_timestamp(flash_mgr_state_t *mgr);
+static esp_err_t flush_staging(flash_mgr_state_t *mgr);
+static bool staging_flush_due(flash_mgr_state_t *mgr);
+static esp_err_t maybe_reclaim(flash_mgr_state_t *mgr);
+static esp_err_t append_batch(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count, bool stamp_now);
+static esp_err_t append_entry(flash_mgr_state_t *mgr, uint32_t timestamp, uint8_t type, uint8_t unit,
+                              int32_t value_x1000);
+static esp_err_t stage_entry(flash_mgr_state_t *mgr, uint32_t timestamp, uint8_t type, uint8_t unit,
+                             int32_t value_x1000);
+static esp_err_t reclaim_blobs(flash_mgr_state_t *mgr);
+static uint32_t blob_bytes(flash_mgr_state_t *mgr);
+static uint32_t entry_limit(flash_mgr_state_t *mgr);
+static esp_err_t enqueue_entry(flash_mgr_state_t *mgr, uint32_t timestamp, uint8_t type, uint8_t unit,
+                               int32_t value_x1000);
+static esp_err_t drain_queue(flash_mgr_state_t *mgr);
+static esp_err_t flush_and_checkpoint(flash_mgr_state_t *mgr);
+static void stage_entries(flash_mgr_state_t *mgr, uint32_t count);
+static esp_err_t start_writer_task(flash_mgr_state_t *mgr);
+static void stop_writer_task(flash_mgr_state_t *mgr);
+static void check_auto_cleanup(flash_mgr_state_t *mgr);
+static void account_flushed(flash_mgr_state_t *mgr, uint32_t count);
+static void publish_status(flash_mgr_state_t *mgr);
+static esp_err_t init_time_index(flash_mgr_state_t *mgr);
+static esp_err_t replay_entries(flash_mgr_state_t *mgr, uint32_t id, uint32_t end_id,
+                                void (*fold)(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries,
+                                             uint32_t count));
+static void index_flushed(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count);
+static esp_err_t init_rollups(flash_mgr_state_t *mgr);
+static void rollups_flushed(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count);
+static void rollups_protect(flash_mgr_state_t *mgr, uint32_t new_head_id);
+static esp_err_t read_locked(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t max_entries,
+                             uint32_t *entries_read, flash_mgr_read_handle_t *handle);
+static FILE *read_handle_open(const char *path);
+static void read_handle_close(flash_mgr_read_handle_t *handle);
+static void release_read_handles(flash_mgr_state_t *mgr);
+static esp_err_t records_sync(flash_mgr_state_t *mgr);
+static void records_release(flash_mgr_state_t *mgr);
+static void records_format(flash_mgr_state_t *mgr);
+static esp_err_t read_ahead(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                            uint32_t limit_id, uint32_t *entries_read);
+
+static const flash_mgr_backend_t s_file_backend = {
+    .name = "file",
+    .head_recoverable = true,
+    .overwrites_live = false,
+    .recover = file_backend_recover,
+    .append = file_backend_append,
+    .read = file_backend_read,
+    .read_cached = file_backend_read_cached,
+    .drop_head = file_backend_drop_head,
+    .erase = file_backend_erase,
+    .reclaim = NULL,
+    .truncate = file_backend_truncate
+};
+
+// Same file, but delete only moves the head and reclaim compacts later
+static const flash_mgr_backend_t s_file_logical_backend = {
+    .name = "file (logical delete)",
+    .head_recoverable = false,
+    .overwrites_live = false,
+    .recover = file_backend_recover,
+    .append = file_backend_append,
+    .read = file_backend_read,
+    .read_cached = file_backend_read_cached,
+    .drop_head = file_backend_drop_head,
+    .erase = file_backend_erase,
+    .reclaim = file_backend_reclaim,
+    .truncate = file_backend_truncate
+};
+
+static const flash_mgr_backend_t s_segment_backend = {
+    .name = "segmented",
+    .head_recoverable = false,
+    .overwrites_live = false,
+    .recover = segment_backend_recover,
+    .append = segment_backend_append,
+    .read = segment_backend_read,
+    .read_cached = segment_backend_read_cached,
+    .drop_head = segment_backend_drop_head,
+    .erase = segment_backend_erase,
+    .reclaim = NULL,
+    .truncate = segment_backend_truncate
+};
+
+static const flash_mgr_backend_t s_ring_backend = {
+    .name = "ring",
+    .head_recoverable = false,
+    .overwrites_live = true,
+    .recover = ring_backend_recover,
+    .append = ring_backend_append,
+    .read = ring_backend_read,
+    .read_cached = NULL,
+    .drop_head = ring_backend_drop_head,
+    .erase = ring_backend_erase,
+    .reclaim = NULL,
+    .truncate = ring_backend_truncate
+};
+
+static const flash_mgr_backend_t s_raw_backend = {
+    .name = "raw flash",
+    .head_recoverable = false,
+    .overwrites_live = true,
+    .recover = raw_backend_recover,
+    .append = raw_backend_append,
+    .read = raw_backend_read,
+    .read_cached = NULL,
+    .drop_head = raw_backend_drop_head,
+    .erase = raw_backend_erase,
+    .reclaim = NULL,
+    .truncate = raw_backend_truncate
+};
+
+/**
+* @brief Log that keeps entries of a type: its stream, or mgr itself
+*/
+static inline IRAM_ATTR flash_mgr_state_t *route(flash_mgr_state_t *mgr, uint8_t type) {
+    for (uint32_t i = 0; i < mgr->stream_count; i++) {
+        if (mgr->config.streams[i].type == type) {
+            return mgr->streams[i];
+        }
+    }
+    return mgr;
+}
+
+/**
+* @brief Take the writer lock; readers are kept out until the outermost state_unlock()
+*/
+static inline void state_lock(flash_mgr_state_t *mgr) {
+    if (mgr->lock) {
+        xSemaphoreTakeRecursive(mgr->lock, portMAX_DELAY);
+        if (mgr->lock_depth++ == 0) {
+            xSemaphoreTake(mgr->read_gate, portMAX_DELAY);
+        }
+    }
+}
+
+static inline void state_unlock(flash_mgr_state_t *mgr) {
+    if (mgr->lock) {
+        if (--mgr->lock_depth == 0) {
+            publish_status(mgr);
+            xSemaphoreGive(mgr->read_gate);
+        }
+        xSemaphoreGiveRecursive(mgr->lock);
+    }
+}
+
+/**
+* @brief Let readers in while the writer does slow flash work they can't observe
+* 
+* Only for work that leaves meta, staging and the readable part of the log
+* untouched until readers_pause() returns. Other mutators stay blocked on lock.
+*/
+static inline void readers_resume(flash_mgr_state_t *mgr) {
+    if (mgr->lock_depth > 0) {
+        xSemaphoreGive(mgr->read_gate);
+    }
+}
+
+/**
+* @brief Wait for the readers let in by readers_resume() to finish
+*/
+static inline void readers_pause(flash_mgr_state_t *mgr) {
+    if (mgr->lock_depth > 0) {
+        xSemaphoreTake(mgr->read_gate, portMAX_DELAY);
+    }
+}
+
+static inline void read_lock(flash_mgr_state_t *mgr) {
+    if (mgr->reader_mutex) {
+        xSemaphoreTake(mgr->reader_mutex, portMAX_DELAY);
+        if (mgr->reader_count++ == 0) {
+            xSemaphoreTake(mgr->read_gate, portMAX_DELAY);
+        }
+        xSemaphoreGive(mgr->reader_mutex);
+    }
+}
+
+static inline void read_unlock(flash_mgr_state_t *mgr) {
+    if (mgr->reader_mutex) {
+        xSemaphoreTake(mgr->reader_mutex, portMAX_DELAY);
+        if (--mgr->reader_count == 0) {
+            xSemaphoreGive(mgr->read_gate);
+        }
+        xSemaphoreGive(mgr->reader_mutex);
+    }
+}
 
 // =============================================================================
 // PUBLIC API IMPLEMENTATION
@@ -89,6 +624,9 @@ flash_mgr_config_t flash_mgr_get_default_config(void) {
         .mount_point = FLASH_MGR_DEFAULT_MOUNT_POINT,
         .data_file = FLASH_MGR_DEFAULT_DATA_FILE,
         .meta_file = FLASH_MGR_DEFAULT_META_FILE,
+        .index_file = FLASH_MGR_DEFAULT_INDEX_FILE,
+        .rollup_file = FLASH_MGR_DEFAULT_ROLLUP_FILE,
+        .blob_file = FLASH_MGR_DEFAULT_BLOB_FILE,
         .partition_label = FLASH_MGR_DEFAULT_PARTITION_LABEL,
         
         // Memory Limits
@@ -99,13 +637,55 @@ flash_mgr_config_t flash_mgr_get_default_config(void) {
         .format_on_init = FLASH_MGR_DEFAULT_FORMAT_ON_INIT,
         .auto_cleanup = FLASH_MGR_DEFAULT_AUTO_CLEANUP,
         .cleanup_threshold = FLASH_MGR_DEFAULT_CLEANUP_THRESHOLD,
-        .cleanup_target = FLASH_MGR_DEFAULT_CLEANUP_TARGET
+        .cleanup_target = FLASH_MGR_DEFAULT_CLEANUP_TARGET,
+        
+        // Write Staging Configuration
+        .staging_entries = FLASH_MGR_DEFAULT_STAGING_ENTRIES,
+        .staging_max_age_ms = FLASH_MGR_DEFAULT_STAGING_MAX_AGE_MS,
+        
+        // Metadata Checkpointing
+        .meta_checkpoint_entries = FLASH_MGR_DEFAULT_META_CHECKPOINT_ENTRIES,
+        .meta_checkpoint_interval_ms = FLASH_MGR_DEFAULT_META_CHECKPOINT_INTERVAL_MS,
+        
+        // Storage Layout
+        .storage_mode = FLASH_MGR_DEFAULT_STORAGE_MODE,
+        .segment_size = FLASH_MGR_DEFAULT_SEGMENT_SIZE,
+        .compress_segments = FLASH_MGR_DEFAULT_COMPRESS_SEGMENTS,
+        .logical_delete = FLASH_MGR_DEFAULT_LOGICAL_DELETE,
+        .reclaim_threshold = FLASH_MGR_DEFAULT_RECLAIM_THRESHOLD,
+        
+        // Asynchronous Writer
+        .async_writer = FLASH_MGR_DEFAULT_ASYNC_WRITER,
+        .writer_queue_entries = FLASH_MGR_DEFAULT_WRITER_QUEUE_ENTRIES,
+        .writer_task_priority = FLASH_MGR_DEFAULT_WRITER_TASK_PRIORITY,
+        .writer_task_core = FLASH_MGR_DEFAULT_WRITER_TASK_CORE,
+        .writer_task_stack = FLASH_MGR_DEFAULT_WRITER_TASK_STACK,
+        .overflow_policy = FLASH_MGR_DEFAULT_OVERFLOW_POLICY,
+        .overflow_block_ms = FLASH_MGR_DEFAULT_OVERFLOW_BLOCK_MS,
+        
+        // ISR Appends
+        .isr_queue_entries = FLASH_MGR_DEFAULT_ISR_QUEUE_ENTRIES,
+        
+        // Time Index
+        .time_index_block = FLASH_MGR_DEFAULT_TIME_INDEX_BLOCK,
+        
+        // Rollups
+        .rollup_types = FLASH_MGR_DEFAULT_ROLLUP_TYPES,
+        .rollup_records = {
+            FLASH_MGR_DEFAULT_ROLLUP_MINUTE_RECORDS,
+            FLASH_MGR_DEFAULT_ROLLUP_HOUR_RECORDS,
+            FLASH_MGR_DEFAULT_ROLLUP_DAY_RECORDS
+        },
+        
+        // Named consumers
+        .consumer_cleanup_policy = FLASH_MGR_DEFAULT_CONSUMER_CLEANUP,
+        .stream_count = FLASH_MGR_DEFAULT_STREAM_COUNT
     };
     return config;
 }
 
-esp_err_t flash_mgr_init(const flash_mgr_config_t* config) {
-    if (g_state.initialized) {
+static esp_err_t open_log(flash_mgr_state_t *mgr, const flash_mgr_config_t *config) {
+    if (mgr->initialized) {
         ESP_LOGW(TAG, "Flash manager already initialized");
         return ESP_OK;
     }
@@ -142,217 +722,3432 @@ if (config->cleanup_threshold > 1.0f || config->cleanup_target > 1.0f ||
     ESP_LOGE(TAG, "Invalid cleanup ratios: must be between 0.0 and 1.0");
     return ESP_ERR_INVALID_ARG;
 }
+
+if (config->staging_entries > FLASH_MGR_MAX_STAGING_ENTRIES) {
+    ESP_LOGE(TAG, "Invalid staging_entries: %u (max %u)",
+                config->staging_entries, FLASH_MGR_MAX_STAGING_ENTRIES);
+    return ESP_ERR_INVALID_ARG;
+}
+
+if (config->storage_mode == FLASH_MGR_STORAGE_SEGMENTED &&
+    (config->segment_size < FLASH_MGR_MIN_SEGMENT_SIZE || config->segment_size > config->max_data_size)) {
+    ESP_LOGE(TAG, "Invalid segment_size: %u (must be %u-%u)",
+                config->segment_size, FLASH_MGR_MIN_SEGMENT_SIZE, config->max_data_size);
+    return ESP_ERR_INVALID_ARG;
+}
+
+if (config->logical_delete &&
+    (config->reclaim_threshold <= 0.0f || config->reclaim_threshold > 1.0f)) {
+    ESP_LOGE(TAG, "Invalid reclaim_threshold: %.2f (must be > 0.0 and <= 1.0)", config->reclaim_threshold);
+    return ESP_ERR_INVALID_ARG;
+}
+
+if (config->async_writer &&
+    (config->writer_queue_entries < 2 || config->writer_queue_entries > FLASH_MGR_MAX_WRITER_QUEUE_ENTRIES ||
+     (config->writer_queue_entries & (config->writer_queue_entries - 1)) != 0)) {
+    ESP_LOGE(TAG, "Invalid writer_queue_entries: %u (power of two, 2-%u)",
+                config->writer_queue_entries, FLASH_MGR_MAX_WRITER_QUEUE_ENTRIES);
+    return ESP_ERR_INVALID_ARG;
+}
+
+if (config->isr_queue_entries != 0 &&
+    (config->isr_queue_entries < 2 || config->isr_queue_entries > FLASH_MGR_MAX_ISR_QUEUE_ENTRIES ||
+     (config->isr_queue_entries & (config->isr_queue_entries - 1)) != 0)) {
+    ESP_LOGE(TAG, "Invalid isr_queue_entries: %u (0, or power of two 2-%u)",
+                config->isr_queue_entries, FLASH_MGR_MAX_ISR_QUEUE_ENTRIES);
+    return ESP_ERR_INVALID_ARG;
+}
+
+if (config->time_index_block != 0 &&
+    (config->time_index_block < FLASH_MGR_MIN_TIME_INDEX_BLOCK ||
+     config->time_index_block > FLASH_MGR_MAX_TIME_INDEX_BLOCK || !config->index_file)) {
+    ESP_LOGE(TAG, "Invalid time_index_block: %u (0, or %u-%u with an index_file)",
+                config->time_index_block, FLASH_MGR_MIN_TIME_INDEX_BLOCK, FLASH_MGR_MAX_TIME_INDEX_BLOCK);
+    return ESP_ERR_INVALID_ARG;
+}
+
+if (config->rollup_types > FLASH_MGR_MAX_ROLLUP_TYPES ||
+    (config->rollup_types > 0 && (!config->rollup_file || config->rollup_records[FLASH_MGR_ROLLUP_MINUTE] == 0 ||
+                                  config->rollup_records[FLASH_MGR_ROLLUP_HOUR] == 0 ||
+                                  config->rollup_records[FLASH_MGR_ROLLUP_DAY] == 0))) {
+    ESP_LOGE(TAG, "Invalid rollup_types: %u (0, or up to %u with a rollup_file and rollup_records)",
+                config->rollup_types, FLASH_MGR_MAX_ROLLUP_TYPES);
+    return ESP_ERR_INVALID_ARG;
+}
+
+if (config->stream_count > FLASH_MGR_MAX_STREAMS) {
+    ESP_LOGE(TAG, "Invalid stream_count: %u (max %u)", config->stream_count, FLASH_MGR_MAX_STREAMS);
+    return ESP_ERR_INVALID_ARG;
+}
+
+for (uint32_t i = 0; i < config->stream_count; i++) {
+    for (uint32_t j = 0; j < i; j++) {
+        if (config->streams[j].type == config->streams[i].type) {
+            ESP_LOGE(TAG, "Type %u has two streams", config->streams[i].type);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+}
     
     // Copy configuration
-    memcpy(&g_state.config, config, sizeof(flash_mgr_config_t));
+    memcpy(&mgr->config, config, sizeof(flash_mgr_config_t));
+    mgr->index.fd = -1;
+    mgr->rollups.fd = -1;
+    mgr->blobs.fd = -1;
+    
+    switch (config->storage_mode) {
+        case FLASH_MGR_STORAGE_FILE:
+            mgr->backend = config->logical_delete ? &s_file_logical_backend : &s_file_backend;
+            break;
+        case FLASH_MGR_STORAGE_SEGMENTED:
+            mgr->backend = &s_segment_backend;
+            mgr->seg_entries = config->segment_size / sizeof(flash_mgr_entry_t);
+            break;
+        case FLASH_MGR_STORAGE_RING:
+            mgr->backend = &s_ring_backend;
+            // The header takes the first slot, so the file is exactly max_data_size
+            mgr->ring_slots = config->max_data_size / sizeof(flash_mgr_entry_t) - 1;
+            mgr->fixed_capacity = mgr->ring_slots;
+            break;
+        case FLASH_MGR_STORAGE_RAW:
+            mgr->backend = &s_raw_backend;
+            // Whole sectors, plus a spare one so the oldest can be erased while full
+            mgr->raw_region_size = (config->max_data_size + FLASH_MGR_RAW_SECTOR_SIZE - 1) /
+                                   FLASH_MGR_RAW_SECTOR_SIZE * FLASH_MGR_RAW_SECTOR_SIZE +
+                                      FLASH_MGR_RAW_SECTOR_SIZE;
+            if (FLASH_MGR_EXT_FLASH_SIZE - mgr->raw_region_size < FLASH_MGR_MIN_LITTLEFS_SIZE) {
+                ESP_LOGE(TAG, "max_data_size %u leaves less than %u bytes for LittleFS",
+                        config->max_data_size, FLASH_MGR_MIN_LITTLEFS_SIZE);
+                return ESP_ERR_INVALID_ARG;
+            }
+            mgr->fixed_capacity = (mgr->raw_region_size / FLASH_MGR_RAW_SECTOR_SIZE - 1) *
+                                  FLASH_MGR_RAW_SLOTS_PER_SECTOR;
+            break;
+        default:
+            ESP_LOGE(TAG, "Invalid storage_mode: %d", config->storage_mode);
+            return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (mgr->fixed_capacity > 0 && config->staging_entries >= mgr->fixed_capacity) {
+        ESP_LOGE(TAG, "staging_entries (%u) must be smaller than the storage capacity (%u entries)",
+                config->staging_entries, mgr->fixed_capacity);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (s_mount.mounted && !mount_compatible(mgr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
     
     ESP_LOGI(TAG, "Initializing Flash Manager");
     ESP_LOGI(TAG, "  Max data size: %u bytes (%.1f MB)", 
             config->max_data_size, config->max_data_size / (1024.0 * 1024.0));
     ESP_LOGI(TAG, "  Chunk buffer: %u bytes", config->chunk_buffer_size);
+    ESP_LOGI(TAG, "  Storage: %s", mgr->backend->name);
     ESP_LOGI(TAG, "  Auto cleanup: %s", config->auto_cleanup ? "enabled" : "disabled");
+    ESP_LOGI(TAG, "  Staging: %u entries, max age %u ms", config->staging_entries, config->staging_max_age_ms);
+    ESP_LOGI(TAG, "  Metadata checkpoint: every %u entries / %u ms",
+            config->meta_checkpoint_entries, config->meta_checkpoint_interval_ms);
+    if (config->async_writer) {
+        ESP_LOGI(TAG, "  Async writer: %u entry queue, %s when full",
+                config->writer_queue_entries,
+                config->overflow_policy == FLASH_MGR_OVERFLOW_BLOCK ? "block" : "drop");
+    }
     
-    esp_err_t ret = init_external_flash();
+    // Later logs share the chip and the mount of the first one
+    bool shared = s_mount.mounted;
+    esp_err_t ret = ESP_OK;
+    if (shared) {
+        mgr->ext_flash = s_mount.ext_flash;
+    } else {
+        ret = init_external_flash(mgr);
+    }
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "External flash initialization failed");
         return ret;
     }
     
-    ret = init_littlefs();
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "LittleFS initialization failed");
-        return ret;
+    if (mgr->raw_region_size > 0) {
+        ret = init_raw_log(mgr);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Raw flash log initialization failed");
+            return ret;
+        }
+    }
+    
+    if (!shared) {
+        ret = init_littlefs(mgr);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "LittleFS initialization failed");
+            return ret;
+        }
+        s_mount.mounted = true;
+        s_mount.ext_flash = mgr->ext_flash;
+        s_mount.mount_point = config->mount_point;
+        s_mount.partition_label = config->partition_label;
+        s_mount.raw_region_size = mgr->raw_region_size;
     }
+    // The log holds the mount from here on; abandon_open() gives it back on failure
+    mgr->next_log = s_mount.logs;
+    s_mount.logs = mgr;
+    s_mount.users++;
     
-    ret = load_metadata();
+    ret = load_metadata(mgr);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Metadata loading failed");
-        return ret;
+        return abandon_open(mgr, ret);
     }
     
-    g_state.initialized = true;
-    
-    ESP_LOGI(TAG, "Flash manager initialized successfully");
-    ESP_LOGI(TAG, "  Max entries: %u", calculate_max_entries());
-    ESP_LOGI(TAG, "  Current entries: %u", g_state.meta.active_entries);
-    
-    return ESP_OK;
-}
-
-esp_err_t flash_mgr_deinit(void) {
-    if (!g_state.initialized) {
-        return ESP_OK;
+    // A capacity of one entry is plain write-through
+    mgr->staging_capacity = config->staging_entries > 0 ? config->staging_entries : 1;
+    mgr->staging = malloc(mgr->staging_capacity * sizeof(flash_mgr_entry_t));
+    if (!mgr->staging) {
+        ESP_LOGE(TAG, "Failed to allocate %u entry staging buffer", mgr->staging_capacity);
+        return abandon_open(mgr, ESP_ERR_NO_MEM);
+    }
+    mgr->staged_count = 0;
+    mgr->entries_since_checkpoint = 0;
+    mgr->last_checkpoint_us = esp_timer_get_time();
+    
+    mgr->read_gate = xSemaphoreCreateBinary();
+    mgr->reader_mutex = xSemaphoreCreateMutex();
+    mgr->lock = xSemaphoreCreateRecursiveMutex();
+    if (!mgr->lock || !mgr->read_gate || !mgr->reader_mutex) {
+        ESP_LOGE(TAG, "Failed to create state locks");
+        return abandon_open(mgr, ESP_ERR_NO_MEM);
+    }
+    xSemaphoreGive(mgr->read_gate);
+    
+    // Small sequential reads (read_chunk paging, get_by_id) share one open file and one large read,
+    // visitors borrow the buffer (every layout) so a scan needs no allocation
+    mgr->read_ahead.capacity = config->chunk_buffer_size / sizeof(flash_mgr_entry_t);
+    mgr->read_ahead.entries = malloc(mgr->read_ahead.capacity * sizeof(flash_mgr_entry_t));
+    mgr->read_ahead.lock = xSemaphoreCreateMutex();
+    if (!mgr->read_ahead.entries || !mgr->read_ahead.lock) {
+        ESP_LOGW(TAG, "No read-ahead buffer, reads go to flash directly");
+        free(mgr->read_ahead.entries);
+        mgr->read_ahead.entries = NULL;
     }
     
-    // Save metadata before deinitializing
-    save_metadata();
-    
-    // Unmount filesystem
-    esp_vfs_littlefs_unregister(g_state.config.partition_label);
-    
-    // Reset state
-    memset(&g_state, 0, sizeof(g_state));
-    
-    ESP_LOGI(TAG, "Flash manager deinitialized");
-    return ESP_OK;
-}
-
-bool flash_mgr_is_initialized(void) {
-    return g_state.initialized;
-}
-
-esp_err_t flash_mgr_append(uint8_t type, uint8_t unit, int32_t value_x1000) {
-    return flash_mgr_append_with_timestamp(get_current_timestamp(), type, unit, value_x1000);
-}
-
-esp_err_t flash_mgr_append_with_timestamp(uint32_t timestamp, uint8_t type, uint8_t unit, int32_t value_x1000) {
-    if (!g_state.initialized) {
-        ESP_LOGE(TAG, "Flash manager not initialized");
-        return ESP_ERR_INVALID_STATE;
+    if (config->time_index_block > 0 && init_time_index(mgr) != ESP_OK) {
+        // Only an accelerator: queries scan the whole log without it
+        ESP_LOGW(TAG, "Time index unavailable, time range queries will scan all entries");
+        flash_mgr_index_close(&mgr->index);
     }
     
-    flash_mgr_entry_t entry = {
-        .timestamp = timestamp,
-        .id = g_state.meta.next_id++,
-        .type = type,
-        .unit = unit,
-        .value_x1000 = value_x1000,
-        .reserved = {0}
-    };
+    if (config->rollup_types > 0 && init_rollups(mgr) != ESP_OK) {
+        ESP_LOGW(TAG, "Rollups unavailable");
+        flash_mgr_rollups_close(&mgr->rollups);
+    }
     
-#if FLASH_MGR_ENABLE_DEBUG_LOGS
-    ESP_LOGD(TAG, "Appending entry ID %u", entry.id);
-#endif
+    if (config->blob_file) {
+        uint32_t head_id = mgr->meta.deleted_from_start;
+        if (flash_mgr_blobs_open(&mgr->blobs, config->blob_file, head_id,
+                                 head_id + mgr->meta.active_entries) != ESP_OK) {
+            ESP_LOGW(TAG, "Blob file unavailable, blob appends will fail");
+        }
+    }
     
-    // Append to end of file
-    FILE *f = fopen(g_state.config.data_file, "ab");
-    if (!f) {
-        ESP_LOGE(TAG, "Failed to open data file for append");
-        return ESP_FAIL;
+    if (config->isr_queue_entries > 0) {
+        // Internal RAM, so ISRs never touch PSRAM
+        mgr->isr_queue_slots = heap_caps_malloc(config->isr_queue_entries * sizeof(flash_mgr_queue_slot_t),
+                                                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!mgr->isr_queue_slots) {
+            ESP_LOGE(TAG, "Failed to allocate %u entry ISR queue", config->isr_queue_entries);
+            return abandon_open(mgr, ESP_ERR_NO_MEM);
+        }
+        flash_mgr_queue_init(&mgr->isr_queue, mgr->isr_queue_slots, config->isr_queue_entries);
     }
     
-    size_t written = fwrite(&entry, sizeof(flash_mgr_entry_t), 1, f);
-    fclose(f);
+    publish_status(mgr);
+    mgr->initialized = true;
     
-    if (written != 1) {
-        ESP_LOGE(TAG, "Failed to write entry");
-        return ESP_FAIL;
+    // Formatting a shared partition would take the other logs with it, so only this log's files go
+    if (shared && config->format_on_init) {
+        ret = flash_mgr_log_format(mgr);
+        if (ret != ESP_OK) {
+            close_log(mgr);
+            return ret;
+        }
     }
     
-    // Update metadata
-    g_state.meta.total_entries++;
-    g_state.meta.active_entries++;
-    
-    // Check for auto cleanup
-    if (g_state.config.auto_cleanup) {
-        uint32_t current_size = g_state.meta.active_entries * sizeof(flash_mgr_entry_t);
-        float usage_ratio = (float)current_size / g_state.config.max_data_size;
-        
-        if (usage_ratio >= g_state.config.cleanup_threshold) {
-            ESP_LOGW(TAG, "Storage %.1f%% full, triggering auto cleanup", usage_ratio * 100);
-            esp_err_t cleanup_ret = perform_auto_cleanup();
-            if (cleanup_ret != ESP_OK) {
-                ESP_LOGE(TAG, "Auto cleanup failed: %s", esp_err_to_name(cleanup_ret));
-                // Continue anyway - don't fail the append operation
-            }
+    if (config->async_writer) {
+        ret = start_writer_task(mgr);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start writer task");
+            close_log(mgr);
+            return ret;
         }
     }
     
-    esp_err_t ret = save_metadata();
+    ret = open_streams(mgr);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save metadata");
+        close_log(mgr);
         return ret;
     }
     
-#if FLASH_MGR_ENABLE_DEBUG_LOGS
-    ESP_LOGD(TAG, "Entry appended successfully");
-#endif
+    ESP_LOGI(TAG, "Flash manager initialized successfully");
+    ESP_LOGI(TAG, "  Max entries: %u", calculate_max_entries(mgr));
+    ESP_LOGI(TAG, "  Current entries: %u", mgr->meta.active_entries);
     
     return ESP_OK;
 }
 
-esp_err_t flash_mgr_read_chunk(flash_mgr_entry_t* buffer, uint32_t max_entries, uint32_t* entries_read) {
-    if (!g_state.initialized || !buffer || !entries_read) {
-        return ESP_ERR_INVALID_ARG;
+static esp_err_t close_log(flash_mgr_state_t *mgr) {
+    if (!mgr->initialized) {
+        return ESP_OK;
     }
     
-    *entries_read = 0;
-    
-    if (g_state.meta.active_entries == 0) {
-        return ESP_OK; // No data to read
+    // Streams share the mount, so they go before it can be unmounted
+    for (uint32_t i = 0; i < mgr->stream_count; i++) {
+        close_log(mgr->streams[i]);
+        free(mgr->streams[i]);
     }
+    mgr->stream_count = 0;
     
-    FILE *f = fopen(g_state.config.data_file, "rb");
-    if (!f) {
-        ESP_LOGE(TAG, "Failed to open data file for reading");
-        return ESP_FAIL;
-    }
+    // Producers keep queueing until the writer is gone; flush picks up the rest
+    stop_writer_task(mgr);
     
-    // Read from beginning of file (oldest entries first)
-    uint32_t entries_to_read = (max_entries < g_state.meta.active_entries) ? 
-                            max_entries : g_state.meta.active_entries;
+    state_lock(mgr);
     
-    for (uint32_t i = 0; i < entries_to_read; i++) {
-        size_t read = fread(&buffer[i], sizeof(flash_mgr_entry_t), 1, f);
-        if (read != 1) {
-            // End of file or read error
-            break;
-        }
-        (*entries_read)++;
+    // Write out staged entries and save metadata before deinitializing
+    if (flash_mgr_log_flush(mgr) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to flush %u staged entries", mgr->staged_count);
     }
+    checkpoint_metadata(mgr, true);
     
-    fclose(f);
+    release_log(mgr);
     
-#if FLASH_MGR_ENABLE_DEBUG_LOGS
-    ESP_LOGD(TAG, "Read %u entries from start of file", *entries_read);
-#endif
+    // Reset state
+    SemaphoreHandle_t lock = mgr->lock;
+    SemaphoreHandle_t read_gate = mgr->read_gate;
+    SemaphoreHandle_t reader_mutex = mgr->reader_mutex;
+    memset(mgr, 0, sizeof(*mgr));
+    xSemaphoreGive(read_gate);
+    xSemaphoreGiveRecursive(lock);
+    vSemaphoreDelete(read_gate);
+    vSemaphoreDelete(reader_mutex);
+    vSemaphoreDelete(lock);
     
+    ESP_LOGI(TAG, "Flash manager deinitialized");
     return ESP_OK;
 }
 
-esp_err_t flash_mgr_delete(uint32_t count) {
-    if (!g_state.initialized) {
-        return ESP_ERR_INVALID_STATE;
+/**
+* @brief Release the files, buffers and mount share of a log, all but its state locks
+*/
+static void release_log(flash_mgr_state_t *mgr) {
+    // Open cursors only keep their (now closed) files until flash_mgr_iter_close()
+    release_read_handles(mgr);
+    records_release(mgr);
+    flash_mgr_index_close(&mgr->index);
+    flash_mgr_rollups_close(&mgr->rollups);
+    flash_mgr_blobs_close(&mgr->blobs);
+    
+    // Unmount filesystem once the last log is closed
+    for (flash_mgr_state_t **link = &s_mount.logs; *link; link = &(*link)->next_log) {
+        if (*link == mgr) {
+            *link = mgr->next_log;
+            break;
+        }
     }
-    
-    if (count > g_state.meta.active_entries) {
-        count = g_state.meta.active_entries;
+    if (--s_mount.users == 0) {
+        esp_vfs_littlefs_unregister(s_mount.partition_label);
+        memset(&s_mount, 0, sizeof(s_mount));
     }
     
-    if (count == 0) {
-        return ESP_OK;
+    free(mgr->staging);
+    free(mgr->ring_undo);
+    mgr->ring_undo = NULL;
+    mgr->ring_undo_capacity = 0;
+    mgr->ring_undo_count = 0;
+    free(mgr->queue_slots);
+    free(mgr->isr_queue_slots);
+    free(mgr->read_ahead.entries);
+    if (mgr->read_ahead.lock) {
+        vSemaphoreDelete(mgr->read_ahead.lock);
+    }
+    for (uint32_t i = 0; i < sizeof(mgr->stream_files) / sizeof(mgr->stream_files[0]); i++) {
+        free(mgr->stream_files[i]);
+    }
+}
+
+/**
+* @brief Undo an open_log() that failed after taking its share of the mount
+*/
+static esp_err_t abandon_open(flash_mgr_state_t *mgr, esp_err_t ret) {
+    release_log(mgr);
+    if (mgr->read_gate) {
+        vSemaphoreDelete(mgr->read_gate);
+    }
+    if (mgr->reader_mutex) {
+        vSemaphoreDelete(mgr->reader_mutex);
+    }
+    if (mgr->lock) {
+        vSemaphoreDelete(mgr->lock);
+    }
+    memset(mgr, 0, sizeof(*mgr));
+    return ret;
+}
+
+esp_err_t flash_mgr_open(const flash_mgr_config_t* config, flash_mgr_handle_t* handle) {
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
     }
     
-    ESP_LOGI(TAG, "Deleting %u entries", count);
+    flash_mgr_state_t *mgr = calloc(1, sizeof(flash_mgr_state_t));
+    if (!mgr) {
+        return ESP_ERR_NO_MEM;
+    }
     
-    // Calculate remaining data
-    uint32_t remaining_entries = g_state.meta.active_entries - count;
-    uint32_t bytes_to_skip = count * sizeof(flash_mgr_entry_t);
+    esp_err_t ret = open_log(mgr, config);
+    if (ret != ESP_OK) {
+        free(mgr);
+        return ret;
+    }
+    
+    *handle = mgr;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_close(flash_mgr_handle_t handle) {
+    // The default log belongs to flash_mgr_deinit(), streams to their log
+    if (!handle || handle == &s_default || handle->parent) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    esp_err_t ret = close_log(handle);
+    free(handle);
+    return ret;
+}
+
+bool flash_mgr_log_is_initialized(flash_mgr_handle_t mgr) {
+    return mgr && mgr->initialized;
+}
+
+esp_err_t flash_mgr_log_append(flash_mgr_handle_t mgr, uint8_t type, uint8_t unit, int32_t value_x1000) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return flash_mgr_log_append_with_timestamp(mgr, get_current_timestamp(mgr), type, unit, value_x1000);
+}
+
+esp_err_t flash_mgr_log_append_with_timestamp(flash_mgr_handle_t mgr, uint32_t timestamp, uint8_t type, uint8_t unit,
+                                              int32_t value_x1000) {
+    // Blob entries only come from the blob appends
+    if (!mgr || unit == FLASH_MGR_UNIT_BLOB) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    mgr = route(mgr, type);
+    if (!mgr->initialized) {
+        ESP_LOGE(TAG, "Flash manager not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (mgr->writer_task) {
+        return enqueue_entry(mgr, timestamp, type, unit, value_x1000);
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = append_entry(mgr, timestamp, type, unit, value_x1000);
+    state_unlock(mgr);
+    return ret;
+}
+
+static esp_err_t append_entry(flash_mgr_state_t *mgr, uint32_t timestamp, uint8_t type, uint8_t unit,
+                              int32_t value_x1000) {
+    // Entries queued from ISRs happened before this one
+    esp_err_t ret = drain_queue(mgr);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    return stage_entry(mgr, timestamp, type, unit, value_x1000);
+}
+
+/**
+* @brief Stage one entry with the next id, flushing when staging is due
+*/
+static esp_err_t stage_entry(flash_mgr_state_t *mgr, uint32_t timestamp, uint8_t type, uint8_t unit,
+                             int32_t value_x1000) {
+    esp_err_t ret;
+    
+    // Staging buffer still full from a failed flush - retry before accepting more
+    if (mgr->staged_count >= mgr->staging_capacity) {
+        ret = flush_and_checkpoint(mgr);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    
+    if (protected_room(mgr) == 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    flash_mgr_entry_t entry = {
+        .timestamp = timestamp,
+        .type = type,
+        .unit = unit,
+        .value_x1000 = value_x1000
+    };
+    
+    // Stage in RAM; the flash write happens once per batch
+    mgr->staging[mgr->staged_count] = entry;
+    stage_entries(mgr, 1);
+    
+#if FLASH_MGR_ENABLE_DEBUG_LOGS
+    ESP_LOGD(TAG, "Appended entry ID %u", mgr->meta.next_id - 1);
+#endif
+    
+    if (staging_flush_due(mgr)) {
+        ret = flush_and_checkpoint(mgr);
+        if (ret != ESP_OK) {
+            // Entry stays staged and is retried on the next append or flush
+            ESP_LOGE(TAG, "Failed to flush staged entries");
+            return ret;
+        }
+    }
+    
+    check_auto_cleanup(mgr);
+    
+#if FLASH_MGR_ENABLE_DEBUG_LOGS
+    ESP_LOGD(TAG, "Entry appended successfully");
+#endif
+    
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_log_append_blob(flash_mgr_handle_t mgr, uint8_t type, const void* data, size_t len) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return flash_mgr_log_append_blobs(mgr, type, data, len, 1);
+}
+
+esp_err_t flash_mgr_log_append_blobs(flash_mgr_handle_t mgr, uint8_t type, const void* records, size_t record_size,
+                                     uint32_t count) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    mgr = route(mgr, type);
+    if (!mgr->initialized) {
+        ESP_LOGE(TAG, "Flash manager not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (!records || record_size == 0 || record_size > FLASH_MGR_MAX_BLOB_SIZE || count == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (mgr->blobs.fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    state_lock(mgr);
+    // Payloads are stored under their entries' ids, so everything queued gets its id first
+    esp_err_t ret = drain_queue(mgr);
+    if (ret == ESP_OK && protected_room(mgr) < count) {
+        ret = ESP_ERR_NO_MEM;
+    }
+    uint32_t first_id = mgr->meta.next_id;
+    uint32_t offset = 0;
+    bool written = false;
+    if (ret == ESP_OK) {
+        // Readers only look at records below the end, which moves once the payloads are synced
+        readers_resume(mgr);
+        ret = flash_mgr_blobs_append(&mgr->blobs, first_id, records, record_size, count, &offset);
+        readers_pause(mgr);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write %u blobs of %u bytes", count, (unsigned)record_size);
+        }
+        written = ret == ESP_OK;
+    }
+    
+    uint32_t stride = sizeof(flash_mgr_blob_rec_t) + record_size;
+    for (uint32_t i = 0; ret == ESP_OK && i < count; i++) {
+        ret = stage_entry(mgr, get_current_timestamp(mgr), type, FLASH_MGR_UNIT_BLOB, (int32_t)(offset + i * stride));
+    }
+    uint32_t staged = mgr->meta.next_id - first_id;
+    if (written && staged < count) {
+        // No entry will ever point at the payloads that weren't staged
+        flash_mgr_blobs_truncate(&mgr->blobs, offset + staged * stride);
+    }
+    state_unlock(mgr);
+    return ret;
+}
+
+esp_err_t flash_mgr_log_read_blob(flash_mgr_handle_t mgr, uint32_t id, size_t offset, void* buffer, size_t size,
+                                  size_t* bytes_read, size_t* blob_len) {
+    if (!mgr || !mgr->initialized || !buffer || !bytes_read) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    *bytes_read = 0;
+    flash_mgr_entry_t entry;
+    uint32_t entries_read;
+    
+    read_lock(mgr);
+    esp_err_t ret = read_locked(mgr, id, &entry, 1, &entries_read, NULL);
+    if (ret == ESP_OK && (entries_read != 1 || entry.unit != FLASH_MGR_UNIT_BLOB)) {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    if (ret == ESP_OK) {
+        ret = flash_mgr_blobs_read(&mgr->blobs, (uint32_t)entry.value_x1000, id, offset, buffer, size,
+                                   bytes_read, blob_len);
+    }
+    read_unlock(mgr);
+    
+    return ret;
+}
+
+/**
+* @brief Whether no entry of a batch uses the unit reserved for blob entries (checked before any run is written)
+*/
+static bool batch_units_valid(const flash_mgr_entry_t *entries, uint32_t count) {
+    for (uint32_t i = 0; entries && i < count; i++) {
+        if (entries[i].unit == FLASH_MGR_UNIT_BLOB) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t flash_mgr_log_append_batch(flash_mgr_handle_t mgr, const flash_mgr_entry_t* entries, uint32_t count) {
+    if (!mgr || !batch_units_valid(entries, count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (mgr->stream_count > 0) {
+        return append_routed(mgr, entries, count, false);
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = append_batch(mgr, entries, count, false);
+    state_unlock(mgr);
+    return ret;
+}
+
+esp_err_t flash_mgr_log_append_batch_now(flash_mgr_handle_t mgr, const flash_mgr_entry_t* entries, uint32_t count) {
+    if (!mgr || !batch_units_valid(entries, count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (mgr->stream_count > 0) {
+        return append_routed(mgr, entries, count, true);
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = append_batch(mgr, entries, count, true);
+    state_unlock(mgr);
+    return ret;
+}
+
+static esp_err_t flush_and_checkpoint(flash_mgr_state_t *mgr) {
+    if (!mgr->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (mgr->staged_count == 0) {
+        return ESP_OK;
+    }
+    
+    esp_err_t ret = flush_staging(mgr);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // Acks only move cursors, the acked head goes with the next batch
+    ret = consumers_reclaim(mgr, false);
+    if (ret != ESP_OK) {
+        // The acked entries stay until the next attempt
+        ESP_LOGE(TAG, "Failed to delete acked entries: %s", esp_err_to_name(ret));
+    }
+    
+    // Counters are rebuilt from the data file on mount, so this is only periodic
+    ret = checkpoint_metadata(mgr, false);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save metadata");
+        return ret;
+    }
+    
+    // Compaction is deferred out of delete and amortized over writes
+    ret = maybe_reclaim(mgr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Reclaim failed: %s", esp_err_to_name(ret));
+        // Data is safe, the dead prefix just stays until the next attempt
+    }
+    
+    ret = seal_segments(mgr);
+    if (ret != ESP_OK) {
+        // The segment stays raw and is sealed on a later flush
+        ESP_LOGE(TAG, "Sealing failed: %s", esp_err_to_name(ret));
+    }
+    
+    ret = reclaim_blobs(mgr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Blob reclaim failed: %s", esp_err_to_name(ret));
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_log_flush(flash_mgr_handle_t mgr) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (!mgr->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    state_lock(mgr);
+    // Queued entries are older than anything appended after this call
+    esp_err_t ret = drain_queue(mgr);
+    if (ret == ESP_OK) {
+        ret = flush_and_checkpoint(mgr);
+    }
+    if (ret == ESP_OK) {
+        ret = records_sync(mgr);
+    }
+    state_unlock(mgr);
+    
+    for (uint32_t i = 0; ret == ESP_OK && i < mgr->stream_count; i++) {
+        ret = flash_mgr_log_flush(mgr->streams[i]);
+    }
+    return ret;
+}
+
+static esp_err_t reclaim_locked(flash_mgr_state_t *mgr) {
+    if (!mgr->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (!mgr->backend->reclaim || mgr->meta.head_offset == 0) {
+        return ESP_OK;
+    }
+    
+    ESP_LOGI(TAG, "Reclaiming %u deleted entries", mgr->meta.head_offset);
+    
+    esp_err_t ret = mgr->backend->reclaim(mgr);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // The head moved physically, so the old head_offset must not survive a reset
+    return checkpoint_metadata(mgr, true);
+}
+
+esp_err_t flash_mgr_log_reclaim(flash_mgr_handle_t mgr) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = reclaim_locked(mgr);
+    state_unlock(mgr);
+    return ret;
+}
+
+/**
+* @brief Read up to max_entries entries starting at id, from flash then staging
+* 
+* Ids before the head or past the newest entry read nothing. handle is only
+* used by backends with read_cached; reads without one go through the
+* read-ahead window.
+*/
+static esp_err_t read_locked(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t max_entries,
+                             uint32_t *entries_read, flash_mgr_read_handle_t *handle) {
+    *entries_read = 0;
+    
+    uint32_t head_id = mgr->meta.deleted_from_start;
+    uint32_t end_id = head_id + mgr->meta.active_entries;
+    if (id < head_id || id >= end_id) {
+        return ESP_OK; // No data to read
+    }
+    
+    uint32_t entries_to_read = (max_entries < end_id - id) ? max_entries : end_id - id;
+    uint32_t flushed_end = end_id - mgr->staged_count;
+    uint32_t from_file = 0;
+    if (id < flushed_end) {
+        from_file = (entries_to_read < flushed_end - id) ? entries_to_read : flushed_end - id;
+    }
+    
+    if (from_file > 0) {
+        esp_err_t ret;
+        if (handle && mgr->backend->read_cached) {
+            ret = mgr->backend->read_cached(mgr, handle, id, buffer, from_file, entries_read);
+        } else if (!handle && mgr->backend->read_cached && mgr->read_ahead.entries &&
+                   xSemaphoreTake(mgr->read_ahead.lock, 0) == pdTRUE) {
+            ret = read_ahead(mgr, id, buffer, from_file, flushed_end, entries_read);
+            xSemaphoreGive(mgr->read_ahead.lock);
+        } else {
+            ret = mgr->backend->read(mgr, id, buffer, from_file, entries_read);
+        }
+        if (ret != ESP_OK && *entries_read == 0) {
+            return ret;
+        }
+        
+        if (*entries_read != from_file) {
+            // Don't hand out staged entries after a gap
+            return ESP_OK;
+        }
+    }
+    
+    // Newest entries may still be in the staging buffer
+    uint32_t from_staging = entries_to_read - from_file;
+    if (from_staging > 0) {
+        memcpy(&buffer[from_file], &mgr->staging[id + from_file - flushed_end],
+               from_staging * sizeof(flash_mgr_entry_t));
+        *entries_read += from_staging;
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_log_read_chunk(flash_mgr_handle_t mgr, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                                   uint32_t* entries_read) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return flash_mgr_log_read_at(mgr, 0, buffer, max_entries, entries_read);
+}
+
+esp_err_t flash_mgr_log_read_at(flash_mgr_handle_t mgr, uint32_t start_index, flash_mgr_entry_t* buffer,
+                                uint32_t max_entries, uint32_t* entries_read) {
+    if (!mgr || !mgr->initialized || !buffer || !entries_read) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // Shared with other readers, only excluded while a mutator changes what they see
+    read_lock(mgr);
+    esp_err_t ret = ESP_OK;
+    *entries_read = 0;
+    if (start_index < mgr->meta.active_entries) {
+        ret = read_locked(mgr, mgr->meta.deleted_from_start + start_index, buffer, max_entries, entries_read, NULL);
+    }
+    read_unlock(mgr);
+    
+#if FLASH_MGR_ENABLE_DEBUG_LOGS
+    ESP_LOGD(TAG, "Read %u entries at index %u", *entries_read, start_index);
+#endif
+    
+    return ret;
+}
+
+esp_err_t flash_mgr_log_get_by_id(flash_mgr_handle_t mgr, uint32_t id, flash_mgr_entry_t* entry) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uint32_t entries_read;
+    return flash_mgr_log_read_id_range(mgr, id, id, entry, 1, &entries_read);
+}
+
+esp_err_t flash_mgr_log_read_id_range(flash_mgr_handle_t mgr, uint32_t first_id, uint32_t last_id,
+                                      flash_mgr_entry_t* buffer, uint32_t max_entries, uint32_t* entries_read) {
+    if (!mgr || !mgr->initialized || !buffer || !entries_read || last_id < first_id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    *entries_read = 0;
+    // (0, UINT32_MAX) spans 2^32 ids, one more than fits in 32 bits
+    uint64_t span = (uint64_t)last_id - first_id + 1;
+    uint32_t count = span < max_entries ? (uint32_t)span : max_entries;
+    
+    read_lock(mgr);
+    esp_err_t ret;
+    // Ids are contiguous, so anything outside [head, head + active) is gone or not written yet
+    if (first_id - mgr->meta.deleted_from_start >= mgr->meta.active_entries) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else {
+        ret = read_locked(mgr, first_id, buffer, count, entries_read, NULL);
+    }
+    read_unlock(mgr);
+    
+    if (ret == ESP_OK && *entries_read == 0 && count > 0) {
+        // The backend came up empty for a live id
+        ret = ESP_FAIL;
+    }
+    
+    return ret;
+}
+
+esp_err_t flash_mgr_log_iter_open(flash_mgr_handle_t mgr, uint32_t start_index, flash_mgr_iter_t** iter) {
+    if (!mgr || !mgr->initialized || !iter) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_iter_t *it = calloc(1, sizeof(flash_mgr_iter_t));
+    if (!it) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Registered under the writer lock, which is the only one walking the list
+    state_lock(mgr);
+    it->mgr = mgr;
+    it->next_id = mgr->meta.deleted_from_start + start_index;
+    it->next = mgr->iterators;
+    mgr->iterators = it;
+    state_unlock(mgr);
+    
+    *iter = it;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_iter_next(flash_mgr_iter_t* iter, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                              uint32_t* entries_read) {
+    if (!iter || !iter->mgr->initialized || !buffer || !entries_read) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_state_t *mgr = iter->mgr;
+    
+    read_lock(mgr);
+    // Entries under the cursor were deleted: carry on with the oldest
+    if (iter->next_id < mgr->meta.deleted_from_start) {
+        iter->next_id = mgr->meta.deleted_from_start;
+    }
+    esp_err_t ret = read_locked(mgr, iter->next_id, buffer, max_entries, entries_read, &iter->handle);
+    iter->next_id += *entries_read;
+    read_unlock(mgr);
+    
+    return ret;
+}
+
+void flash_mgr_iter_close(flash_mgr_iter_t* iter) {
+    if (!iter) {
+        return;
+    }
+    
+    flash_mgr_state_t *mgr = iter->mgr;
+    
+    state_lock(mgr);
+    for (flash_mgr_iter_t **link = &mgr->iterators; *link; link = &(*link)->next) {
+        if (*link == iter) {
+            *link = iter->next;
+            break;
+        }
+    }
+    state_unlock(mgr);
+    
+    read_handle_close(&iter->handle);
+    free(iter);
+}
+
+static esp_err_t delete_locked(flash_mgr_state_t *mgr, uint32_t count) {
+    if (!mgr->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (count > mgr->meta.active_entries) {
+        count = mgr->meta.active_entries;
+    }
+    
+    if (count == 0) {
+        return ESP_OK;
+    }
+    
+    // Deletion works on flash, so everything must be written out first
+    esp_err_t ret = flush_staging(mgr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to flush staged entries before delete");
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Deleting %u entries", count);
+    
+    rollups_protect(mgr, mgr->meta.deleted_from_start + count);
+    ret = mgr->backend->drop_head(mgr, count);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // Update metadata
+    mgr->meta.active_entries -= count;
+    mgr->meta.deleted_from_start += count;
+    consumers_skip_to(mgr, mgr->meta.deleted_from_start);
+    
+    // next_id can't be recovered from an empty log, and not every layout can find its head
+    ret = checkpoint_metadata(mgr, mgr->meta.active_entries == 0 || !mgr->backend->head_recoverable);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save metadata after deletion");
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Successfully deleted %u entries. Active: %u, Total deleted: %u", 
+            count, mgr->meta.active_entries, mgr->meta.deleted_from_start);
+    
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_log_delete(flash_mgr_handle_t mgr, uint32_t count) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = delete_locked(mgr, count);
+    state_unlock(mgr);
+    return ret;
+}
+
+/**
+* @brief Publish the counters for flash_mgr_get_status() (writer lock held)
+*/
+static void publish_status(flash_mgr_state_t *mgr) {
+    unsigned int seq = atomic_load_explicit(&mgr->status.seq, memory_order_relaxed);
+    flash_mgr_status_counters_t *next = &mgr->status.slots[(seq + 1) & 1];
+    
+    atomic_store_explicit(&next->total_entries, mgr->meta.total_entries, memory_order_relaxed);
+    atomic_store_explicit(&next->active_entries, mgr->meta.active_entries, memory_order_relaxed);
+    atomic_store_explicit(&next->deleted_entries, mgr->meta.deleted_from_start, memory_order_relaxed);
+    atomic_store_explicit(&next->pending_entries, mgr->staged_count, memory_order_relaxed);
+    atomic_store_explicit(&next->used_bytes, used_space_bytes(mgr), memory_order_relaxed);
+    atomic_store_explicit(&mgr->status.seq, seq + 1, memory_order_release);
+}
+
+esp_err_t flash_mgr_log_get_status(flash_mgr_handle_t mgr, flash_mgr_status_t* status) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (!status) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (!mgr->initialized) {
+        memset(status, 0, sizeof(flash_mgr_status_t));
+        status->initialized = false;
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    // Lock-free: copy the current slot, retry if anything was published meanwhile
+    unsigned int seq;
+    do {
+        seq = atomic_load_explicit(&mgr->status.seq, memory_order_acquire);
+        flash_mgr_status_counters_t *cur = &mgr->status.slots[seq & 1];
+        status->total_entries = atomic_load_explicit(&cur->total_entries, memory_order_relaxed);
+        status->active_entries = atomic_load_explicit(&cur->active_entries, memory_order_relaxed);
+        status->deleted_entries = atomic_load_explicit(&cur->deleted_entries, memory_order_relaxed);
+        status->pending_entries = atomic_load_explicit(&cur->pending_entries, memory_order_relaxed);
+        status->used_space_bytes = atomic_load_explicit(&cur->used_bytes, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&mgr->status.seq, memory_order_relaxed) != seq);
+    
+    status->free_space_bytes = status->used_space_bytes < mgr->config.max_data_size ?
+        mgr->config.max_data_size - status->used_space_bytes : 0;
+    status->queued_entries = mgr->queue_slots ? flash_mgr_queue_depth(&mgr->queue) : 0;
+    status->dropped_entries = mgr->queue_slots ?
+        atomic_load_explicit(&mgr->queue.dropped, memory_order_relaxed) : 0;
+    status->isr_queued_entries = mgr->isr_queue_slots ? flash_mgr_queue_depth(&mgr->isr_queue) : 0;
+    status->isr_dropped_entries = mgr->isr_queue_slots ?
+        atomic_load_explicit(&mgr->isr_queue.dropped, memory_order_relaxed) : 0;
+    status->initialized = true;
+    
+    return ESP_OK;
+}
+
+static esp_err_t cleanup_locked(flash_mgr_state_t *mgr, uint32_t target_entries) {
+    if (!mgr->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (target_entries >= mgr->meta.active_entries) {
+        ESP_LOGW(TAG, "Target entries %u >= active entries %u, no cleanup needed", 
+                target_entries, mgr->meta.active_entries);
+        return ESP_OK;
+    }
+    
+    uint32_t entries_to_remove = mgr->meta.active_entries - target_entries;
+    ESP_LOGI(TAG, "Manual cleanup: removing %u entries (keeping %u)", 
+            entries_to_remove, target_entries);
+    
+    return flash_mgr_log_delete(mgr, entries_to_remove);
+}
+
+esp_err_t flash_mgr_log_cleanup(flash_mgr_handle_t mgr, uint32_t target_entries) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = cleanup_locked(mgr, target_entries);
+    state_unlock(mgr);
+    return ret;
+}
+
+static esp_err_t format_locked(flash_mgr_state_t *mgr) {
+    if (!mgr->initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    ESP_LOGW(TAG, "Formatting storage - ALL DATA WILL BE LOST");
+    
+    // Remove data files and drop anything not yet written
+    mgr->backend->erase(mgr);
+    remove(mgr->config.meta_file);
+    mgr->staged_count = 0;
+    flash_mgr_entry_t discard[16];
+    if (mgr->queue_slots) {
+        while (flash_mgr_queue_pop(&mgr->queue, discard, 16) > 0) {
+        }
+    }
+    if (mgr->isr_queue_slots) {
+        while (flash_mgr_queue_pop(&mgr->isr_queue, discard, 16) > 0) {
+        }
+    }
+    
+    // Reset metadata; consumers stay registered and start over with the ids
+    memset(&mgr->meta, 0, sizeof(mgr->meta));
+    mgr->meta.magic = FLASH_MGR_METADATA_MAGIC;
+    for (int i = 0; i < FLASH_MGR_MAX_CONSUMERS; i++) {
+        mgr->consumers[i].cursor = 0;
+    }
+    
+    // Ids start over, so old index records would match new blocks
+    if (mgr->index.fd >= 0) {
+        flash_mgr_index_close(&mgr->index);
+        remove(mgr->config.index_file);
+        if (init_time_index(mgr) != ESP_OK) {
+            ESP_LOGW(TAG, "Time index unavailable after format");
+            flash_mgr_index_close(&mgr->index);
+        }
+    }
+    
+    // Rollups describe the entries, so they go too
+    if (mgr->rollups.fd >= 0) {
+        flash_mgr_rollups_close(&mgr->rollups);
+        remove(mgr->config.rollup_file);
+        if (init_rollups(mgr) != ESP_OK) {
+            ESP_LOGW(TAG, "Rollups unavailable after format");
+            flash_mgr_rollups_close(&mgr->rollups);
+        }
+    }
+    
+    if (mgr->blobs.fd >= 0 && flash_mgr_blobs_reset(&mgr->blobs, mgr->config.blob_file) != ESP_OK) {
+        ESP_LOGW(TAG, "Blob file unavailable after format");
+    }
+    
+    records_format(mgr);
+    
+    esp_err_t ret = checkpoint_metadata(mgr, true);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save metadata after format");
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Storage formatted successfully");
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_log_format(flash_mgr_handle_t mgr) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = format_locked(mgr);
+    state_unlock(mgr);
+    
+    for (uint32_t i = 0; ret == ESP_OK && i < mgr->stream_count; i++) {
+        ret = flash_mgr_log_format(mgr->streams[i]);
+    }
+    return ret;
+}
+
+esp_err_t flash_mgr_get_fs_info(size_t* total_bytes, size_t* used_bytes) {
+    if (s_mount.users == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    return esp_littlefs_info(s_mount.partition_label, total_bytes, used_bytes);
+}
+
+// =============================================================================
+// INTERNAL FUNCTION IMPLEMENTATIONS
+// =============================================================================
+
+/**
+* @brief Whether a log can join the mount of the logs already open
+* 
+* They must name the same mount, only one of them can have the raw region the
+* mount was sized for, and no two may share a file.
+*/
+static bool mount_compatible(const flash_mgr_state_t *mgr) {
+    const flash_mgr_config_t *config = &mgr->config;
+    
+    if (strcmp(config->mount_point, s_mount.mount_point) != 0 ||
+        strcmp(config->partition_label, s_mount.partition_label) != 0) {
+        ESP_LOGE(TAG, "Logs must share one mount (%s, partition %s)", s_mount.mount_point, s_mount.partition_label);
+        return false;
+    }
+    
+    if (mgr->raw_region_size > 0 && mgr->raw_region_size != s_mount.raw_region_size) {
+        ESP_LOGE(TAG, "RAW mode needs the raw region reserved when LittleFS was mounted (%u bytes)",
+                s_mount.raw_region_size);
+        return false;
+    }
+    
+    const char *files[5] = {
+        config->data_file,
+        config->meta_file,
+        config->time_index_block > 0 ? config->index_file : NULL,
+        config->rollup_types > 0 ? config->rollup_file : NULL,
+        config->blob_file
+    };
+    for (const flash_mgr_state_t *log = s_mount.logs; log; log = log->next_log) {
+        if (mgr->raw_region_size > 0 && log->raw_region_size > 0) {
+            ESP_LOGE(TAG, "Only one log can use RAW mode");
+            return false;
+        }
+        
+        const char *other[5] = {
+            log->config.data_file,
+            log->config.meta_file,
+            log->index.fd >= 0 ? log->config.index_file : NULL,
+            log->rollups.fd >= 0 ? log->config.rollup_file : NULL,
+            log->config.blob_file
+        };
+        for (int i = 0; i < 5; i++) {
+            for (int j = 0; j < 5; j++) {
+                if (files[i] && other[j] && strcmp(files[i], other[j]) == 0) {
+                    ESP_LOGE(TAG, "%s is already used by another log", files[i]);
+                    return false;
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+static esp_err_t init_external_flash(flash_mgr_state_t *mgr) {
+    spi_bus_config_t bus_cfg = {
+        .mosi_io_num = mgr->config.mosi_pin,
+        .miso_io_num = mgr->config.miso_pin,
+        .sclk_io_num = mgr->config.sclk_pin,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1
+    };
+    
+    esp_err_t ret = spi_bus_initialize(mgr->config.spi_host, &bus_cfg, SPI_DMA_CH_AUTO);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "SPI bus init failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    esp_flash_spi_device_config_t flash_cfg = {
+        .host_id = mgr->config.spi_host,
+        .cs_io_num = mgr->config.cs_pin,
+        .cs_id = 0,
+        .freq_mhz = mgr->config.freq_mhz,
+        .io_mode = SPI_FLASH_FASTRD
+    };
+    
+    ret = spi_bus_add_flash_device(&mgr->ext_flash, &flash_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Add flash device failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ret = esp_flash_init(mgr->ext_flash);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Flash init failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    uint32_t jedec_id;
+    ret = esp_flash_read_id(mgr->ext_flash, &jedec_id);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "JEDEC read failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "External flash initialized - JEDEC ID: 0x%06X", jedec_id);
+    return ESP_OK;
+}
+
+static esp_err_t init_littlefs(flash_mgr_state_t *mgr) {
+    static esp_partition_t ext_partition = {
+        .type = ESP_PARTITION_TYPE_DATA,
+        .subtype = ESP_PARTITION_SUBTYPE_DATA_LITTLEFS,
+        .address = 0x0,
+        .size = FLASH_MGR_EXT_FLASH_SIZE,
+        .encrypted = false,
+        .readonly = false
+    };
+    
+    // Set partition label and flash chip
+    strncpy((char*)ext_partition.label, mgr->config.partition_label, sizeof(ext_partition.label) - 1);
+    ext_partition.flash_chip = mgr->ext_flash;
+    
+    // RAW mode keeps the top of the chip for the entry log
+    ext_partition.size = FLASH_MGR_EXT_FLASH_SIZE - mgr->raw_region_size;
+    
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = mgr->config.mount_point,
+        .partition = &ext_partition,
+        .format_if_mount_failed = mgr->config.format_on_init,
+        .dont_mount = false,
+        .grow_on_mount = false
+    };
+    
+    if (mgr->config.format_on_init) {
+        ESP_LOGI(TAG, "Formatting external flash...");
+        esp_err_t fmt_ret = esp_littlefs_format_partition(&ext_partition);
+        if (fmt_ret != ESP_OK) {
+            ESP_LOGE(TAG, "Format failed: %s", esp_err_to_name(fmt_ret));
+            return fmt_ret;
+        }
+    }
+    
+    esp_err_t ret = esp_vfs_littlefs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "LittleFS mount failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "LittleFS mounted at %s", mgr->config.mount_point);
+    return ESP_OK;
+}
+
+static esp_err_t load_metadata(flash_mgr_state_t *mgr) {
+    mgr->meta_seq = 0;
+    FILE *f = fopen(mgr->config.meta_file, "rb");
+    if (!f) {
+        // First boot - initialize metadata
+        memset(&mgr->meta, 0, sizeof(mgr->meta));
+        mgr->meta.magic = FLASH_MGR_METADATA_MAGIC;
+        ESP_LOGI(TAG, "Initializing fresh metadata");
+        return recover_from_data_file(mgr);
+    }
+    
+    // Newest valid slot; without one, the file may predate the slots
+    bool found = false;
+    flash_mgr_meta_slot_t slot;
+    for (uint32_t i = 0; i < 2; i++) {
+        if (fseek(f, (long)(i * sizeof(slot)), SEEK_SET) == 0 && fread(&slot, sizeof(slot), 1, f) == 1 &&
+            meta_slot_valid(&slot) && (!found || (int32_t)(slot.seq - mgr->meta_seq) > 0)) {
+            mgr->meta = slot.meta;
+            memcpy(mgr->consumers, slot.consumers, sizeof(mgr->consumers));
+            mgr->meta_seq = slot.seq;
+            found = true;
+        }
+    }
+    
+    size_t read = found ? 1 : 0;
+    if (!found && fseek(f, 0, SEEK_SET) == 0) {
+        // No head offset or consumers back then
+        memset(&mgr->meta, 0, sizeof(mgr->meta));
+        memset(mgr->consumers, 0, sizeof(mgr->consumers));
+        read = fread(&mgr->meta, FLASH_MGR_LEGACY_METADATA_SIZE, 1, f);
+    }
+    fclose(f);
+    
+    if (read != 1 || mgr->meta.magic != FLASH_MGR_METADATA_MAGIC) {
+        // The data file is authoritative, so a bad checkpoint is not fatal
+        ESP_LOGW(TAG, "Invalid metadata checkpoint, rebuilding from data file");
+        memset(&mgr->meta, 0, sizeof(mgr->meta));
+        memset(mgr->consumers, 0, sizeof(mgr->consumers));
+        mgr->meta.magic = FLASH_MGR_METADATA_MAGIC;
+        return recover_from_data_file(mgr);
+    }
+    
+    ESP_LOGI(TAG, "Loaded metadata - active: %u, total: %u, deleted: %u",
+            mgr->meta.active_entries, mgr->meta.total_entries, mgr->meta.deleted_from_start);
+    
+    esp_err_t ret = recover_from_data_file(mgr);
+    
+    // Entries past the end were lost with the log; their ids get handed out again
+    for (int i = 0; i < FLASH_MGR_MAX_CONSUMERS; i++) {
+        if (mgr->consumers[i].cursor > mgr->meta.next_id) {
+            mgr->consumers[i].cursor = mgr->meta.next_id;
+        }
+    }
+    
+    return ret;
+}
+
+/**
+* @brief Bring the metadata checkpoint up to date with the data on flash
+* 
+* Metadata is only saved periodically, so after a reset the checkpoint can lag
+* behind the log. Entry ids are contiguous, so the id range the backend finds
+* on flash reconstructs every counter: next_id follows the last id and, where
+* the backend can tell, deleted_from_start is the first id. Only an empty log
+* relies on the checkpoint, for next_id.
+*/
+static esp_err_t recover_from_data_file(flash_mgr_state_t *mgr) {
+    uint32_t first_id = 0;
+    uint32_t end_id = 0;
+    
+    esp_err_t ret = mgr->backend->recover(mgr, &first_id, &end_id);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    if (first_id == end_id) {
+        mgr->meta.active_entries = 0;
+        mgr->meta.deleted_from_start = mgr->meta.next_id;
+        mgr->meta.total_entries = mgr->meta.next_id;
+        mgr->meta.head_offset = 0;
+        return ESP_OK;
+    }
+    
+    uint32_t head_id = first_id;
+    if (!mgr->backend->head_recoverable) {
+        // Head comes from the checkpoint, which is forced on every delete
+        head_id = mgr->meta.deleted_from_start;
+        if (head_id < first_id) {
+            head_id = first_id;
+        } else if (head_id > end_id) {
+            head_id = end_id;
+        }
+    }
+    
+    // Same bound append applies: beyond the capacity the oldest entries count as overwritten
+    if (mgr->fixed_capacity > 0 && end_id - head_id > mgr->fixed_capacity) {
+        head_id = end_id - mgr->fixed_capacity;
+    }
+    
+    uint32_t active = end_id - head_id;
+    if (mgr->meta.active_entries != active || mgr->meta.next_id != end_id) {
+        ESP_LOGI(TAG, "Recovered from data file - active: %u -> %u, next id: %u -> %u",
+                mgr->meta.active_entries, active, mgr->meta.next_id, end_id);
+    }
+    
+    mgr->meta.active_entries = active;
+    mgr->meta.next_id = end_id;
+    mgr->meta.total_entries = end_id;
+    mgr->meta.deleted_from_start = head_id;
+    mgr->meta.head_offset = head_id - first_id;
+    
+    return ESP_OK;
+}
+
+static bool meta_slot_valid(const flash_mgr_meta_slot_t *slot) {
+    return slot->magic == FLASH_MGR_META_SLOT_MAGIC && slot->meta.magic == FLASH_MGR_METADATA_MAGIC &&
+           slot->crc == flash_mgr_crc32(0, slot, offsetof(flash_mgr_meta_slot_t, crc));
+}
+
+static esp_err_t save_metadata(flash_mgr_state_t *mgr) {
+    flash_mgr_meta_slot_t slot = {
+        .magic = FLASH_MGR_META_SLOT_MAGIC,
+        .seq = mgr->meta_seq + 1,
+        .meta = mgr->meta
+    };
+    memcpy(slot.consumers, mgr->consumers, sizeof(slot.consumers));
+    slot.crc = flash_mgr_crc32(0, &slot, offsetof(flash_mgr_meta_slot_t, crc));
+    
+    // Overwrite the older slot in place; "wb" would truncate the newer one with it
+    FILE *f = fopen(mgr->config.meta_file, "r+b");
+    if (!f) {
+        f = fopen(mgr->config.meta_file, "wb");
+    }
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open metadata file for writing");
+        return ESP_FAIL;
+    }
+    
+    bool ok = fseek(f, (long)((slot.seq & 1) * sizeof(slot)), SEEK_SET) == 0 &&
+              fwrite(&slot, sizeof(slot), 1, f) == 1;
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to write metadata");
+        return ESP_FAIL;
+    }
+    
+    mgr->meta_seq = slot.seq;
+    return ESP_OK;
+}
+
+static esp_err_t checkpoint_metadata(flash_mgr_state_t *mgr, bool force) {
+    if (!force) {
+        bool due = false;
+        
+        if (mgr->config.meta_checkpoint_entries > 0 &&
+            mgr->entries_since_checkpoint >= mgr->config.meta_checkpoint_entries) {
+            due = true;
+        }
+        
+        if (mgr->config.meta_checkpoint_interval_ms > 0 &&
+            esp_timer_get_time() - mgr->last_checkpoint_us >=
+                (int64_t)mgr->config.meta_checkpoint_interval_ms * 1000) {
+            due = true;
+        }
+        
+        if (!due) {
+            return ESP_OK;
+        }
+    }
+    
+    esp_err_t ret = save_metadata(mgr);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    // Open windows are lost on reset unless their entries can be replayed, so
+    // they're saved on the same schedule
+    if (mgr->rollups.fd >= 0) {
+        flash_mgr_rollups_save(&mgr->rollups);
+    }
+    
+    mgr->entries_since_checkpoint = 0;
+    mgr->last_checkpoint_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+static esp_err_t maybe_reclaim(flash_mgr_state_t *mgr) {
+    if (!mgr->backend->reclaim || mgr->meta.head_offset == 0) {
+        return ESP_OK;
+    }
+    
+    uint32_t stored_entries = mgr->meta.head_offset + mgr->meta.active_entries - mgr->staged_count;
+    float dead_ratio = (float)mgr->meta.head_offset / stored_entries;
+    if (dead_ratio < mgr->config.reclaim_threshold) {
+        return ESP_OK;
+    }
+    
+    return flash_mgr_log_reclaim(mgr);
+}
+
+/**
+* @brief Compact the blob file once enough of it belongs to deleted entries
+* 
+* Same threshold as the data file. The copy is made with readers in; they're
+* only excluded for the swap.
+*/
+static esp_err_t reclaim_blobs(flash_mgr_state_t *mgr) {
+    if (mgr->blobs.fd < 0) {
+        return ESP_OK;
+    }
+    
+    uint32_t dead = flash_mgr_blobs_advance(&mgr->blobs, mgr->meta.deleted_from_start);
+    uint32_t size = mgr->blobs.end - mgr->blobs.base;
+    if (dead == 0 || (float)dead / size < mgr->config.reclaim_threshold) {
+        return ESP_OK;
+    }
+    
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", mgr->config.blob_file);
+    
+    readers_resume(mgr);
+    esp_err_t ret = flash_mgr_blobs_copy_live(&mgr->blobs, tmp_path);
+    readers_pause(mgr);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ret = flash_mgr_blobs_swap(&mgr->blobs, mgr->config.blob_file, tmp_path);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Reclaimed %u bytes of blobs", dead);
+    }
+    return ret;
+}
+
+static uint32_t blob_bytes(flash_mgr_state_t *mgr) {
+    return mgr->blobs.fd >= 0 ? mgr->blobs.end - mgr->blobs.live : 0;
+}
+
+/**
+* @brief Entries that fill max_data_size next to the live blobs
+*/
+static uint32_t entry_limit(flash_mgr_state_t *mgr) {
+    float blob_share = (float)blob_bytes(mgr) / mgr->config.max_data_size;
+    return blob_share < 1.0f ? (uint32_t)(calculate_max_entries(mgr) * (1.0f - blob_share)) : 0;
+}
+
+static void check_auto_cleanup(flash_mgr_state_t *mgr) {
+    // A ring makes room by overwriting, at no extra cost
+    if (!mgr->config.auto_cleanup || mgr->fixed_capacity > 0) {
+        return;
+    }
+    
+    float usage_ratio = (float)mgr->meta.active_entries / calculate_max_entries(mgr) +
+                        (float)blob_bytes(mgr) / mgr->config.max_data_size;
+    
+    if (usage_ratio < mgr->config.cleanup_threshold) {
+        mgr->cleanup_held = false;
+    } else {
+        // Once consumers hold cleanup back, this would repeat on every append
+        if (!mgr->cleanup_held) {
+            ESP_LOGW(TAG, "Storage %.1f%% full, triggering auto cleanup", usage_ratio * 100);
+        }
+        esp_err_t cleanup_ret = perform_auto_cleanup(mgr);
+        if (cleanup_ret != ESP_OK) {
+            ESP_LOGE(TAG, "Auto cleanup failed: %s", esp_err_to_name(cleanup_ret));
+            // Continue anyway - don't fail the append operation
+        }
+    }
+}
+
+/**
+* @brief Assign ids to the count entries placed after the staged ones and count them as staged
+*/
+static void stage_entries(flash_mgr_state_t *mgr, uint32_t count) {
+    if (mgr->staged_count == 0) {
+        mgr->staged_since_us = esp_timer_get_time();
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        flash_mgr_entry_t *entry = &mgr->staging[mgr->staged_count + i];
+        entry->id = mgr->meta.next_id++;
+        flash_mgr_entry_seal(entry);
+    }
+    
+    mgr->staged_count += count;
+    mgr->meta.total_entries += count;
+    mgr->meta.active_entries += count;
+    
+    // A ring overwrites its oldest entry instead of growing
+    if (mgr->fixed_capacity > 0 && mgr->meta.active_entries > mgr->fixed_capacity) {
+        uint32_t overwritten = mgr->meta.active_entries - mgr->fixed_capacity;
+        mgr->meta.active_entries -= overwritten;
+        mgr->meta.deleted_from_start += overwritten;
+    }
+}
+
+/**
+* @brief Count entries that went to flash without passing through staging
+*/
+static void account_flushed(flash_mgr_state_t *mgr, uint32_t count) {
+    mgr->meta.next_id += count;
+    mgr->meta.total_entries += count;
+    mgr->meta.active_entries += count;
+    mgr->entries_since_checkpoint += count;
+    
+    if (mgr->fixed_capacity > 0 && mgr->meta.active_entries > mgr->fixed_capacity) {
+        uint32_t overwritten = mgr->meta.active_entries - mgr->fixed_capacity;
+        mgr->meta.active_entries -= overwritten;
+        mgr->meta.deleted_from_start += overwritten;
+    }
+}
+
+static esp_err_t append_batch(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                              bool stamp_now) {
+    if (!mgr->initialized) {
+        ESP_LOGE(TAG, "Flash manager not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (count == 0) {
+        return ESP_OK;
+    }
+    
+    if (!entries) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uint32_t capacity = mgr->fixed_capacity > 0 ? mgr->fixed_capacity : calculate_max_entries(mgr);
+    if (count > capacity) {
+        ESP_LOGE(TAG, "Batch of %u entries exceeds storage capacity (%u)", count, capacity);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    // Earlier appends go first, and are kept even if the batch fails
+    esp_err_t ret = drain_queue(mgr);
+    if (ret == ESP_OK) {
+        ret = flush_staging(mgr);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    if (protected_room(mgr) < count) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // The (now empty) staging buffer doubles as the write buffer when the batch fits
+    flash_mgr_entry_t *batch = mgr->staging;
+    if (count > mgr->staging_capacity) {
+        batch = malloc(count * sizeof(flash_mgr_entry_t));
+        if (!batch) {
+            ESP_LOGE(TAG, "Failed to allocate %u entry batch buffer", count);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    
+    uint32_t first_id = mgr->meta.next_id;
+    for (uint32_t i = 0; i < count; i++) {
+        batch[i] = entries[i];
+        batch[i].id = first_id + i;
+        if (stamp_now) {
+            batch[i].timestamp = get_current_timestamp(mgr);
+        }
+        flash_mgr_entry_seal(&batch[i]);
+    }
+    
+    if (mgr->fixed_capacity > 0 && first_id + count > mgr->fixed_capacity) {
+        rollups_protect(mgr, first_id + count - mgr->fixed_capacity);
+    }
+    
+    flash_mgr_metadata_t saved_meta = mgr->meta;
+    uint32_t written = 0;
+    // The new ids stay invisible until account_flushed(mgr)
+    bool shared = !mgr->backend->overwrites_live;
+    if (shared) {
+        readers_resume(mgr);
+    }
+    ret = mgr->backend->append(mgr, batch, count, &written);
+    if (shared) {
+        readers_pause(mgr);
+    }
+    
+    if (ret != ESP_OK || written != count) {
+        ESP_LOGE(TAG, "Batch write failed: wrote %u of %u, rolling back", written, count);
+        // A backend may adjust the head while appending (raw sector recycling)
+        mgr->meta = saved_meta;
+        if (mgr->backend->truncate(mgr, first_id) != ESP_OK) {
+            // Ids must never go backwards on flash, so what couldn't be removed is kept
+            ESP_LOGE(TAG, "Can't remove partial batch from flash, keeping %u entries", written);
+            account_flushed(mgr, written);
+            index_flushed(mgr, batch, written);
+            rollups_flushed(mgr, batch, written);
+            if (mgr->backend == &s_ring_backend && mgr->meta.active_entries == mgr->fixed_capacity) {
+                // The slot after the prefix held the head and may be torn
+                mgr->meta.active_entries--;
+                mgr->meta.deleted_from_start++;
+            }
+        }
+        if (batch != mgr->staging) {
+            free(batch);
+        }
+        return ret != ESP_OK ? ret : ESP_FAIL;
+    }
+    
+    account_flushed(mgr, count);
+    index_flushed(mgr, batch, count);
+    rollups_flushed(mgr, batch, count);
+    if (batch != mgr->staging) {
+        free(batch);
+    }
+    
+#if FLASH_MGR_ENABLE_DEBUG_LOGS
+    ESP_LOGD(TAG, "Appended batch of %u entries, ids %u-%u", count, first_id, first_id + count - 1);
+#endif
+    
+    ret = checkpoint_metadata(mgr, false);
+    if (ret != ESP_OK) {
+        // The batch is on flash and recovered from there after a reset
+        ESP_LOGE(TAG, "Failed to save metadata");
+    }
+    
+    ret = maybe_reclaim(mgr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Reclaim failed: %s", esp_err_to_name(ret));
+    }
+    
+    ret = seal_segments(mgr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Sealing failed: %s", esp_err_to_name(ret));
+    }
+    
+    ret = reclaim_blobs(mgr);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Blob reclaim failed: %s", esp_err_to_name(ret));
+    }
+    
+    check_auto_cleanup(mgr);
+    
+    return ESP_OK;
+}
+
+/**
+* @brief Entries on flash and the bytes they take, when sealed segments make that differ from 16 per entry
+*/
+static bool packed_footprint(flash_mgr_state_t *mgr, uint32_t *entries, uint32_t *bytes) {
+    if (mgr->backend != &s_segment_backend || mgr->seg_sealed <= mgr->seg_first || mgr->seg_bytes == 0) {
+        return false;
+    }
+    uint32_t flushed_end = mgr->meta.deleted_from_start + mgr->meta.active_entries - mgr->staged_count;
+    *entries = flushed_end - mgr->seg_first * mgr->seg_entries;
+    *bytes = mgr->seg_bytes;
+    return *entries > 0;
+}
+
+static uint32_t calculate_max_entries(flash_mgr_state_t *mgr) {
+    uint32_t max_entries = mgr->config.max_data_size / sizeof(flash_mgr_entry_t);
+    uint32_t stored;
+    uint32_t bytes;
+    // Sealed segments hold more history in the same space; the raw tail keeps the estimate conservative
+    if (packed_footprint(mgr, &stored, &bytes) && bytes < stored * sizeof(flash_mgr_entry_t)) {
+        max_entries = (uint32_t)((uint64_t)mgr->config.max_data_size * stored / bytes);
+    }
+    return max_entries;
+}
+
+static uint32_t used_space_bytes(flash_mgr_state_t *mgr) {
+    uint32_t stored;
+    uint32_t bytes;
+    if (packed_footprint(mgr, &stored, &bytes)) {
+        return (uint32_t)((uint64_t)bytes * mgr->meta.active_entries / stored) + blob_bytes(mgr);
+    }
+    return mgr->meta.active_entries * sizeof(flash_mgr_entry_t) + blob_bytes(mgr);
+}
+
+static esp_err_t perform_auto_cleanup(flash_mgr_state_t *mgr) {
+    uint32_t max_entries = calculate_max_entries(mgr);
+    uint32_t target_entries = (uint32_t)(max_entries * mgr->config.cleanup_target);
+    if (blob_bytes(mgr) > 0) {
+        // Blobs count against the same space; keep the share of entries that leaves usage at the target
+        float usage_ratio = (float)mgr->meta.active_entries / max_entries +
+                            (float)blob_bytes(mgr) / mgr->config.max_data_size;
+        target_entries = (uint32_t)(mgr->meta.active_entries * mgr->config.cleanup_target / usage_ratio);
+    }
+    
+    if (mgr->meta.active_entries <= target_entries) {
+        return ESP_OK; // Already at target
+    }
+    
+    uint32_t entries_to_remove = mgr->meta.active_entries - target_entries;
+    uint32_t slowest;
+    if (mgr->config.consumer_cleanup_policy == FLASH_MGR_CONSUMER_CLEANUP_PROTECT && slowest_cursor(mgr, &slowest)) {
+        uint32_t acked = slowest - mgr->meta.deleted_from_start;
+        if (entries_to_remove > acked) {
+            if (!mgr->cleanup_held) {
+                ESP_LOGW(TAG, "Auto cleanup: only %u of %u entries acked by every consumer", acked, entries_to_remove);
+            }
+            mgr->cleanup_held = true;
+            entries_to_remove = acked;
+        } else {
+            mgr->cleanup_held = false;
+        }
+        if (entries_to_remove == 0) {
+            return ESP_OK;
+        }
+    }
+    
+    ESP_LOGI(TAG, "Auto cleanup: removing %u entries (keeping %u)", 
+            entries_to_remove, target_entries);
+    
+    return flash_mgr_log_delete(mgr, entries_to_remove);
+}
+ 
+static esp_err_t flush_staging(flash_mgr_state_t *mgr) {
+    if (mgr->staged_count == 0) {
+        return ESP_OK;
+    }
+    
+    // Staging already moved the head past what RING/RAW are about to overwrite
+    rollups_protect(mgr, mgr->meta.deleted_from_start);
+    
+    uint32_t written = 0;
+    // Readers see the staged entries in RAM until staged_count drops below
+    bool shared = !mgr->backend->overwrites_live;
+    if (shared) {
+        readers_resume(mgr);
+    }
+    esp_err_t ret = mgr->backend->append(mgr, mgr->staging, mgr->staged_count, &written);
+    if (shared) {
+        readers_pause(mgr);
+    }
+    index_flushed(mgr, mgr->staging, written);
+    rollups_flushed(mgr, mgr->staging, written);
+    
+    if (ret != ESP_OK || written != mgr->staged_count) {
+        ESP_LOGE(TAG, "Failed to write staged entries: wrote %u of %u", written, mgr->staged_count);
+        // Keep the unwritten tail staged so ordering is preserved on retry
+        memmove(mgr->staging, &mgr->staging[written],
+                (mgr->staged_count - written) * sizeof(flash_mgr_entry_t));
+        mgr->staged_count -= written;
+        return ESP_FAIL;
+    }
+    
+#if FLASH_MGR_ENABLE_DEBUG_LOGS
+    ESP_LOGD(TAG, "Flushed %u staged entries", mgr->staged_count);
+#endif
+    
+    mgr->entries_since_checkpoint += mgr->staged_count;
+    mgr->staged_count = 0;
+    return ESP_OK;
+}
+
+static bool staging_flush_due(flash_mgr_state_t *mgr) {
+    if (mgr->staged_count >= mgr->staging_capacity) {
+        return true;
+    }
+    
+    if (mgr->config.staging_max_age_ms > 0 && mgr->staged_count > 0) {
+        int64_t age_us = esp_timer_get_time() - mgr->staged_since_us;
+        return age_us >= (int64_t)mgr->config.staging_max_age_ms * 1000;
+    }
+    
+    return false;
+}
+ 
+static uint32_t get_current_timestamp(flash_mgr_state_t *mgr) {
+    // Try to get real timestamp, fallback to entry ID
+    time_t now = time(NULL);
+    if (now > 0) {
+        return (uint32_t)now;
+    } else {
+        return mgr->meta.next_id;
+    }
+}
+
+// =============================================================================
+// NAMED CONSUMERS
+// =============================================================================
+
+static bool valid_consumer_name(const char *name) {
+    return name && name[0] != '\0' && strnlen(name, FLASH_MGR_CONSUMER_NAME_LEN) < FLASH_MGR_CONSUMER_NAME_LEN;
+}
+
+static flash_mgr_consumer_t *find_consumer(flash_mgr_state_t *mgr, const char *name) {
+    for (int i = 0; i < FLASH_MGR_MAX_CONSUMERS; i++) {
+        flash_mgr_consumer_t *consumer = &mgr->consumers[i];
+        if (consumer->name[0] != '\0' && strncmp(consumer->name, name, FLASH_MGR_CONSUMER_NAME_LEN) == 0) {
+            return consumer;
+        }
+    }
+    return NULL;
+}
+
+/**
+* @brief Id of a consumer's next entry; entries deleted or overwritten under it are skipped
+*/
+static uint32_t consumer_cursor(flash_mgr_state_t *mgr, const flash_mgr_consumer_t *consumer) {
+    uint32_t head_id = mgr->meta.deleted_from_start;
+    return consumer->cursor > head_id ? consumer->cursor : head_id;
+}
+
+/**
+* @brief Cursor of the consumer furthest behind
+* 
+* @return false if there are no consumers
+*/
+static bool slowest_cursor(flash_mgr_state_t *mgr, uint32_t *cursor) {
+    bool found = false;
+    for (int i = 0; i < FLASH_MGR_MAX_CONSUMERS; i++) {
+        const flash_mgr_consumer_t *consumer = &mgr->consumers[i];
+        if (consumer->name[0] == '\0') {
+            continue;
+        }
+        uint32_t next = consumer_cursor(mgr, consumer);
+        if (!found || next < *cursor) {
+            *cursor = next;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+* @brief Move cursors left behind by a delete to the new head
+*/
+static void consumers_skip_to(flash_mgr_state_t *mgr, uint32_t head_id) {
+    for (int i = 0; i < FLASH_MGR_MAX_CONSUMERS; i++) {
+        flash_mgr_consumer_t *consumer = &mgr->consumers[i];
+        if (consumer->name[0] != '\0' && consumer->cursor < head_id) {
+            ESP_LOGW(TAG, "Consumer %s skipped %u unread entries", consumer->name, head_id - consumer->cursor);
+            consumer->cursor = head_id;
+        }
+    }
+}
+
+/**
+* @brief Delete the entries every consumer has acked
+* 
+* A plain FILE log rewrites its data file on every delete, so unless forced
+* it waits until the acked entries are reclaim_threshold of the log.
+*/
+static esp_err_t consumers_reclaim(flash_mgr_state_t *mgr, bool force) {
+    uint32_t slowest;
+    if (!slowest_cursor(mgr, &slowest) || slowest <= mgr->meta.deleted_from_start) {
+        return ESP_OK;
+    }
+    
+    uint32_t acked = slowest - mgr->meta.deleted_from_start;
+    if (!force && mgr->backend == &s_file_backend &&
+        acked < mgr->meta.active_entries * mgr->config.reclaim_threshold) {
+        return ESP_OK;
+    }
+    return delete_locked(mgr, acked);
+}
+
+/**
+* @brief Entries that still fit while consumers hold auto-cleanup back
+* 
+* Under FLASH_MGR_CONSUMER_CLEANUP_PROTECT cleanup can't go past the slowest
+* consumer, so appends stop at max_data_size rather than growing the log.
+* Acked entries are dropped first. UINT32_MAX when nothing holds cleanup back.
+*/
+static uint32_t protected_room(flash_mgr_state_t *mgr) {
+    uint32_t slowest;
+    if (!mgr->config.auto_cleanup || mgr->fixed_capacity > 0 ||
+        mgr->config.consumer_cleanup_policy != FLASH_MGR_CONSUMER_CLEANUP_PROTECT ||
+        !slowest_cursor(mgr, &slowest)) {
+        return UINT32_MAX;
+    }
+    
+    if (mgr->meta.active_entries >= entry_limit(mgr) && slowest > mgr->meta.deleted_from_start) {
+        esp_err_t ret = consumers_reclaim(mgr, true);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to delete acked entries: %s", esp_err_to_name(ret));
+        }
+    }
+    
+    uint32_t limit = entry_limit(mgr);
+    return mgr->meta.active_entries < limit ? limit - mgr->meta.active_entries : 0;
+}
+
+esp_err_t flash_mgr_log_consumer_register(flash_mgr_handle_t mgr, const char* name) {
+    if (!mgr || !mgr->initialized || !valid_consumer_name(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = ESP_OK;
+    if (!find_consumer(mgr, name)) {
+        flash_mgr_consumer_t *consumer = NULL;
+        for (int i = 0; i < FLASH_MGR_MAX_CONSUMERS && !consumer; i++) {
+            if (mgr->consumers[i].name[0] == '\0') {
+                consumer = &mgr->consumers[i];
+            }
+        }
+        
+        if (!consumer) {
+            ESP_LOGE(TAG, "All %u consumer slots in use", FLASH_MGR_MAX_CONSUMERS);
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            memset(consumer->name, 0, sizeof(consumer->name));
+            strncpy(consumer->name, name, FLASH_MGR_CONSUMER_NAME_LEN - 1);
+            consumer->cursor = mgr->meta.deleted_from_start;
+            ret = checkpoint_metadata(mgr, true);
+            ESP_LOGI(TAG, "Registered consumer %s at id %u", name, consumer->cursor);
+        }
+    }
+    state_unlock(mgr);
+    
+    return ret;
+}
+
+esp_err_t flash_mgr_log_consumer_unregister(flash_mgr_handle_t mgr, const char* name) {
+    if (!mgr || !mgr->initialized || !valid_consumer_name(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    flash_mgr_consumer_t *consumer = find_consumer(mgr, name);
+    if (consumer) {
+        // What every consumer acked goes now, before the last cursor disappears
+        ret = consumers_reclaim(mgr, true);
+        memset(consumer, 0, sizeof(*consumer));
+        if (ret == ESP_OK) {
+            ret = consumers_reclaim(mgr, true);
+        }
+        if (ret == ESP_OK) {
+            ret = checkpoint_metadata(mgr, true);
+        }
+    }
+    state_unlock(mgr);
+    
+    return ret;
+}
+
+esp_err_t flash_mgr_log_read_next(flash_mgr_handle_t mgr, const char* name, flash_mgr_entry_t* buffer,
+                                  uint32_t max_entries, uint32_t* entries_read) {
+    if (!mgr || !mgr->initialized || !valid_consumer_name(name) || !buffer || !entries_read) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    *entries_read = 0;
+    read_lock(mgr);
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    const flash_mgr_consumer_t *consumer = find_consumer(mgr, name);
+    if (consumer) {
+        ret = ESP_OK;
+        uint32_t id = consumer_cursor(mgr, consumer);
+        if (id - mgr->meta.deleted_from_start < mgr->meta.active_entries) {
+            ret = read_locked(mgr, id, buffer, max_entries, entries_read, NULL);
+        }
+    }
+    read_unlock(mgr);
+    
+    return ret;
+}
+
+esp_err_t flash_mgr_log_ack(flash_mgr_handle_t mgr, const char* name, uint32_t count) {
+    if (!mgr || !mgr->initialized || !valid_consumer_name(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    flash_mgr_consumer_t *consumer = find_consumer(mgr, name);
+    if (consumer) {
+        uint32_t cursor = consumer_cursor(mgr, consumer);
+        uint32_t unread = mgr->meta.deleted_from_start + mgr->meta.active_entries - cursor;
+        consumer->cursor = cursor + (count < unread ? count : unread);
+        
+        // The acked head is deleted lazily, by the next append's cleanup check
+        ret = checkpoint_metadata(mgr, false);
+    }
+    state_unlock(mgr);
+    
+    return ret;
+}
+
+// =============================================================================
+// TIME INDEX
+// =============================================================================
+
+/**
+* @brief Oldest block whose record can still be in the index, given the block being filled
+*/
+static uint32_t index_first_block(flash_mgr_state_t *mgr, uint32_t head_block, uint32_t open_block) {
+    if (open_block < head_block) {
+        return open_block;
+    }
+    // Older blocks share their slot with a newer one
+    if (open_block - head_block >= mgr->index.slots) {
+        return open_block - mgr->index.slots + 1;
+    }
+    return head_block;
+}
+
+static void index_start_block(flash_mgr_state_t *mgr, uint32_t block) {
+    memset(&mgr->index_open, 0, sizeof(mgr->index_open));
+    mgr->index_open.block = block;
+    mgr->index_count = 0;
+}
+
+/**
+* @brief Fold entries that just reached flash into the index, recording every block they close
+*/
+static void index_flushed(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count) {
+    if (mgr->index.fd < 0) {
+        return;
+    }
+    
+    uint32_t block_entries = mgr->config.time_index_block;
+    flash_mgr_index_rec_t *rec = &mgr->index_open;
+    for (uint32_t i = 0; i < count; i++) {
+        const flash_mgr_entry_t *entry = &entries[i];
+        if (entry->id / block_entries != rec->block) {
+            // Only after (re)starting mid-log, ids are contiguous otherwise
+            index_start_block(mgr, entry->id / block_entries);
+        }
+        
+        if (mgr->index_count++ == 0) {
+            rec->min_ts = rec->max_ts = entry->timestamp;
+            rec->min_value = rec->max_value = entry->value_x1000;
+        } else {
+            rec->min_ts = (entry->timestamp < rec->min_ts) ? entry->timestamp : rec->min_ts;
+            rec->max_ts = (entry->timestamp > rec->max_ts) ? entry->timestamp : rec->max_ts;
+            rec->min_value = (entry->value_x1000 < rec->min_value) ? entry->value_x1000 : rec->min_value;
+            rec->max_value = (entry->value_x1000 > rec->max_value) ? entry->value_x1000 : rec->max_value;
+        }
+        rec->types[entry->type / 8] |= 1 << (entry->type % 8);
+        rec->units[entry->unit / 8] |= 1 << (entry->unit % 8);
+        
+        if (entry->id % block_entries == block_entries - 1) {
+            if (rec->max_ts > mgr->index_run_max_ts) {
+                mgr->index_run_max_ts = rec->max_ts;
+            }
+            rec->run_max_ts = mgr->index_run_max_ts;
+            if (flash_mgr_index_put(&mgr->index, rec) != ESP_OK) {
+                // Queries just read this block instead of skipping it
+                ESP_LOGE(TAG, "Failed to write time index record for block %u", rec->block);
+            }
+            index_start_block(mgr, rec->block + 1);
+        }
+    }
+}
+
+/**
+* @brief Feed entries [id, end_id) from flash to fold, one chunk at a time
+*/
+static esp_err_t replay_entries(flash_mgr_state_t *mgr, uint32_t id, uint32_t end_id,
+                                void (*fold)(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries,
+                                             uint32_t count)) {
+    uint32_t chunk_entries = mgr->config.chunk_buffer_size / sizeof(flash_mgr_entry_t);
+    flash_mgr_entry_t *buffer = malloc(chunk_entries * sizeof(flash_mgr_entry_t));
+    if (!buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    while (id < end_id) {
+        uint32_t count = (end_id - id < chunk_entries) ? end_id - id : chunk_entries;
+        uint32_t entries_read = 0;
+        ret = mgr->backend->read(mgr, id, buffer, count, &entries_read);
+        if (entries_read == 0) {
+            ret = (ret != ESP_OK) ? ret : ESP_FAIL;
+            break;
+        }
+        fold(mgr, buffer, entries_read);
+        id += entries_read;
+        ret = ESP_OK;
+    }
+    
+    free(buffer);
+    return ret;
+}
+
+/**
+* @brief Open the time index and catch up with the data on flash
+* 
+* A block's record is only written once the whole block is on flash, so
+* after a reset the newest closed blocks may lack one. Those are rebuilt
+* from the data, and so is the summary of the block still filling.
+*/
+static esp_err_t init_time_index(flash_mgr_state_t *mgr) {
+    uint32_t block_entries = mgr->config.time_index_block;
+    // Sized from the configuration, not calculate_max_entries(): that follows the packing
+    // ratio, and a new size would throw the index away and rebuild it on every mount
+    uint32_t capacity = mgr->config.max_data_size / sizeof(flash_mgr_entry_t);
+    if (mgr->fixed_capacity > 0) {
+        capacity = mgr->fixed_capacity;
+    } else if (mgr->config.compress_segments && mgr->backend == &s_segment_backend) {
+        capacity = mgr->config.max_data_size / FLASH_MGR_DELTA_MIN_ENTRY_BYTES;
+    }
+    bool created;
+    
+    esp_err_t ret = flash_mgr_index_open(&mgr->index, mgr->config.index_file, block_entries,
+                                         capacity / block_entries + 2, &created);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    uint32_t head_id = mgr->meta.deleted_from_start;
+    uint32_t end_id = head_id + mgr->meta.active_entries - mgr->staged_count;
+    uint32_t open_block = end_id / block_entries;
+    uint32_t first_block = index_first_block(mgr, head_id / block_entries, open_block);
+    
+    // Walk back to the newest block that has its record
+    uint32_t block = first_block;
+    mgr->index_run_max_ts = 0;
+    if (!created) {
+        flash_mgr_index_rec_t rec;
+        for (block = open_block; block > first_block; block--) {
+            if (flash_mgr_index_get(&mgr->index, block - 1, &rec)) {
+                mgr->index_run_max_ts = rec.run_max_ts;
+                break;
+            }
+        }
+    }
+    
+    if (open_block > block) {
+        ESP_LOGI(TAG, "Rebuilding time index for %u blocks", open_block - block);
+    }
+    
+    index_start_block(mgr, block);
+    uint32_t id = (block * block_entries > head_id) ? block * block_entries : head_id;
+    return replay_entries(mgr, id, end_id, index_flushed);
+}
+
+/**
+* @brief First block in [lo, hi) whose run_max_ts reaches t0 (hi if none)
+* 
+* run_max_ts never decreases, so this is a plain binary search even if
+* timestamps jump around. Falls back to lo if a record is missing.
+*/
+static uint32_t index_lower_bound(flash_mgr_state_t *mgr, uint32_t lo, uint32_t hi, uint32_t t0) {
+    uint32_t first = lo;
+    flash_mgr_index_rec_t rec;
+    
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (!flash_mgr_index_get(&mgr->index, mid, &rec)) {
+            return first;
+        }
+        if (rec.run_max_ts < t0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    return lo;
+}
+
+flash_mgr_filter_t flash_mgr_get_default_filter(void) {
+    flash_mgr_filter_t filter = {
+        .min_timestamp = 0,
+        .max_timestamp = UINT32_MAX,
+        .type = FLASH_MGR_FILTER_ANY,
+        .unit = FLASH_MGR_FILTER_ANY,
+        .min_value_x1000 = INT32_MIN,
+        .max_value_x1000 = INT32_MAX
+    };
+    return filter;
+}
+
+static bool filter_matches(const flash_mgr_filter_t *filter, const flash_mgr_entry_t *entry) {
+    return entry->timestamp >= filter->min_timestamp && entry->timestamp <= filter->max_timestamp &&
+           (filter->type == FLASH_MGR_FILTER_ANY || entry->type == filter->type) &&
+           (filter->unit == FLASH_MGR_FILTER_ANY || entry->unit == filter->unit) &&
+           entry->value_x1000 >= filter->min_value_x1000 && entry->value_x1000 <= filter->max_value_x1000;
+}
+
+/**
+* @brief Whether a block with this summary can hold an entry matching filter
+*/
+static bool filter_may_match(const flash_mgr_filter_t *filter, const flash_mgr_index_rec_t *rec) {
+    if (rec->max_ts < filter->min_timestamp || rec->min_ts > filter->max_timestamp ||
+        rec->max_value < filter->min_value_x1000 || rec->min_value > filter->max_value_x1000) {
+        return false;
+    }
+    if (filter->type != FLASH_MGR_FILTER_ANY && !(rec->types[filter->type / 8] & (1 << (filter->type % 8)))) {
+        return false;
+    }
+    if (filter->unit != FLASH_MGR_FILTER_ANY && !(rec->units[filter->unit / 8] & (1 << (filter->unit % 8)))) {
+        return false;
+    }
+    return true;
+}
+
+esp_err_t flash_mgr_log_query_time_range(flash_mgr_handle_t mgr, uint32_t t0, uint32_t t1,
+                                         flash_mgr_entry_cb_t callback, void* ctx) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_filter_t filter = flash_mgr_get_default_filter();
+    filter.min_timestamp = t0;
+    filter.max_timestamp = t1;
+    return flash_mgr_log_scan(mgr, &filter, callback, ctx);
+}
+
+/**
+* @brief Call callback for the entries with ids first_id..last_id that match filter
+* 
+* Entries are read a chunk at a time into the read-ahead buffer and the
+* callback gets pointers into it. The buffer is only allocated when another
+* visitor holds it. Blocks the index rules out aren't read.
+*/
+static esp_err_t visit(flash_mgr_state_t *mgr, uint32_t first_id, uint32_t last_id, const flash_mgr_filter_t *filter,
+                       flash_mgr_entry_cb_t callback, void *ctx) {
+    flash_mgr_read_ahead_t *ra = &mgr->read_ahead;
+    uint32_t chunk_entries = mgr->config.chunk_buffer_size / sizeof(flash_mgr_entry_t);
+    bool borrowed = ra->entries && xSemaphoreTake(ra->lock, 0) == pdTRUE;
+    flash_mgr_entry_t *buffer = borrowed ? ra->entries : malloc(chunk_entries * sizeof(flash_mgr_entry_t));
+    if (!buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    uint32_t block_entries = mgr->config.time_index_block;
+    uint32_t id = first_id;
+    bool first = true;
+    bool more = true;
+    esp_err_t ret = ESP_OK;
+    
+    // One chunk per pass; the lock is dropped while the callback runs
+    while (more) {
+        read_lock(mgr);
+        uint32_t head_id = mgr->meta.deleted_from_start;
+        uint32_t end_id = head_id + mgr->meta.active_entries;
+        uint32_t flushed_end = end_id - mgr->staged_count;
+        if (last_id < end_id) {
+            end_id = last_id + 1;
+        }
+        if (id < head_id) {
+            id = head_id;
+        }
+        
+        if (id < end_id && mgr->index.fd >= 0) {
+            // Closed blocks [lo, hi) have records, the rest is always read
+            uint32_t hi = mgr->index_open.block;
+            uint32_t lo = index_first_block(mgr, head_id / block_entries, hi);
+            if (first && id / block_entries == lo) {
+                uint32_t start = index_lower_bound(mgr, lo, hi, filter->min_timestamp) * block_entries;
+                id = (start > id) ? start : id;
+            }
+            
+            flash_mgr_index_rec_t rec;
+            while (id < end_id && id / block_entries >= lo && id / block_entries < hi &&
+                   flash_mgr_index_get(&mgr->index, id / block_entries, &rec) &&
+                   !filter_may_match(filter, &rec)) {
+                id = (id / block_entries + 1) * block_entries;
+            }
+        }
+        
+        uint32_t count = 0;
+        if (id < end_id) {
+            count = (end_id - id < chunk_entries) ? end_id - id : chunk_entries;
+            if (mgr->index.fd >= 0) {
+                // Stop at the block end so the next block can be skipped
+                uint32_t block_end = (id / block_entries + 1) * block_entries;
+                count = (block_end - id < count) ? block_end - id : count;
+            }
+        }
+        first = false;
+        
+        uint32_t entries_read = 0;
+        if (count > 0 && borrowed) {
+            // Straight into the window through its open file; what came from flash stays cached
+            ra->count = 0;
+            ret = read_locked(mgr, id, buffer, count, &entries_read, mgr->backend->read_cached ? &ra->handle : NULL);
+            if (mgr->backend->read_cached && id < flushed_end) {
+                ra->first_id = id;
+                ra->count = (entries_read < flushed_end - id) ? entries_read : flushed_end - id;
+            }
+        } else if (count > 0) {
+            ret = read_locked(mgr, id, buffer, count, &entries_read, NULL);
+        }
+        if (ret == ESP_OK && count > 0 && entries_read == 0) {
+            ret = ESP_FAIL;
+        }
+        read_unlock(mgr);
+        
+        if (ret != ESP_OK || entries_read == 0) {
+            break;
+        }
+        
+        for (uint32_t i = 0; i < entries_read && more; i++) {
+            if (filter_matches(filter, &buffer[i])) {
+                more = callback(&buffer[i], ctx);
+            }
+        }
+        id += entries_read;
+        if (id == 0 || id - 1 >= last_id) {
+            break;
+        }
+    }
+    
+    if (borrowed) {
+        xSemaphoreGive(ra->lock);
+    } else {
+        free(buffer);
+    }
+    return ret;
+}
+
+static bool valid_filter(const flash_mgr_filter_t *filter) {
+    return filter->min_timestamp <= filter->max_timestamp && filter->min_value_x1000 <= filter->max_value_x1000 &&
+           filter->type >= FLASH_MGR_FILTER_ANY && filter->type <= UINT8_MAX &&
+           filter->unit >= FLASH_MGR_FILTER_ANY && filter->unit <= UINT8_MAX;
+}
+
+esp_err_t flash_mgr_log_scan(flash_mgr_handle_t mgr, const flash_mgr_filter_t* filter, flash_mgr_entry_cb_t callback,
+                             void* ctx) {
+    if (!mgr || !mgr->initialized || !filter || !callback || !valid_filter(filter)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return visit(mgr, 0, UINT32_MAX, filter, callback, ctx);
+}
+
+esp_err_t flash_mgr_log_foreach(flash_mgr_handle_t mgr, uint32_t first_id, uint32_t last_id,
+                                const flash_mgr_filter_t* filter, flash_mgr_entry_cb_t callback, void* ctx) {
+    if (!mgr || !mgr->initialized || !callback || last_id < first_id || (filter && !valid_filter(filter))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_filter_t all = flash_mgr_get_default_filter();
+    return visit(mgr, first_id, last_id, filter ? filter : &all, callback, ctx);
+}
+
+// =============================================================================
+// ROLLUPS
+// =============================================================================
+
+/**
+* @brief Open the rollup file and replay what it hasn't seen yet
+* 
+* The saved state covers entries up to its through_id; the ones flushed
+* after it are still in the log (rollups_protect() saves the state before
+* they can be dropped), so folding them again restores the open windows.
+* A new file starts from the oldest entry on flash.
+*/
+static esp_err_t init_rollups(flash_mgr_state_t *mgr) {
+    uint32_t head_id = mgr->meta.deleted_from_start;
+    uint32_t end_id = head_id + mgr->meta.active_entries - mgr->staged_count;
+    
+    esp_err_t ret = flash_mgr_rollups_open(&mgr->rollups, mgr->config.rollup_file,
+                                           mgr->config.rollup_types, mgr->config.rollup_records, head_id);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    flash_mgr_rollups_t *rollups = &mgr->rollups;
+    if (rollups->through_id > end_id) {
+        // The log lost entries the rollups already hold; don't skip the ids reused for new ones
+        ESP_LOGW(TAG, "Rollups are ahead of the log (%u > %u)", rollups->through_id, end_id);
+        rollups->through_id = end_id;
+        rollups->dirty = true;
+    } else if (rollups->through_id < head_id) {
+        ESP_LOGW(TAG, "Entries %u-%u were deleted before they were rolled up", rollups->through_id, head_id - 1);
+        rollups->through_id = head_id;
+        rollups->dirty = true;
+    }
+    
+    if (rollups->through_id < end_id) {
+        ESP_LOGI(TAG, "Rolling up %u entries", end_id - rollups->through_id);
+        ret = replay_entries(mgr, rollups->through_id, end_id, rollups_flushed);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    
+    return flash_mgr_rollups_save(rollups);
+}
+
+/**
+* @brief Fold entries that just reached flash into the rollups
+*/
+static void rollups_flushed(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count) {
+    if (mgr->rollups.fd >= 0) {
+        flash_mgr_rollups_add(&mgr->rollups, entries, count);
+    }
+}
+
+/**
+* @brief Save the rollup state before the entries it would replay after a reset are dropped
+* 
+* @param new_head_id Oldest id left once the drop is done
+*/
+static void rollups_protect(flash_mgr_state_t *mgr, uint32_t new_head_id) {
+    if (mgr->rollups.fd >= 0 && mgr->rollups.saved_through_id < new_head_id) {
+        flash_mgr_rollups_save(&mgr->rollups);
+    }
+}
+
+esp_err_t flash_mgr_log_get_rollups(flash_mgr_handle_t mgr, uint8_t type, flash_mgr_rollup_window_t window,
+                                    uint32_t from_ts, uint32_t to_ts, flash_mgr_rollup_t* rollups,
+                                    uint32_t max_rollups, uint32_t* rollups_read) {
+    if (!mgr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    mgr = route(mgr, type);
+    if (!mgr->initialized || window >= FLASH_MGR_ROLLUP_WINDOWS || !rollups || !rollups_read) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    *rollups_read = 0;
+    read_lock(mgr);
+    esp_err_t ret = flash_mgr_rollups_query(&mgr->rollups, type, window, from_ts, to_ts,
+                                            rollups, max_rollups, rollups_read);
+    read_unlock(mgr);
+    
+    return ret;
+}
+
+// =============================================================================
+// STREAMS
+// =============================================================================
+
+/**
+* @brief Name of a file kept next to a log file: data.bin becomes data.t042.bin for kind 't' and number 42
+* 
+* Streams use kind 't' (their copy of each log file), record files kind 'r'.
+*/
+static char *sibling_file(const char *path, char kind, uint8_t number) {
+    if (!path) {
+        return NULL;
+    }
+    
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t stem = (dot && (!slash || dot > slash)) ? (size_t)(dot - path) : strlen(path);
+    size_t size = strlen(path) + sizeof(".t000");
+    char *name = malloc(size);
+    if (name) {
+        snprintf(name, size, "%.*s.%c%03u%s", (int)stem, path, kind, number, path + stem);
+    }
+    return name;
+}
+
+/**
+* @brief Open a sub-log for every entry of config.streams, next to the log's files
+*/
+static esp_err_t open_streams(flash_mgr_state_t *mgr) {
+    const char *paths[5] = {
+        mgr->config.data_file,
+        mgr->config.meta_file,
+        mgr->config.index_file,
+        mgr->config.rollup_file,
+        mgr->config.blob_file
+    };
+    
+    for (uint32_t i = 0; i < mgr->config.stream_count; i++) {
+        const flash_mgr_stream_config_t *stream = &mgr->config.streams[i];
+        flash_mgr_state_t *log = calloc(1, sizeof(flash_mgr_state_t));
+        if (!log) {
+            return ESP_ERR_NO_MEM;
+        }
+        
+        esp_err_t ret = ESP_OK;
+        for (int j = 0; j < 5; j++) {
+            log->stream_files[j] = sibling_file(paths[j], 't', stream->type);
+            if (paths[j] && !log->stream_files[j]) {
+                ret = ESP_ERR_NO_MEM;
+            }
+        }
+        
+        // Everything but the files and the quota is the log's
+        flash_mgr_config_t config = mgr->config;
+        config.data_file = log->stream_files[0];
+        config.meta_file = log->stream_files[1];
+        config.index_file = log->stream_files[2];
+        config.rollup_file = log->stream_files[3];
+        config.blob_file = log->stream_files[4];
+        config.max_data_size = stream->max_data_size;
+        if (stream->cleanup_threshold > 0) {
+            config.cleanup_threshold = stream->cleanup_threshold;
+            config.cleanup_target = stream->cleanup_target;
+        }
+        // The raw region belongs to the log, so its streams live in LittleFS
+        if (config.storage_mode == FLASH_MGR_STORAGE_RAW) {
+            config.storage_mode = FLASH_MGR_STORAGE_FILE;
+        }
+        config.stream_count = 0;
+        
+        if (ret == ESP_OK) {
+            ret = open_log(log, &config);
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to open the stream of type %u", stream->type);
+            // A failed open_log() may have freed the names already, then they are NULL
+            for (int j = 0; j < 5; j++) {
+                free(log->stream_files[j]);
+            }
+            free(log);
+            return ret;
+        }
+        
+        log->parent = mgr;
+        mgr->streams[mgr->stream_count++] = log;
+    }
+    
+    return ESP_OK;
+}
+
+/**
+* @brief Append a batch whose entries may belong to streams, one append per run of entries going to the same log
+*/
+static esp_err_t append_routed(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                               bool stamp_now) {
+    if (!mgr->initialized) {
+        ESP_LOGE(TAG, "Flash manager not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (count > 0 && !entries) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    esp_err_t ret = ESP_OK;
+    for (uint32_t start = 0; ret == ESP_OK && start < count; ) {
+        flash_mgr_state_t *log = route(mgr, entries[start].type);
+        uint32_t end = start + 1;
+        while (end < count && route(mgr, entries[end].type) == log) {
+            end++;
+        }
+        
+        state_lock(log);
+        ret = append_batch(log, entries + start, end - start, stamp_now);
+        state_unlock(log);
+        start = end;
+    }
+    return ret;
+}
+
+esp_err_t flash_mgr_log_stream(flash_mgr_handle_t mgr, uint8_t type, flash_mgr_handle_t* stream) {
+    if (!mgr || !mgr->initialized || !stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_state_t *log = route(mgr, type);
+    if (log == mgr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    *stream = log;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_log_merge_open(flash_mgr_handle_t mgr, flash_mgr_merge_t** merge) {
+    if (!mgr || !mgr->initialized || !merge) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_merge_t *m = calloc(1, sizeof(flash_mgr_merge_t));
+    if (!m) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // The log itself, then its streams
+    esp_err_t ret = ESP_OK;
+    for (uint32_t i = 0; ret == ESP_OK && i <= mgr->stream_count; i++) {
+        ret = flash_mgr_log_iter_open(i == 0 ? mgr : mgr->streams[i - 1], 0, &m->sources[i].iter);
+        if (ret == ESP_OK) {
+            m->count++;
+        }
+    }
+    if (ret != ESP_OK) {
+        flash_mgr_merge_close(m);
+        return ret;
+    }
+    
+    *merge = m;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_merge_next(flash_mgr_merge_t* merge, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                               uint32_t* entries_read) {
+    if (!merge || !buffer || !entries_read) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    *entries_read = 0;
+    // A log read up in this call isn't asked again until the next one
+    bool drained[1 + FLASH_MGR_MAX_STREAMS] = {false};
+    while (*entries_read < max_entries) {
+        flash_mgr_merge_source_t *next = NULL;
+        for (uint32_t i = 0; i < merge->count; i++) {
+            flash_mgr_merge_source_t *source = &merge->sources[i];
+            if (source->pos == source->count && !drained[i]) {
+                source->pos = 0;
+                esp_err_t ret = flash_mgr_iter_next(source->iter, source->entries, FLASH_MGR_MERGE_READ_ENTRIES,
+                                                    &source->count);
+                if (ret != ESP_OK) {
+                    source->count = 0;
+                    // What was merged so far is returned, the error comes back on the next call
+                    return *entries_read > 0 ? ESP_OK : ret;
+                }
+                drained[i] = source->count == 0;
+            }
+            
+            // Strictly older only, so ties go to the log, then the streams in config order
+            if (source->pos < source->count &&
+                (!next || source->entries[source->pos].timestamp < next->entries[next->pos].timestamp)) {
+                next = source;
+            }
+        }
+        
+        if (!next) {
+            break;
+        }
+        buffer[(*entries_read)++] = next->entries[next->pos++];
+    }
+    
+    return ESP_OK;
+}
+
+void flash_mgr_merge_close(flash_mgr_merge_t* merge) {
+    if (!merge) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < merge->count; i++) {
+        flash_mgr_iter_close(merge->sources[i].iter);
+    }
+    free(merge);
+}
+
+// =============================================================================
+// RECORD FILES
+// =============================================================================
+
+static void records_free(flash_mgr_records_t *records) {
+    free(records->buffer);
+    free(records->path);
+    free(records);
+}
+
+esp_err_t flash_mgr_log_records_open(flash_mgr_handle_t mgr, uint8_t schema_id, size_t record_size, uint32_t slots,
+                                     flash_mgr_records_t** records) {
+    if (!mgr || !mgr->initialized || !records || record_size == 0 || record_size > FLASH_MGR_MAX_RECORD_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_records_t *r = calloc(1, sizeof(flash_mgr_records_t));
+    if (!r) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    size_t stride = FLASH_MGR_RECORD_STRIDE(record_size);
+    r->mgr = mgr;
+    r->file.fd = -1;
+    r->schema_id = schema_id;
+    r->record_size = record_size;
+    r->slots = (slots > 0) ? slots : FLASH_MGR_DEFAULT_RECORD_SLOTS;
+    r->batch = (FLASH_MGR_RECORD_WRITE_BUFFER >= stride) ? FLASH_MGR_RECORD_WRITE_BUFFER / stride : 1;
+    // Zeroed once: appends copy headers and records in and leave the padding alone
+    r->buffer = calloc(r->batch, stride);
+    r->path = sibling_file(mgr->config.data_file, 'r', schema_id);
+    if (!r->buffer || !r->path) {
+        records_free(r);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    state_lock(mgr);
+    esp_err_t ret = ESP_OK;
+    for (flash_mgr_records_t *other = mgr->records; other; other = other->next) {
+        if (other->schema_id == schema_id) {
+            ESP_LOGE(TAG, "Record file of schema %u is open already", schema_id);
+            ret = ESP_ERR_INVALID_STATE;
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = flash_mgr_record_file_open(&r->file, r->path, record_size, r->slots);
+    }
+    if (ret == ESP_OK) {
+        r->next = mgr->records;
+        mgr->records = r;
+    }
+    state_unlock(mgr);
+    
+    if (ret != ESP_OK) {
+        records_free(r);
+        return ret;
+    }
+    
+    *records = r;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_records_append(flash_mgr_records_t* records, const void* data, uint32_t count) {
+    if (!records || (count > 0 && !data)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    flash_mgr_state_t *mgr = records->mgr;
+    const uint8_t *src = data;
+    esp_err_t ret = ESP_OK;
+    
+    state_lock(mgr);
+    flash_mgr_record_header_t header = {
+        .id = records->file.end_id,
+        .timestamp = get_current_timestamp(mgr)
+    };
+    while (ret == ESP_OK && count > 0) {
+        uint32_t n = (count < records->batch) ? count : records->batch;
+        uint8_t *slot = records->buffer;
+        for (uint32_t i = 0; i < n; i++) {
+            memcpy(slot, &header, sizeof(header));
+            memcpy(slot + sizeof(header), src, records->record_size);
+            header.id++;
+            slot += records->file.stride;
+            src += records->record_size;
+        }
+        
+        ret = flash_mgr_record_file_write(&records->file, records->buffer, n);
+        count -= n;
+    }
+    state_unlock(mgr);
+    
+    return ret;
+}
+
+esp_err_t flash_mgr_records_read(flash_mgr_records_t* records, uint32_t id, void* buffer, uint32_t max_records,
+                                 uint32_t* records_read) {
+    if (!records || !buffer || !records_read) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    read_lock(records->mgr);
+    esp_err_t ret = flash_mgr_record_file_read(&records->file, id, buffer, max_records, records_read);
+    read_unlock(records->mgr);
+    
+    return ret;
+}
+
+esp_err_t flash_mgr_records_bounds(flash_mgr_records_t* records, uint32_t* first_id, uint32_t* end_id) {
+    if (!records || !first_id || !end_id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    read_lock(records->mgr);
+    esp_err_t ret = (records->file.fd >= 0) ? ESP_OK : ESP_ERR_INVALID_STATE;
+    *first_id = records->file.first_id;
+    *end_id = records->file.end_id;
+    read_unlock(records->mgr);
+    
+    return ret;
+}
+
+void flash_mgr_records_close(flash_mgr_records_t* records) {
+    if (!records) {
+        return;
+    }
+    
+    flash_mgr_state_t *mgr = records->mgr;
+    
+    state_lock(mgr);
+    for (flash_mgr_records_t **link = &mgr->records; *link; link = &(*link)->next) {
+        if (*link == records) {
+            *link = records->next;
+            break;
+        }
+    }
+    flash_mgr_record_file_close(&records->file);
+    state_unlock(mgr);
+    
+    records_free(records);
+}
+
+/**
+* @brief Sync the open record files of a log, for flash_mgr_flush()
+*/
+static esp_err_t records_sync(flash_mgr_state_t *mgr) {
+    esp_err_t ret = ESP_OK;
+    for (flash_mgr_records_t *r = mgr->records; r; r = r->next) {
+        if (flash_mgr_record_file_sync(&r->file) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to sync the record file of schema %u", r->schema_id);
+            ret = ESP_FAIL;
+        }
+    }
+    return ret;
+}
+
+/**
+* @brief Close the files of record files still open when the log closes
+* 
+* Their handles stay allocated until flash_mgr_records_close(), which then only frees them.
+*/
+static void records_release(flash_mgr_state_t *mgr) {
+    for (flash_mgr_records_t *r = mgr->records; r; r = r->next) {
+        flash_mgr_record_file_close(&r->file);
+    }
+    mgr->records = NULL;
+}
+
+/**
+* @brief Drop every record file of the log: open ones start over empty, the others are removed
+*/
+static void records_format(flash_mgr_state_t *mgr) {
+    for (uint32_t schema = 0; schema <= UINT8_MAX; schema++) {
+        flash_mgr_records_t *r = mgr->records;
+        while (r && r->schema_id != schema) {
+            r = r->next;
+        }
+        
+        if (r) {
+            if (flash_mgr_record_file_reset(&r->file, r->path, r->record_size, r->slots) != ESP_OK) {
+                ESP_LOGW(TAG, "Record file of schema %u unavailable after format", schema);
+            }
+            continue;
+        }
+        
+        char *path = sibling_file(mgr->config.data_file, 'r', schema);
+        if (path) {
+            remove(path);
+            free(path);
+        }
+    }
+}
+
+// =============================================================================
+// ASYNCHRONOUS WRITER AND ISR APPENDS
+// =============================================================================
+
+static esp_err_t enqueue_entry(flash_mgr_state_t *mgr, uint32_t timestamp, uint8_t type, uint8_t unit,
+                               int32_t value_x1000) {
+    // Id is assigned when the writer stages the entry, so queue order is id order
+    flash_mgr_entry_t entry = {
+        .timestamp = timestamp,
+        .type = type,
+        .unit = unit,
+        .value_x1000 = value_x1000
+    };
+    bool block = mgr->config.overflow_policy == FLASH_MGR_OVERFLOW_BLOCK;
+    
+    if (!flash_mgr_queue_push(&mgr->queue, &entry, !block)) {
+        if (!block) {
+            return ESP_ERR_NO_MEM;
+        }
+        
+        TickType_t start = xTaskGetTickCount();
+        TickType_t limit = pdMS_TO_TICKS(mgr->config.overflow_block_ms);
+        do {
+            if (xTaskGetTickCount() - start >= limit) {
+                atomic_fetch_add_explicit(&mgr->queue.dropped, 1, memory_order_relaxed);
+                return ESP_ERR_TIMEOUT;
+            }
+            xTaskNotifyGive(mgr->writer_task);
+            vTaskDelay(1);
+        } while (!flash_mgr_queue_push(&mgr->queue, &entry, false));
+    }
+    
+    // Wake the writer once a staging buffer's worth is waiting; the age limit covers the rest
+    if (flash_mgr_queue_depth(&mgr->queue) >= mgr->staging_capacity) {
+        xTaskNotifyGive(mgr->writer_task);
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR flash_mgr_log_append_from_isr(flash_mgr_handle_t mgr, uint32_t timestamp, uint8_t type,
+                                                  uint8_t unit, int32_t value_x1000) {
+    if (!mgr || unit == FLASH_MGR_UNIT_BLOB) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    mgr = route(mgr, type);
+    if (!mgr->isr_queue_slots) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    flash_mgr_entry_t entry = {
+        .timestamp = timestamp,
+        .type = type,
+        .unit = unit,
+        .value_x1000 = value_x1000
+    };
+    
+    if (!flash_mgr_queue_push_bounded(&mgr->isr_queue, &entry, FLASH_MGR_ISR_PUSH_ATTEMPTS)) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    if (mgr->writer_task && flash_mgr_queue_depth(&mgr->isr_queue) >= mgr->staging_capacity) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(mgr->writer_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+    
+    return ESP_OK;
+}
+
+/**
+* @brief Move one queue's entries into staging, flushing whenever it fills up
+* 
+* Entries stay queued if staging can't be flushed, or consumers hold back
+* cleanup of a full log, so either backs up into the queue and its overflow
+* policy rather than losing entries.
+*/
+static esp_err_t drain_from(flash_mgr_state_t *mgr, flash_mgr_queue_t *queue, bool isr, uint32_t *drained) {
+    for (;;) {
+        if (mgr->staged_count >= mgr->staging_capacity) {
+            esp_err_t ret = flush_and_checkpoint(mgr);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+        
+        uint32_t room = protected_room(mgr);
+        if (room == 0) {
+            return flash_mgr_queue_depth(queue) > 0 ? ESP_ERR_NO_MEM : ESP_OK;
+        }
+        
+        uint32_t free_slots = mgr->staging_capacity - mgr->staged_count;
+        flash_mgr_entry_t *first = &mgr->staging[mgr->staged_count];
+        uint32_t count = flash_mgr_queue_pop(queue, first, room < free_slots ? room : free_slots);
+        if (count == 0) {
+            return ESP_OK;
+        }
+        
+        // ISRs can't read the clock; timestamp 0 means "when it was picked up"
+        if (isr) {
+            for (uint32_t i = 0; i < count; i++) {
+                if (first[i].timestamp == 0) {
+                    first[i].timestamp = get_current_timestamp(mgr);
+                }
+            }
+        }
+        
+        stage_entries(mgr, count);
+        *drained += count;
+    }
+}
+
+static esp_err_t drain_queue(flash_mgr_state_t *mgr) {
+    uint32_t drained = 0;
+    esp_err_t ret = ESP_OK;
+    
+    if (mgr->isr_queue_slots) {
+        ret = drain_from(mgr, &mgr->isr_queue, true, &drained);
+    }
+    if (ret == ESP_OK && mgr->queue_slots) {
+        ret = drain_from(mgr, &mgr->queue, false, &drained);
+    }
+    
+    if (drained > 0) {
+        check_auto_cleanup(mgr);
+    }
+    
+    return ret;
+}
+
+static void writer_task(void *arg) {
+    flash_mgr_state_t *mgr = arg;
+    TickType_t wait = mgr->config.staging_max_age_ms > 0 ?
+                      pdMS_TO_TICKS(mgr->config.staging_max_age_ms) : portMAX_DELAY;
+    
+    while (!mgr->writer_stop) {
+        // Woken by producers; the timeout drives the staging age limit
+        ulTaskNotifyTake(pdTRUE, wait);
+        
+        state_lock(mgr);
+        esp_err_t ret = drain_queue(mgr);
+        // A full log only stops the queue, what's staged still goes to flash
+        if ((ret == ESP_OK || ret == ESP_ERR_NO_MEM) && staging_flush_due(mgr)) {
+            esp_err_t flush_ret = flush_and_checkpoint(mgr);
+            ret = flush_ret != ESP_OK ? flush_ret : ret;
+        }
+        state_unlock(mgr);
+        
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Writer failed to flush: %s", esp_err_to_name(ret));
+            vTaskDelay(pdMS_TO_TICKS(FLASH_MGR_WRITER_RETRY_MS));
+        }
+    }
+    
+    xSemaphoreGive(mgr->writer_done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t start_writer_task(flash_mgr_state_t *mgr) {
+    mgr->queue_slots = malloc(mgr->config.writer_queue_entries * sizeof(flash_mgr_queue_slot_t));
+    mgr->writer_done = xSemaphoreCreateBinary();
+    if (!mgr->queue_slots || !mgr->writer_done) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = flash_mgr_queue_init(&mgr->queue, mgr->queue_slots, mgr->config.writer_queue_entries);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    mgr->writer_stop = false;
+    BaseType_t core = mgr->config.writer_task_core < 0 ? tskNO_AFFINITY : mgr->config.writer_task_core;
+    if (xTaskCreatePinnedToCore(writer_task, "flash_mgr_writer", mgr->config.writer_task_stack, mgr,
+                                mgr->config.writer_task_priority, &mgr->writer_task, core) != pdPASS) {
+        mgr->writer_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    
+    return ESP_OK;
+}
+
+static void stop_writer_task(flash_mgr_state_t *mgr) {
+    if (mgr->writer_task) {
+        mgr->writer_stop = true;
+        xTaskNotifyGive(mgr->writer_task);
+        xSemaphoreTake(mgr->writer_done, portMAX_DELAY);
+        mgr->writer_task = NULL;
+    }
+    
+    if (mgr->writer_done) {
+        vSemaphoreDelete(mgr->writer_done);
+        mgr->writer_done = NULL;
+    }
+}
+
+// =============================================================================
+// STORAGE BACKENDS
+// =============================================================================
+
+/**
+* @brief Cut entries that fail their check off the end of a data file
+* 
+* Only the last chunk is read: an append that was cut short by a reset can't
+* reach back further than that, so mount never scans the whole file.
+*/
+static esp_err_t trim_torn_tail(flash_mgr_state_t *mgr, const char *path, uint32_t *entries) {
+    uint32_t tail = mgr->config.chunk_buffer_size / sizeof(flash_mgr_entry_t);
+    if (tail > *entries) {
+        tail = *entries;
+    }
+    if (tail == 0) {
+        return ESP_OK;
+    }
+    
+    flash_mgr_entry_t *buffer = malloc(tail * sizeof(flash_mgr_entry_t));
+    if (!buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    FILE *f = fopen(path, "rb");
+    bool ok = f && fseek(f, (long)(*entries - tail) * sizeof(flash_mgr_entry_t), SEEK_SET) == 0 &&
+              fread(buffer, sizeof(flash_mgr_entry_t), tail, f) == tail;
+    if (f) {
+        fclose(f);
+    }
+    uint32_t intact = ok ? flash_mgr_intact_prefix(buffer, tail) : tail;
+    free(buffer);
+    
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to read the tail of %s", path);
+        return ESP_FAIL;
+    }
+    
+    if (intact < tail) {
+        uint32_t keep = *entries - tail + intact;
+        ESP_LOGW(TAG, "Truncating %u torn entries at end of %s", tail - intact, path);
+        if (truncate(path, (off_t)keep * sizeof(flash_mgr_entry_t)) != 0) {
+            ESP_LOGE(TAG, "Failed to truncate %s", path);
+            return ESP_FAIL;
+        }
+        *entries = keep;
+    }
+    
+    return ESP_OK;
+}
+
+static esp_err_t file_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id) {
+    char temp_file[256];
+    snprintf(temp_file, sizeof(temp_file), "%s_temp.bin", mgr->config.data_file);
+    
+    struct stat st;
+    if (stat(mgr->config.data_file, &st) != 0) {
+        // A reset between remove() and rename() in a delete leaves only the temp file
+        if (stat(temp_file, &st) == 0 && rename(temp_file, mgr->config.data_file) == 0) {
+            ESP_LOGW(TAG, "Completed interrupted delete from %s", temp_file);
+        } else {
+            st.st_size = 0;
+        }
+    } else {
+        // Leftover copy from an interrupted delete; the original is still intact
+        remove(temp_file);
+    }
+    
+    uint32_t file_entries = st.st_size / sizeof(flash_mgr_entry_t);
+    
+    if (st.st_size % sizeof(flash_mgr_entry_t) != 0) {
+        ESP_LOGW(TAG, "Truncating torn record at end of data file (%ld bytes)", (long)st.st_size);
+        if (truncate(mgr->config.data_file, file_entries * sizeof(flash_mgr_entry_t)) != 0) {
+            ESP_LOGE(TAG, "Failed to truncate data file");
+            return ESP_FAIL;
+        }
+    }
+    
+    esp_err_t ret = trim_torn_tail(mgr, mgr->config.data_file, &file_entries);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    if (file_entries == 0) {
+        *first_id = *end_id = 0;
+        return ESP_OK;
+    }
+    
+    FILE *f = fopen(mgr->config.data_file, "rb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open data file for recovery");
+        return ESP_FAIL;
+    }
+    
+    flash_mgr_entry_t first, last;
+    bool ok = fread(&first, sizeof(first), 1, f) == 1 &&
+              fseek(f, (long)(file_entries - 1) * sizeof(flash_mgr_entry_t), SEEK_SET) == 0 &&
+              fread(&last, sizeof(last), 1, f) == 1;
+    fclose(f);
+    
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to read first/last record for recovery");
+        return ESP_FAIL;
+    }
+    
+    *end_id = last.id + 1;
+    if (last.id - first.id + 1 != file_entries) {
+        // Ids are not contiguous; trust the record count and never reuse ids
+        ESP_LOGW(TAG, "Data file ids %u..%u don't match %u records", first.id, last.id, file_entries);
+        if (mgr->meta.next_id > *end_id) {
+            *end_id = mgr->meta.next_id;
+        }
+    }
+    *first_id = *end_id - file_entries;
+    
+    return ESP_OK;
+}
+
+static esp_err_t file_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                     uint32_t *written) {
+    FILE *f = fopen(mgr->config.data_file, "ab");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open data file for append");
+        *written = 0;
+        return ESP_FAIL;
+    }
+    
+    *written = fwrite(entries, sizeof(flash_mgr_entry_t), count, f);
+    fclose(f);
+    
+    return (*written == count) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                   uint32_t *entries_read) {
+    flash_mgr_read_handle_t handle = {0};
+    esp_err_t ret = file_backend_read_cached(mgr, &handle, id, buffer, count, entries_read);
+    read_handle_close(&handle);
+    return ret;
+}
+
+static esp_err_t file_backend_read_cached(flash_mgr_state_t *mgr, flash_mgr_read_handle_t *handle, uint32_t id,
+                                          flash_mgr_entry_t *buffer, uint32_t count, uint32_t *entries_read) {
+    *entries_read = 0;
+    
+    // The file starts head_offset entries before the current head
+    long offset = (long)(id - mgr->meta.deleted_from_start + mgr->meta.head_offset) *
+                  sizeof(flash_mgr_entry_t);
+    
+    for (;;) {
+        bool reused = handle->f != NULL;
+        if (!reused) {
+            handle->f = read_handle_open(mgr->config.data_file);
+            if (!handle->f) {
+                ESP_LOGE(TAG, "Failed to open data file for reading");
+                return ESP_FAIL;
+            }
+        }
+        
+        if (fseek(handle->f, offset, SEEK_SET) != 0) {
+            read_handle_close(handle);
+            return ESP_FAIL;
+        }
+        
+        *entries_read = fread(buffer, sizeof(flash_mgr_entry_t), count, handle->f);
+        if (*entries_read == count || !reused) {
+            return ESP_OK;
+        }
+        
+        // A kept handle may not see entries appended since it was opened
+        read_handle_close(handle);
+    }
+}
+
+/**
+* @brief Open a file for read_cached(), unbuffered so a read goes straight into the caller's buffer
+*/
+static FILE *read_handle_open(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f) {
+        setvbuf(f, NULL, _IONBF, 0);
+    }
+    return f;
+}
+
+static void read_handle_close(flash_mgr_read_handle_t *handle) {
+    if (handle->f) {
+        fclose(handle->f);
+        handle->f = NULL;
+    }
+    free(handle->packed);
+    handle->packed = NULL;
+    handle->packed_block = 0;
+}
+
+/**
+* @brief Close the files read cursors keep open
+* 
+* Called before a data file is removed, replaced or truncated. Runs with readers
+* excluded, so no cursor is using its handle; cursors reopen on the next read.
+*/
+static void release_read_handles(flash_mgr_state_t *mgr) {
+    for (flash_mgr_iter_t *it = mgr->iterators; it; it = it->next) {
+        read_handle_close(&it->handle);
+    }
+    read_handle_close(&mgr->read_ahead.handle);
+    mgr->read_ahead.count = 0;
+}
+
+/**
+* @brief Read through the read-ahead window, refilling it with one large read on a miss
+* 
+* Requests at least as large as the window skip it and are read straight
+* into buffer, through the window's open file.
+* 
+* @param limit_id First id not on flash yet, the window never reaches it
+*/
+static esp_err_t read_ahead(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                            uint32_t limit_id, uint32_t *entries_read) {
+    flash_mgr_read_ahead_t *ra = &mgr->read_ahead;
+    *entries_read = 0;
+    
+    while (*entries_read < count) {
+        uint32_t left = count - *entries_read;
+        if (id >= ra->first_id && id - ra->first_id < ra->count) {
+            uint32_t avail = ra->first_id + ra->count - id;
+            uint32_t n = (left < avail) ? left : avail;
+            memcpy(&buffer[*entries_read], &ra->entries[id - ra->first_id], n * sizeof(flash_mgr_entry_t));
+            *entries_read += n;
+            id += n;
+            continue;
+        }
+        
+        uint32_t done = 0;
+        if (left >= ra->capacity) {
+            esp_err_t ret = mgr->backend->read_cached(mgr, &ra->handle, id, &buffer[*entries_read], left, &done);
+            *entries_read += done;
+            return ret;
+        }
+        
+        uint32_t want = (limit_id - id < ra->capacity) ? limit_id - id : ra->capacity;
+        ra->count = 0;
+        esp_err_t ret = mgr->backend->read_cached(mgr, &ra->handle, id, ra->entries, want, &done);
+        ra->first_id = id;
+        ra->count = done;
+        if (done == 0) {
+            return ret;
+        }
+    }
+    
+    return ESP_OK;
+}
+
+static esp_err_t file_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count) {
+    // Calculate remaining data
+    uint32_t remaining_entries = mgr->meta.active_entries - count;
     
     if (remaining_entries == 0) {
         // Simple case: delete entire file
         ESP_LOGI(TAG, "Deleting entire file (no remaining entries)");
-        if (remove(g_state.config.data_file) != 0) {
+        release_read_handles(mgr);
+        if (remove(mgr->config.data_file) != 0) {
             ESP_LOGW(TAG, "Failed to remove file, but continuing");
         }
-        
-        g_state.meta.active_entries = 0;
-        g_state.meta.deleted_from_start += count;
-        return save_metadata();
+        mgr->meta.head_offset = 0;
+        return ESP_OK;
+    }
+    
+    if (mgr->config.logical_delete) {
+        // O(1): just move the head, file_backend_reclaim(mgr) compacts later
+        mgr->meta.head_offset += count;
+        return ESP_OK;
+    }
+    
+    esp_err_t ret = file_compact(mgr, mgr->meta.head_offset + count, remaining_entries);
+    if (ret == ESP_OK) {
+        mgr->meta.head_offset = 0;
+    }
+    return ret;
+}
+
+static esp_err_t file_backend_reclaim(flash_mgr_state_t *mgr) {
+    // Staged entries aren't in the file yet
+    uint32_t live_entries = mgr->meta.active_entries - mgr->staged_count;
+    
+    esp_err_t ret = file_compact(mgr, mgr->meta.head_offset, live_entries);
+    if (ret == ESP_OK) {
+        mgr->meta.head_offset = 0;
     }
+    return ret;
+}
+
+/**
+* @brief Rewrite the data file without its first skip_entries entries
+* 
+* Copies the following keep_entries entries to a temp file in chunk_buffer_size
+* pieces and renames it over the data file.
+*/
+static esp_err_t file_compact(flash_mgr_state_t *mgr, uint32_t skip_entries, uint32_t keep_entries) {
+    uint32_t bytes_to_skip = skip_entries * sizeof(flash_mgr_entry_t);
     
     // Use configured chunk size for RAM-efficient operation
-    uint8_t *chunk_buffer = malloc(g_state.config.chunk_buffer_size);
+    uint8_t *chunk_buffer = malloc(mgr->config.chunk_buffer_size);
     if (!chunk_buffer) {
-        ESP_LOGE(TAG, "Failed to allocate %u byte chunk buffer", g_state.config.chunk_buffer_size);
+        ESP_LOGE(TAG, "Failed to allocate %u byte chunk buffer", mgr->config.chunk_buffer_size);
         return ESP_ERR_NO_MEM;
     }
     
     // Create temporary file for safe operation
     char temp_file[256];
-    snprintf(temp_file, sizeof(temp_file), "%s_temp.bin", g_state.config.data_file);
+    snprintf(temp_file, sizeof(temp_file), "%s_temp.bin", mgr->config.data_file);
     
-    FILE *src = fopen(g_state.config.data_file, "rb");
+    FILE *src = fopen(mgr->config.data_file, "rb");
     if (!src) {
         ESP_LOGE(TAG, "Failed to open source file");
         free(chunk_buffer);
@@ -378,14 +4173,17 @@ esp_err_t flash_mgr_delete(uint32_t count) {
     }
     
     // Copy remaining data in chunks
-    uint32_t remaining_bytes = remaining_entries * sizeof(flash_mgr_entry_t);
+    uint32_t remaining_bytes = keep_entries * sizeof(flash_mgr_entry_t);
     uint32_t bytes_copied = 0;
     
-    ESP_LOGI(TAG, "Copying %u bytes in chunks of %u", remaining_bytes, g_state.config.chunk_buffer_size);
+    ESP_LOGI(TAG, "Copying %u bytes in chunks of %u", remaining_bytes, mgr->config.chunk_buffer_size);
+    
+    // The data file is only read until the swap below, so readers may keep using it
+    readers_resume(mgr);
     
     while (bytes_copied < remaining_bytes) {
-        uint32_t chunk_size = (remaining_bytes - bytes_copied > g_state.config.chunk_buffer_size) ? 
-                            g_state.config.chunk_buffer_size : (remaining_bytes - bytes_copied);
+        uint32_t chunk_size = (remaining_bytes - bytes_copied > mgr->config.chunk_buffer_size) ? 
+                            mgr->config.chunk_buffer_size : (remaining_bytes - bytes_copied);
         
         size_t read = fread(chunk_buffer, 1, chunk_size, src);
         if (read != chunk_size) {
@@ -409,6 +4207,8 @@ esp_err_t flash_mgr_delete(uint32_t count) {
         }
     }
     
+    readers_pause(mgr);
+    
     fclose(src);
     fclose(dst);
     free(chunk_buffer);
@@ -420,281 +4220,1080 @@ esp_err_t flash_mgr_delete(uint32_t count) {
     }
     
     // Atomically replace original file with temp file
-    if (remove(g_state.config.data_file) != 0) {
+    release_read_handles(mgr);
+    if (remove(mgr->config.data_file) != 0) {
         ESP_LOGE(TAG, "Failed to remove original file");
         remove(temp_file);
         return ESP_FAIL;
     }
     
-    if (rename(temp_file, g_state.config.data_file) != 0) {
+    if (rename(temp_file, mgr->config.data_file) != 0) {
         ESP_LOGE(TAG, "Failed to rename temp file");
         return ESP_FAIL;
     }
     
-    // Update metadata
-    g_state.meta.active_entries -= count;
-    g_state.meta.deleted_from_start += count;
+    return ESP_OK;
+}
+
+static esp_err_t file_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id) {
+    long size = (long)(end_id - mgr->meta.deleted_from_start + mgr->meta.head_offset) *
+                sizeof(flash_mgr_entry_t);
     
-    esp_err_t ret = save_metadata();
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save metadata after deletion");
-        return ret;
+    struct stat st;
+    if (stat(mgr->config.data_file, &st) != 0 || st.st_size <= size) {
+        return ESP_OK;
     }
     
-    ESP_LOGI(TAG, "Successfully deleted %u entries. Active: %u, Total deleted: %u", 
-            count, g_state.meta.active_entries, g_state.meta.deleted_from_start);
+    release_read_handles(mgr);
+    if (truncate(mgr->config.data_file, size) != 0) {
+        ESP_LOGE(TAG, "Failed to truncate data file to %ld bytes", size);
+        return ESP_FAIL;
+    }
     
     return ESP_OK;
 }
 
-esp_err_t flash_mgr_get_status(flash_mgr_status_t* status) {
-    if (!status) {
-        return ESP_ERR_INVALID_ARG;
+static void file_backend_erase(flash_mgr_state_t *mgr) {
+    release_read_handles(mgr);
+    remove(mgr->config.data_file);
+}
+
+/**
+* @brief Build the path of a segment file
+* 
+* Segments live next to data_file with the segment index inserted before the
+* extension, e.g. "/ext/data.bin" -> "/ext/data.000123.bin". Segment n holds
+* ids [n * seg_entries, (n + 1) * seg_entries).
+*/
+static void segment_path(flash_mgr_state_t *mgr, uint32_t segment, const char *suffix, char *path, size_t len) {
+    const char *data_file = mgr->config.data_file;
+    const char *slash = strrchr(data_file, '/');
+    const char *ext = strrchr(data_file, '.');
+    int base_len = (ext && (!slash || ext > slash)) ? (int)(ext - data_file) : (int)strlen(data_file);
+    
+    snprintf(path, len, "%.*s.%06u.%s", base_len, data_file, segment, suffix);
+}
+
+/**
+* @brief Path of the file a segment lives in: sealed ones are data.000123.dlt
+*/
+static void segment_file(flash_mgr_state_t *mgr, uint32_t segment, char *path, size_t len) {
+    segment_path(mgr, segment, segment < mgr->seg_sealed ? "dlt" : "bin", path, len);
+}
+
+static bool segment_stat(flash_mgr_state_t *mgr, uint32_t segment, const char *suffix, struct stat *st) {
+    char path[256];
+    segment_path(mgr, segment, suffix, path, sizeof(path));
+    return stat(path, st) == 0;
+}
+
+/**
+* @brief Find the newest segment index on flash
+* 
+* @return true if at least one segment file exists
+*/
+static bool segment_find_last(flash_mgr_state_t *mgr, uint32_t *last) {
+    const char *data_file = mgr->config.data_file;
+    const char *slash = strrchr(data_file, '/');
+    const char *ext = strrchr(data_file, '.');
+    const char *base = slash ? slash + 1 : data_file;
+    int base_len = (ext && ext > base) ? (int)(ext - base) : (int)strlen(base);
+    
+    char dir_path[256];
+    if (slash) {
+        snprintf(dir_path, sizeof(dir_path), "%.*s", (int)(slash - data_file), data_file);
+    } else {
+        snprintf(dir_path, sizeof(dir_path), "%s", mgr->config.mount_point);
     }
     
-    if (!g_state.initialized) {
-        memset(status, 0, sizeof(flash_mgr_status_t));
-        status->initialized = false;
-        return ESP_ERR_INVALID_STATE;
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return false;
     }
     
-    status->total_entries = g_state.meta.total_entries;
-    status->active_entries = g_state.meta.active_entries;
-    status->deleted_entries = g_state.meta.deleted_from_start;
-    status->used_space_bytes = g_state.meta.active_entries * sizeof(flash_mgr_entry_t);
-    status->free_space_bytes = g_state.config.max_data_size - status->used_space_bytes;
-    status->initialized = true;
+    bool found = false;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned int index;
+        char suffix[5];
+        if (strncmp(entry->d_name, base, base_len) != 0 ||
+            sscanf(entry->d_name + base_len, ".%u.%4s", &index, suffix) != 2 ||
+            (strcmp(suffix, "bin") != 0 && strcmp(suffix, "dlt") != 0)) {
+            continue;
+        }
+        if (!found || index > *last) {
+            *last = index;
+        }
+        found = true;
+    }
     
-    return ESP_OK;
+    closedir(dir);
+    return found;
 }
 
-esp_err_t flash_mgr_cleanup(uint32_t target_entries) {
-    if (!g_state.initialized) {
-        return ESP_ERR_INVALID_STATE;
-    }
+static esp_err_t segment_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id) {
+    uint32_t last;
     
-    if (target_entries >= g_state.meta.active_entries) {
-        ESP_LOGW(TAG, "Target entries %u >= active entries %u, no cleanup needed", 
-                target_entries, g_state.meta.active_entries);
+    mgr->seg_first = 0;
+    mgr->seg_count = 0;
+    mgr->seg_sealed = 0;
+    mgr->seg_bytes = 0;
+    *first_id = *end_id = 0;
+    
+    if (!segment_find_last(mgr, &last)) {
         return ESP_OK;
     }
     
-    uint32_t entries_to_remove = g_state.meta.active_entries - target_entries;
-    ESP_LOGI(TAG, "Manual cleanup: removing %u entries (keeping %u)", 
-            entries_to_remove, target_entries);
+    // Walk back over the contiguous run; anything older than a gap is unreachable
+    char path[256];
+    struct stat st;
+    uint32_t first = last;
+    while (first > 0 && (segment_stat(mgr, first - 1, "bin", &st) || segment_stat(mgr, first - 1, "dlt", &st))) {
+        first--;
+    }
+    
+    // Sealed segments are the oldest ones; a raw copy beside a sealed one is
+    // left over from a reset right after the sealed file was renamed in
+    mgr->seg_sealed = first;
+    while (mgr->seg_sealed <= last && segment_stat(mgr, mgr->seg_sealed, "dlt", &st)) {
+        segment_path(mgr, mgr->seg_sealed, "bin", path, sizeof(path));
+        remove(path);
+        mgr->seg_sealed++;
+    }
+    segment_path(mgr, mgr->seg_sealed, "tmp", path, sizeof(path));
+    remove(path);
+    
+    uint32_t tail_entries = mgr->seg_entries; // Only full segments are sealed
+    if (last >= mgr->seg_sealed) {
+        segment_path(mgr, last, "bin", path, sizeof(path));
+        if (stat(path, &st) != 0) {
+            return ESP_FAIL;
+        }
+        
+        tail_entries = st.st_size / sizeof(flash_mgr_entry_t);
+        if (st.st_size % sizeof(flash_mgr_entry_t) != 0) {
+            ESP_LOGW(TAG, "Truncating torn record at end of %s (%ld bytes)", path, (long)st.st_size);
+            if (truncate(path, tail_entries * sizeof(flash_mgr_entry_t)) != 0) {
+                ESP_LOGE(TAG, "Failed to truncate segment");
+                return ESP_FAIL;
+            }
+        }
+        
+        esp_err_t ret = trim_torn_tail(mgr, path, &tail_entries);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    
+    mgr->seg_first = first;
+    mgr->seg_count = last - first + 1;
+    mgr->seg_bytes = 0;
+    for (uint32_t segment = first; segment <= last; segment++) {
+        if (segment_stat(mgr, segment, segment < mgr->seg_sealed ? "dlt" : "bin", &st)) {
+            mgr->seg_bytes += st.st_size;
+        }
+    }
+    *first_id = first * mgr->seg_entries;
+    *end_id = last * mgr->seg_entries + tail_entries;
     
-    return flash_mgr_delete(entries_to_remove);
+    ESP_LOGI(TAG, "Found %u segments (%06u-%06u), %u sealed", mgr->seg_count, first, last,
+            mgr->seg_sealed - first);
+    return ESP_OK;
 }
 
-esp_err_t flash_mgr_format(void) {
-    if (!g_state.initialized) {
-        return ESP_ERR_INVALID_STATE;
+static esp_err_t segment_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                        uint32_t *written) {
+    char path[256];
+    *written = 0;
+    
+    while (*written < count) {
+        // Position comes from the id; a batch can straddle a segment boundary
+        uint32_t id = entries[*written].id;
+        uint32_t segment = id / mgr->seg_entries;
+        uint32_t room = mgr->seg_entries - (id % mgr->seg_entries);
+        uint32_t batch = (count - *written < room) ? (count - *written) : room;
+        
+        segment_path(mgr, segment, "bin", path, sizeof(path));
+        FILE *f = fopen(path, "ab");
+        if (!f) {
+            ESP_LOGE(TAG, "Failed to open segment %s for append", path);
+            return ESP_FAIL;
+        }
+        
+        size_t done = fwrite(&entries[*written], sizeof(flash_mgr_entry_t), batch, f);
+        fclose(f);
+        mgr->seg_bytes += done * sizeof(flash_mgr_entry_t);
+        
+        if (mgr->seg_count == 0) {
+            mgr->seg_first = segment;
+            mgr->seg_count = 1;
+        } else if (segment >= mgr->seg_first + mgr->seg_count) {
+            mgr->seg_count = segment - mgr->seg_first + 1;
+        }
+        
+        *written += done;
+        if (done != batch) {
+            return ESP_FAIL;
+        }
     }
     
-    ESP_LOGW(TAG, "Formatting storage - ALL DATA WILL BE LOST");
+    return ESP_OK;
+}
+
+/**
+* @brief Read from a sealed segment: load the block holding index, decode what's asked for
+* 
+* The handle keeps the encoded block, so paging through a block reads it once.
+* Stops at the end of the block; the caller moves on to the next.
+*/
+static esp_err_t sealed_read(flash_mgr_state_t *mgr, flash_mgr_read_handle_t *handle, uint32_t index,
+                             flash_mgr_entry_t *buffer, uint32_t count, uint32_t *entries_read) {
+    *entries_read = 0;
+    uint32_t block = index / FLASH_MGR_DELTA_BLOCK_ENTRIES;
+    uint32_t skip = index % FLASH_MGR_DELTA_BLOCK_ENTRIES;
+    
+    if (!handle->packed) {
+        handle->packed = malloc(FLASH_MGR_DELTA_MAX_BLOCK_BYTES(FLASH_MGR_DELTA_BLOCK_ENTRIES));
+        handle->packed_block = 0;
+        if (!handle->packed) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
     
-    // Remove data files
-    remove(g_state.config.data_file);
-    remove(g_state.config.meta_file);
+    if (handle->packed_block != block + 1) {
+        flash_mgr_delta_header_t header;
+        uint32_t offsets[2];
+        bool ok = fseek(handle->f, 0, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, handle->f) == 1 &&
+                  header.magic == FLASH_MGR_DELTA_MAGIC && header.block_entries == FLASH_MGR_DELTA_BLOCK_ENTRIES &&
+                  fseek(handle->f, (long)(sizeof(header) + block * sizeof(uint32_t)), SEEK_SET) == 0 &&
+                  fread(offsets, sizeof(uint32_t), 2, handle->f) == 2 && offsets[1] > offsets[0] &&
+                  offsets[1] - offsets[0] <= FLASH_MGR_DELTA_MAX_BLOCK_BYTES(FLASH_MGR_DELTA_BLOCK_ENTRIES) &&
+                  fseek(handle->f, (long)offsets[0], SEEK_SET) == 0 &&
+                  fread(handle->packed, 1, offsets[1] - offsets[0], handle->f) == offsets[1] - offsets[0];
+        if (!ok) {
+            ESP_LOGE(TAG, "Failed to read block %u of sealed segment %u", block, handle->segment);
+            handle->packed_block = 0;
+            return ESP_FAIL;
+        }
+        handle->packed_block = block + 1;
+        handle->packed_len = offsets[1] - offsets[0];
+        handle->packed_entries = header.entries;
+    }
     
-    // Reset metadata
-    memset(&g_state.meta, 0, sizeof(g_state.meta));
-    g_state.meta.magic = FLASH_MGR_METADATA_MAGIC;
+    if (index >= handle->packed_entries) {
+        return ESP_OK;
+    }
+    uint32_t block_count = handle->packed_entries - block * FLASH_MGR_DELTA_BLOCK_ENTRIES;
+    if (block_count > FLASH_MGR_DELTA_BLOCK_ENTRIES) {
+        block_count = FLASH_MGR_DELTA_BLOCK_ENTRIES;
+    }
+    uint32_t n = (count < block_count - skip) ? count : block_count - skip;
     
-    esp_err_t ret = save_metadata();
+    esp_err_t ret = flash_mgr_delta_decode(handle->packed, handle->packed_len,
+                                           handle->segment * mgr->seg_entries + block * FLASH_MGR_DELTA_BLOCK_ENTRIES,
+                                           block_count, skip, buffer, n);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save metadata after format");
+        ESP_LOGE(TAG, "Block %u of sealed segment %u is damaged", block, handle->segment);
+        handle->packed_block = 0;
         return ret;
     }
     
-    ESP_LOGI(TAG, "Storage formatted successfully");
+    *entries_read = n;
     return ESP_OK;
 }
 
-esp_err_t flash_mgr_get_fs_info(size_t* total_bytes, size_t* used_bytes) {
-    if (!g_state.initialized) {
-        return ESP_ERR_INVALID_STATE;
+static esp_err_t segment_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                      uint32_t *entries_read) {
+    flash_mgr_read_handle_t handle = {0};
+    esp_err_t ret = segment_backend_read_cached(mgr, &handle, id, buffer, count, entries_read);
+    read_handle_close(&handle);
+    return ret;
+}
+
+static esp_err_t segment_backend_read_cached(flash_mgr_state_t *mgr, flash_mgr_read_handle_t *handle, uint32_t id,
+                                             flash_mgr_entry_t *buffer, uint32_t count, uint32_t *entries_read) {
+    char path[256];
+    *entries_read = 0;
+    
+    while (*entries_read < count) {
+        uint32_t segment = id / mgr->seg_entries;
+        uint32_t offset = id % mgr->seg_entries;
+        uint32_t room = mgr->seg_entries - offset;
+        uint32_t batch = (count - *entries_read < room) ? (count - *entries_read) : room;
+        
+        bool reused = handle->f != NULL && handle->segment == segment;
+        if (!reused) {
+            read_handle_close(handle);
+            segment_file(mgr, segment, path, sizeof(path));
+            handle->f = read_handle_open(path);
+            if (!handle->f) {
+                ESP_LOGE(TAG, "Failed to open segment %s for reading", path);
+                return ESP_FAIL;
+            }
+            handle->segment = segment;
+        }
+        
+        if (segment < mgr->seg_sealed) {
+            uint32_t done = 0;
+            esp_err_t ret = sealed_read(mgr, handle, offset, &buffer[*entries_read], batch, &done);
+            *entries_read += done;
+            id += done;
+            if (ret != ESP_OK || done != batch) {
+                return ret;
+            }
+            continue;
+        }
+        
+        if (fseek(handle->f, (long)offset * sizeof(flash_mgr_entry_t), SEEK_SET) != 0) {
+            read_handle_close(handle);
+            return ESP_FAIL;
+        }
+        
+        size_t done = fread(&buffer[*entries_read], sizeof(flash_mgr_entry_t), batch, handle->f);
+        if (done != batch && reused) {
+            // A kept handle may not see entries appended since it was opened
+            read_handle_close(handle);
+            continue;
+        }
+        
+        *entries_read += done;
+        id += done;
+        if (done != batch) {
+            break;
+        }
     }
     
-    return esp_littlefs_info(g_state.config.partition_label, total_bytes, used_bytes);
+    return ESP_OK;
 }
 
-// =============================================================================
-// INTERNAL FUNCTION IMPLEMENTATIONS
-// =============================================================================
-
-static esp_err_t init_external_flash(void) {
-    spi_bus_config_t bus_cfg = {
-        .mosi_io_num = g_state.config.mosi_pin,
-        .miso_io_num = g_state.config.miso_pin,
-        .sclk_io_num = g_state.config.sclk_pin,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1
+/**
+* @brief Write the delta encoded copy of a full raw segment to its .tmp file
+* 
+* @param[out] size Bytes written
+*/
+static esp_err_t segment_encode(flash_mgr_state_t *mgr, uint32_t segment, const char *raw_path, const char *tmp_path,
+                                uint32_t *size) {
+    uint32_t blocks = (mgr->seg_entries + FLASH_MGR_DELTA_BLOCK_ENTRIES - 1) / FLASH_MGR_DELTA_BLOCK_ENTRIES;
+    flash_mgr_entry_t *entries = malloc(FLASH_MGR_DELTA_BLOCK_ENTRIES * sizeof(flash_mgr_entry_t));
+    uint8_t *packed = malloc(FLASH_MGR_DELTA_MAX_BLOCK_BYTES(FLASH_MGR_DELTA_BLOCK_ENTRIES));
+    uint32_t *offsets = malloc((blocks + 1) * sizeof(uint32_t));
+    FILE *in = fopen(raw_path, "rb");
+    FILE *out = fopen(tmp_path, "wb");
+    
+    flash_mgr_delta_header_t header = {
+        .magic = FLASH_MGR_DELTA_MAGIC,
+        .first_id = segment * mgr->seg_entries,
+        .entries = mgr->seg_entries,
+        .block_entries = FLASH_MGR_DELTA_BLOCK_ENTRIES
     };
     
-    esp_err_t ret = spi_bus_initialize(g_state.config.spi_host, &bus_cfg, SPI_DMA_CH_AUTO);
-    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
-        ESP_LOGE(TAG, "SPI bus init failed: %s", esp_err_to_name(ret));
-        return ret;
+    // Offsets are only known once the blocks are written, so the table is written twice
+    uint32_t pos = sizeof(header) + (blocks + 1) * sizeof(uint32_t);
+    bool ok = entries && packed && offsets && in && out &&
+              fwrite(&header, sizeof(header), 1, out) == 1 && fseek(out, (long)pos, SEEK_SET) == 0;
+    for (uint32_t block = 0; ok && block < blocks; block++) {
+        uint32_t count = mgr->seg_entries - block * FLASH_MGR_DELTA_BLOCK_ENTRIES;
+        count = (count < FLASH_MGR_DELTA_BLOCK_ENTRIES) ? count : FLASH_MGR_DELTA_BLOCK_ENTRIES;
+        ok = fread(entries, sizeof(flash_mgr_entry_t), count, in) == count;
+        if (ok) {
+            size_t len = flash_mgr_delta_encode(entries, count, packed);
+            offsets[block] = pos;
+            ok = fwrite(packed, 1, len, out) == len;
+            pos += len;
+        }
+    }
+    if (ok) {
+        offsets[blocks] = pos;
+        ok = fseek(out, sizeof(header), SEEK_SET) == 0 &&
+             fwrite(offsets, sizeof(uint32_t), blocks + 1, out) == blocks + 1;
+    }
+    
+    if (in) {
+        fclose(in);
+    }
+    if (out && fclose(out) != 0) {
+        ok = false;
+    }
+    free(entries);
+    free(packed);
+    free(offsets);
+    
+    *size = pos;
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+/**
+* @brief Delta encode the full segments behind the tail (compress_segments)
+* 
+* Only segments before the one holding the newest flushed entry are sealed, so
+* appends, truncation and the torn-tail check only ever see raw files. Encoding
+* runs with readers in; they're only excluded for the swap. Every entry is
+* written twice (raw, then encoded), so this trades flash wear for capacity.
+*/
+static esp_err_t seal_segments(flash_mgr_state_t *mgr) {
+    if (!mgr->config.compress_segments || mgr->backend != &s_segment_backend || mgr->seg_count == 0) {
+        return ESP_OK;
+    }
+    
+    uint32_t flushed_end = mgr->meta.deleted_from_start + mgr->meta.active_entries - mgr->staged_count;
+    uint32_t tail_segment = (flushed_end - 1) / mgr->seg_entries;
+    if (mgr->seg_sealed < mgr->seg_first) {
+        mgr->seg_sealed = mgr->seg_first;
+    }
+    
+    while (mgr->seg_sealed < tail_segment) {
+        uint32_t segment = mgr->seg_sealed;
+        char raw_path[256];
+        char tmp_path[256];
+        char sealed_path[256];
+        segment_path(mgr, segment, "bin", raw_path, sizeof(raw_path));
+        segment_path(mgr, segment, "tmp", tmp_path, sizeof(tmp_path));
+        segment_path(mgr, segment, "dlt", sealed_path, sizeof(sealed_path));
+        
+        uint32_t size = 0;
+        readers_resume(mgr);
+        esp_err_t ret = segment_encode(mgr, segment, raw_path, tmp_path, &size);
+        readers_pause(mgr);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to seal segment %u", segment);
+            remove(tmp_path);
+            return ret;
+        }
+        
+        // Once the rename is done the sealed file wins, see segment_backend_recover(mgr)
+        release_read_handles(mgr);
+        if (rename(tmp_path, sealed_path) != 0) {
+            ESP_LOGE(TAG, "Failed to rename %s", tmp_path);
+            remove(tmp_path);
+            return ESP_FAIL;
+        }
+        mgr->seg_sealed++;
+        remove(raw_path);
+        
+        mgr->seg_bytes -= mgr->seg_entries * sizeof(flash_mgr_entry_t);
+        mgr->seg_bytes += size;
+        ESP_LOGI(TAG, "Sealed segment %u: %u -> %u bytes", segment,
+                (unsigned)(mgr->seg_entries * sizeof(flash_mgr_entry_t)), size);
+    }
+    
+    return ESP_OK;
+}
+
+static esp_err_t segment_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count) {
+    uint32_t new_head = mgr->meta.deleted_from_start + count;
+    char path[256];
+    
+    // Only whole segments are unlinked; the head offset into the first one is
+    // kept in deleted_from_start
+    while (mgr->seg_count > 0 &&
+           (mgr->seg_first + 1) * mgr->seg_entries <= new_head) {
+        release_read_handles(mgr);
+        segment_file(mgr, mgr->seg_first, path, sizeof(path));
+        struct stat st;
+        uint32_t size = (stat(path, &st) == 0) ? st.st_size : 0;
+        if (remove(path) != 0) {
+            ESP_LOGE(TAG, "Failed to remove segment %s", path);
+            return ESP_FAIL;
+        }
+        mgr->seg_bytes -= (size < mgr->seg_bytes) ? size : mgr->seg_bytes;
+        mgr->seg_first++;
+        mgr->seg_count--;
+        if (mgr->seg_sealed < mgr->seg_first) {
+            mgr->seg_sealed = mgr->seg_first;
+        }
+    }
+    
+    return ESP_OK;
+}
+
+static esp_err_t segment_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id) {
+    char path[256];
+    
+    release_read_handles(mgr);
+    
+    // Segments that start at or after end_id only hold the cut entries. end_id
+    // is never below the flushed end, so sealed segments are never touched.
+    struct stat st;
+    while (mgr->seg_count > 0 &&
+           (mgr->seg_first + mgr->seg_count - 1) * mgr->seg_entries >= end_id) {
+        segment_path(mgr, mgr->seg_first + mgr->seg_count - 1, "bin", path, sizeof(path));
+        uint32_t size = (stat(path, &st) == 0) ? st.st_size : 0;
+        if (remove(path) != 0) {
+            ESP_LOGE(TAG, "Failed to remove segment %s", path);
+            return ESP_FAIL;
+        }
+        mgr->seg_bytes -= (size < mgr->seg_bytes) ? size : mgr->seg_bytes;
+        mgr->seg_count--;
+    }
+    
+    if (mgr->seg_count == 0) {
+        return ESP_OK;
+    }
+    
+    uint32_t last = mgr->seg_first + mgr->seg_count - 1;
+    segment_path(mgr, last, "bin", path, sizeof(path));
+    uint32_t size = (stat(path, &st) == 0) ? st.st_size : 0;
+    uint32_t keep = (end_id - last * mgr->seg_entries) * sizeof(flash_mgr_entry_t);
+    if (truncate(path, (long)keep) != 0) {
+        ESP_LOGE(TAG, "Failed to truncate segment %s", path);
+        return ESP_FAIL;
+    }
+    if (size > keep) {
+        mgr->seg_bytes -= (size - keep < mgr->seg_bytes) ? size - keep : mgr->seg_bytes;
+    }
+    
+    return ESP_OK;
+}
+
+static void segment_backend_erase(flash_mgr_state_t *mgr) {
+    char path[256];
+    uint32_t last;
+    
+    release_read_handles(mgr);
+    
+    // Also catches segments from a previous, unrecovered run
+    while (segment_find_last(mgr, &last)) {
+        segment_path(mgr, last, "dlt", path, sizeof(path));
+        bool removed = remove(path) == 0;
+        segment_path(mgr, last, "bin", path, sizeof(path));
+        removed = (remove(path) == 0) || removed;
+        if (!removed) {
+            ESP_LOGE(TAG, "Failed to remove segment %u", last);
+            break;
+        }
+    }
+    
+    mgr->seg_first = 0;
+    mgr->seg_count = 0;
+    mgr->seg_sealed = 0;
+    mgr->seg_bytes = 0;
+}
+
+/**
+* @brief Create and pre-allocate the ring file
+* 
+* Written once: every slot is filled with 0xFF, which fails the entry check,
+* so LittleFS never has to grow the file again.
+*/
+static esp_err_t ring_create(flash_mgr_state_t *mgr, uint32_t base_id) {
+    FILE *f = fopen(mgr->config.data_file, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to create ring file");
+        return ESP_FAIL;
     }
     
-    esp_flash_spi_device_config_t flash_cfg = {
-        .host_id = g_state.config.spi_host,
-        .cs_io_num = g_state.config.cs_pin,
-        .cs_id = 0,
-        .freq_mhz = g_state.config.freq_mhz,
-        .io_mode = SPI_FLASH_FASTRD
+    flash_mgr_ring_header_t header = {
+        .magic = FLASH_MGR_RING_MAGIC,
+        .slots = mgr->ring_slots,
+        .base_id = base_id,
+        .reserved = 0
     };
     
-    ret = spi_bus_add_flash_device(&g_state.ext_flash, &flash_cfg);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Add flash device failed: %s", esp_err_to_name(ret));
-        return ret;
+    uint8_t *chunk_buffer = malloc(mgr->config.chunk_buffer_size);
+    if (!chunk_buffer) {
+        fclose(f);
+        return ESP_ERR_NO_MEM;
     }
+    memset(chunk_buffer, 0xFF, mgr->config.chunk_buffer_size);
     
-    ret = esp_flash_init(g_state.ext_flash);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Flash init failed: %s", esp_err_to_name(ret));
-        return ret;
+    ESP_LOGI(TAG, "Pre-allocating %u slot ring file", mgr->ring_slots);
+    
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    uint32_t remaining_bytes = mgr->ring_slots * sizeof(flash_mgr_entry_t);
+    while (ok && remaining_bytes > 0) {
+        uint32_t chunk_size = (remaining_bytes > mgr->config.chunk_buffer_size) ?
+                            mgr->config.chunk_buffer_size : remaining_bytes;
+        ok = fwrite(chunk_buffer, 1, chunk_size, f) == chunk_size;
+        remaining_bytes -= chunk_size;
     }
     
-    uint32_t jedec_id;
-    ret = esp_flash_read_id(g_state.ext_flash, &jedec_id);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "JEDEC read failed: %s", esp_err_to_name(ret));
-        return ret;
+    fclose(f);
+    free(chunk_buffer);
+    
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to pre-allocate ring file");
+        remove(mgr->config.data_file);
+        return ESP_FAIL;
     }
     
-    ESP_LOGI(TAG, "External flash initialized - JEDEC ID: 0x%06X", jedec_id);
+    mgr->ring_base_id = base_id;
+    mgr->ring_ready = true;
     return ESP_OK;
 }
 
-static esp_err_t init_littlefs(void) {
-    static esp_partition_t ext_partition = {
-        .type = ESP_PARTITION_TYPE_DATA,
-        .subtype = ESP_PARTITION_SUBTYPE_DATA_LITTLEFS,
-        .address = 0x0,
-        .size = 16 * 1024 * 1024, // 16MB
-        .encrypted = false,
-        .readonly = false
-    };
-    
-    // Set partition label and flash chip
-    strncpy((char*)ext_partition.label, g_state.config.partition_label, sizeof(ext_partition.label) - 1);
-    ext_partition.flash_chip = g_state.ext_flash;
+static long ring_slot_offset(flash_mgr_state_t *mgr, uint32_t id) {
+    uint32_t slot = (id - mgr->ring_base_id) % mgr->ring_slots;
+    return (long)sizeof(flash_mgr_ring_header_t) + (long)slot * sizeof(flash_mgr_entry_t);
+}
+
+/**
+* @brief Read one slot; returns false for an empty, torn or unreadable slot
+*/
+static bool ring_read_slot(FILE *f, uint32_t slot, flash_mgr_entry_t *entry) {
+    long offset = (long)sizeof(flash_mgr_ring_header_t) + (long)slot * sizeof(flash_mgr_entry_t);
+    if (fseek(f, offset, SEEK_SET) != 0 || fread(entry, sizeof(*entry), 1, f) != 1) {
+        return false;
+    }
+    return flash_mgr_entry_intact(entry);
+}
+
+/**
+* @brief Read or write the raw slots of count ids from id on, wrapping at the end of the ring
+*/
+static esp_err_t ring_slots_io(flash_mgr_state_t *mgr, FILE *f, uint32_t id, flash_mgr_entry_t *slots,
+                               uint32_t count, bool write) {
+    uint32_t done = 0;
+    while (done < count) {
+        uint32_t slot = (id + done - mgr->ring_base_id) % mgr->ring_slots;
+        uint32_t room = mgr->ring_slots - slot;
+        uint32_t batch = (count - done < room) ? (count - done) : room;
+        
+        if (fseek(f, ring_slot_offset(mgr, id + done), SEEK_SET) != 0) {
+            return ESP_FAIL;
+        }
+        size_t moved = write ? fwrite(&slots[done], sizeof(flash_mgr_entry_t), batch, f)
+                             : fread(&slots[done], sizeof(flash_mgr_entry_t), batch, f);
+        if (moved != batch) {
+            return ESP_FAIL;
+        }
+        done += batch;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ring_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id) {
+    *first_id = *end_id = 0;
+    mgr->ring_ready = false;
+    
+    FILE *f = fopen(mgr->config.data_file, "rb");
+    flash_mgr_ring_header_t header;
+    if (!f || fread(&header, sizeof(header), 1, f) != 1 || header.magic != FLASH_MGR_RING_MAGIC) {
+        if (f) {
+            fclose(f);
+            ESP_LOGW(TAG, "Data file is not a ring, re-creating it");
+        }
+        return ring_create(mgr, mgr->meta.next_id);
+    }
     
-    esp_vfs_littlefs_conf_t conf = {
-        .base_path = g_state.config.mount_point,
-        .partition = &ext_partition,
-        .format_if_mount_failed = g_state.config.format_on_init,
-        .dont_mount = false,
-        .grow_on_mount = false
-    };
+    if (header.slots != mgr->ring_slots) {
+        // Keep existing data readable; a new size takes effect after format
+        ESP_LOGW(TAG, "Ring has %u slots, config asks for %u - keeping %u",
+                header.slots, mgr->ring_slots, header.slots);
+        mgr->ring_slots = header.slots;
+    }
+    mgr->ring_base_id = header.base_id;
+    mgr->ring_ready = true;
     
-    if (g_state.config.format_on_init) {
-        ESP_LOGI(TAG, "Formatting external flash...");
-        esp_err_t fmt_ret = esp_littlefs_format_partition(&ext_partition);
-        if (fmt_ret != ESP_OK) {
-            ESP_LOGE(TAG, "Format failed: %s", esp_err_to_name(fmt_ret));
-            return fmt_ret;
+    flash_mgr_entry_t entry;
+    if (!ring_read_slot(f, 0, &entry)) {
+        fclose(f);
+        return ESP_OK; // Nothing written yet
+    }
+    uint32_t lap_base = entry.id; // Id of slot 0 on the newest lap
+    
+    // Slots [0, tail) belong to slot 0's lap; binary search for the first one that doesn't
+    uint32_t lo = 1;
+    uint32_t hi = mgr->ring_slots;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ring_read_slot(f, mid, &entry) && entry.id == lap_base + mid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
+    uint32_t tail = lo;
+    *end_id = lap_base + tail;
     
-    esp_err_t ret = esp_vfs_littlefs_register(&conf);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "LittleFS mount failed: %s", esp_err_to_name(ret));
-        return ret;
+    // Everything after the tail is either the previous lap or never written
+    if (tail < mgr->ring_slots && ring_read_slot(f, tail, &entry) &&
+        entry.id + mgr->ring_slots == *end_id) {
+        *first_id = *end_id - mgr->ring_slots;
+    } else {
+        *first_id = lap_base;
     }
     
-    ESP_LOGI(TAG, "LittleFS mounted at %s", g_state.config.mount_point);
+    fclose(f);
+    
+    ESP_LOGI(TAG, "Ring tail at slot %u, ids %u-%u", tail, *first_id, *end_id);
     return ESP_OK;
 }
 
-static esp_err_t load_metadata(void) {
-    FILE *f = fopen(g_state.config.meta_file, "rb");
-    if (!f) {
-        // First boot - initialize metadata
-        memset(&g_state.meta, 0, sizeof(g_state.meta));
-        g_state.meta.magic = FLASH_MGR_METADATA_MAGIC;
-        ESP_LOGI(TAG, "Initializing fresh metadata");
-        return ESP_OK;
+static esp_err_t ring_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                     uint32_t *written) {
+    *written = 0;
+    
+    if (!mgr->ring_ready) {
+        esp_err_t ret = ring_create(mgr, entries[0].id);
+        if (ret != ESP_OK) {
+            return ret;
+        }
     }
     
-    size_t read = fread(&g_state.meta, sizeof(flash_mgr_metadata_t), 1, f);
-    fclose(f);
+    if (count > mgr->ring_undo_capacity) {
+        flash_mgr_entry_t *undo = realloc(mgr->ring_undo, count * sizeof(flash_mgr_entry_t));
+        if (!undo) {
+            return ESP_ERR_NO_MEM;
+        }
+        mgr->ring_undo = undo;
+        mgr->ring_undo_capacity = count;
+    }
     
-    if (read != 1) {
-        ESP_LOGE(TAG, "Failed to read metadata");
+    FILE *f = fopen(mgr->config.data_file, "r+b");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open ring file for writing");
         return ESP_FAIL;
     }
     
-    if (g_state.meta.magic != FLASH_MGR_METADATA_MAGIC) {
-        ESP_LOGW(TAG, "Invalid metadata magic, reinitializing");
-        memset(&g_state.meta, 0, sizeof(g_state.meta));
-        g_state.meta.magic = FLASH_MGR_METADATA_MAGIC;
-        return ESP_OK;
+    // Keep what the slots hold, so truncate can put it back if the append fails part way
+    mgr->ring_undo_count = 0;
+    if (ring_slots_io(mgr, f, entries[0].id, mgr->ring_undo, count, false) != ESP_OK) {
+        fclose(f);
+        return ESP_FAIL;
+    }
+    mgr->ring_undo_id = entries[0].id;
+    mgr->ring_undo_count = count;
+    
+    esp_err_t ret = ESP_OK;
+    while (*written < count) {
+        // Contiguous run up to the end of the ring, then wrap to slot 0
+        uint32_t id = entries[*written].id;
+        uint32_t slot = (id - mgr->ring_base_id) % mgr->ring_slots;
+        uint32_t room = mgr->ring_slots - slot;
+        uint32_t batch = (count - *written < room) ? (count - *written) : room;
+        
+        if (fseek(f, ring_slot_offset(mgr, id), SEEK_SET) != 0) {
+            ret = ESP_FAIL;
+            break;
+        }
+        
+        size_t done = fwrite(&entries[*written], sizeof(flash_mgr_entry_t), batch, f);
+        *written += done;
+        if (done != batch) {
+            ret = ESP_FAIL;
+            break;
+        }
     }
     
-    ESP_LOGI(TAG, "Loaded metadata - active: %u, total: %u, deleted: %u",
-            g_state.meta.active_entries, g_state.meta.total_entries, g_state.meta.deleted_from_start);
-    
-    return ESP_OK;
+    fclose(f);
+    return ret;
 }
 
-static esp_err_t save_metadata(void) {
-    FILE *f = fopen(g_state.config.meta_file, "wb");
+static esp_err_t ring_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                   uint32_t *entries_read) {
+    *entries_read = 0;
+    
+    FILE *f = fopen(mgr->config.data_file, "rb");
     if (!f) {
-        ESP_LOGE(TAG, "Failed to open metadata file for writing");
+        ESP_LOGE(TAG, "Failed to open ring file for reading");
         return ESP_FAIL;
     }
     
-    size_t written = fwrite(&g_state.meta, sizeof(flash_mgr_metadata_t), 1, f);
+    esp_err_t ret = ESP_OK;
+    while (*entries_read < count) {
+        uint32_t slot = (id - mgr->ring_base_id) % mgr->ring_slots;
+        uint32_t room = mgr->ring_slots - slot;
+        uint32_t batch = (count - *entries_read < room) ? (count - *entries_read) : room;
+        
+        if (fseek(f, ring_slot_offset(mgr, id), SEEK_SET) != 0) {
+            ret = ESP_FAIL;
+            break;
+        }
+        
+        size_t done = fread(&buffer[*entries_read], sizeof(flash_mgr_entry_t), batch, f);
+        // A slot not holding the requested id was overwritten by a failed write or never written
+        size_t valid = 0;
+        while (valid < done && buffer[*entries_read + valid].id == id + valid) {
+            valid++;
+        }
+        *entries_read += valid;
+        id += valid;
+        if (valid != batch) {
+            break;
+        }
+    }
+    
     fclose(f);
+    return ret;
+}
+
+/**
+* @brief Put back what the last append found in the slots of ids [end_id, end of that append)
+* 
+* Older entries the batch overwrote are readable again, and never written
+* slots are erased again, so recovery doesn't see the cut ids.
+*/
+static esp_err_t ring_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id) {
+    uint32_t skip = end_id - mgr->ring_undo_id;
+    if (skip > mgr->ring_undo_count) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (skip == mgr->ring_undo_count) {
+        return ESP_OK;
+    }
     
-    if (written != 1) {
-        ESP_LOGE(TAG, "Failed to write metadata");
+    FILE *f = fopen(mgr->config.data_file, "r+b");
+    if (!f) {
         return ESP_FAIL;
     }
-    
+    esp_err_t ret = ring_slots_io(mgr, f, end_id, mgr->ring_undo + skip, mgr->ring_undo_count - skip, true);
+    if (fclose(f) != 0) {
+        ret = ESP_FAIL;
+    }
+    if (ret == ESP_OK) {
+        mgr->ring_undo_count = skip;
+    }
+    return ret;
+}
+
+static esp_err_t ring_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count) {
+    // The head lives in metadata; slots are simply overwritten on a later lap
     return ESP_OK;
 }
 
-static uint32_t calculate_max_entries(void) {
-    return g_state.config.max_data_size / sizeof(flash_mgr_entry_t);
+static void ring_backend_erase(flash_mgr_state_t *mgr) {
+    remove(mgr->config.data_file);
+    // Re-created on the next append, with slot 0 at that entry's id
+    mgr->ring_ready = false;
+}
+
+// =============================================================================
+// RAW FLASH BACKEND (esp_flash, no filesystem)
+// =============================================================================
+
+static esp_err_t raw_io_read(void *ctx, uint32_t addr, void *buffer, uint32_t len) {
+    return esp_flash_read((esp_flash_t *)ctx, buffer, addr, len);
+}
+
+static esp_err_t raw_io_write(void *ctx, uint32_t addr, const void *data, uint32_t len) {
+    return esp_flash_write((esp_flash_t *)ctx, data, addr, len);
 }
 
-static esp_err_t perform_auto_cleanup(void) {
-    uint32_t max_entries = calculate_max_entries();
-    uint32_t target_entries = (uint32_t)(max_entries * g_state.config.cleanup_target);
+static esp_err_t raw_io_erase(void *ctx, uint32_t addr, uint32_t len) {
+    return esp_flash_erase_region((esp_flash_t *)ctx, addr, len);
+}
+
+static esp_err_t init_raw_log(flash_mgr_state_t *mgr) {
+    const flash_mgr_raw_io_t io = {
+        .ctx = mgr->ext_flash,
+        .read = raw_io_read,
+        .write = raw_io_write,
+        .erase = raw_io_erase
+    };
+    uint32_t base = FLASH_MGR_EXT_FLASH_SIZE - mgr->raw_region_size;
     
-    if (g_state.meta.active_entries <= target_entries) {
-        return ESP_OK; // Already at target
+    esp_err_t ret = flash_mgr_raw_log_init(&mgr->raw, &io, base, mgr->raw_region_size);
+    if (ret != ESP_OK) {
+        return ret;
     }
     
-    uint32_t entries_to_remove = g_state.meta.active_entries - target_entries;
-    ESP_LOGI(TAG, "Auto cleanup: removing %u entries (keeping %u)", 
-            entries_to_remove, target_entries);
+    ESP_LOGI(TAG, "Raw log at 0x%06X, %u bytes, %u entries",
+            base, mgr->raw_region_size, flash_mgr_raw_log_capacity(&mgr->raw));
     
-    return flash_mgr_delete(entries_to_remove);
+    if (mgr->config.format_on_init) {
+        // Formatting LittleFS doesn't touch the raw region
+        return flash_mgr_raw_log_erase(&mgr->raw);
+    }
+    
+    return ESP_OK;
 }
- 
-static uint32_t get_current_timestamp(void) {
-    // Try to get real timestamp, fallback to entry ID
-    time_t now = time(NULL);
-    if (now > 0) {
-        return (uint32_t)now;
+
+static esp_err_t raw_backend_recover(flash_mgr_state_t *mgr, uint32_t *first_id, uint32_t *end_id) {
+    return flash_mgr_raw_log_recover(&mgr->raw, first_id, end_id);
+}
+
+static void raw_sync_head(flash_mgr_state_t *mgr) {
+    // Recycling a sector can drop more than the capacity accounted for at append time
+    if (mgr->meta.deleted_from_start < mgr->raw.first_id) {
+        uint32_t lost = mgr->raw.first_id - mgr->meta.deleted_from_start;
+        mgr->meta.active_entries -= lost;
+        mgr->meta.deleted_from_start += lost;
+    }
+}
+
+static esp_err_t raw_backend_append(flash_mgr_state_t *mgr, const flash_mgr_entry_t *entries, uint32_t count,
+                                    uint32_t *written) {
+    esp_err_t ret = flash_mgr_raw_log_append(&mgr->raw, entries, count, written);
+    raw_sync_head(mgr);
+    return ret;
+}
+
+static esp_err_t raw_backend_read(flash_mgr_state_t *mgr, uint32_t id, flash_mgr_entry_t *buffer, uint32_t count,
+                                  uint32_t *entries_read) {
+    return flash_mgr_raw_log_read(&mgr->raw, id, buffer, count, entries_read);
+}
+
+static esp_err_t raw_backend_drop_head(flash_mgr_state_t *mgr, uint32_t count) {
+    // The head lives in metadata; sectors are erased when the log wraps onto them
+    return ESP_OK;
+}
+
+static esp_err_t raw_backend_truncate(flash_mgr_state_t *mgr, uint32_t end_id) {
+    esp_err_t ret = flash_mgr_raw_log_truncate(&mgr->raw, end_id);
+    
+    // Sectors recycled by the failed append stay lost
+    if (mgr->raw.empty) {
+        mgr->meta.active_entries = 0;
+        mgr->meta.deleted_from_start = mgr->meta.next_id;
     } else {
-        return g_state.meta.next_id;
+        raw_sync_head(mgr);
+    }
+    return ret;
+}
+
+static void raw_backend_erase(flash_mgr_state_t *mgr) {
+    if (flash_mgr_raw_log_erase(&mgr->raw) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase raw log");
     }
 }
 
+// =============================================================================
+// DEFAULT LOG - THE API WITHOUT A HANDLE
+// =============================================================================
+
+esp_err_t flash_mgr_init(const flash_mgr_config_t* config) {
+    return open_log(&s_default, config);
+}
+
+esp_err_t flash_mgr_deinit(void) {
+    return close_log(&s_default);
+}
+
+bool flash_mgr_is_initialized(void) {
+    return flash_mgr_log_is_initialized(&s_default);
+}
+
+esp_err_t flash_mgr_append(uint8_t type, uint8_t unit, int32_t value_x1000) {
+    return flash_mgr_log_append(&s_default, type, unit, value_x1000);
+}
+
+esp_err_t flash_mgr_append_with_timestamp(uint32_t timestamp, uint8_t type, uint8_t unit, int32_t value_x1000) {
+    return flash_mgr_log_append_with_timestamp(&s_default, timestamp, type, unit, value_x1000);
+}
+
+esp_err_t IRAM_ATTR flash_mgr_append_from_isr(uint32_t timestamp, uint8_t type, uint8_t unit, int32_t value_x1000) {
+    return flash_mgr_log_append_from_isr(&s_default, timestamp, type, unit, value_x1000);
+}
+
+esp_err_t flash_mgr_append_blob(uint8_t type, const void* data, size_t len) {
+    return flash_mgr_log_append_blob(&s_default, type, data, len);
+}
+
+esp_err_t flash_mgr_append_blobs(uint8_t type, const void* records, size_t record_size, uint32_t count) {
+    return flash_mgr_log_append_blobs(&s_default, type, records, record_size, count);
+}
+
+esp_err_t flash_mgr_read_blob(uint32_t id, size_t offset, void* buffer, size_t size, size_t* bytes_read,
+                              size_t* blob_len) {
+    return flash_mgr_log_read_blob(&s_default, id, offset, buffer, size, bytes_read, blob_len);
+}
+
+esp_err_t flash_mgr_append_batch(const flash_mgr_entry_t* entries, uint32_t count) {
+    return flash_mgr_log_append_batch(&s_default, entries, count);
+}
+
+esp_err_t flash_mgr_append_batch_now(const flash_mgr_entry_t* entries, uint32_t count) {
+    return flash_mgr_log_append_batch_now(&s_default, entries, count);
+}
+
+esp_err_t flash_mgr_flush(void) {
+    return flash_mgr_log_flush(&s_default);
+}
+
+esp_err_t flash_mgr_read_chunk(flash_mgr_entry_t* buffer, uint32_t max_entries, uint32_t* entries_read) {
+    return flash_mgr_log_read_chunk(&s_default, buffer, max_entries, entries_read);
+}
+
+esp_err_t flash_mgr_read_at(uint32_t start_index, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                            uint32_t* entries_read) {
+    return flash_mgr_log_read_at(&s_default, start_index, buffer, max_entries, entries_read);
+}
+
+esp_err_t flash_mgr_get_by_id(uint32_t id, flash_mgr_entry_t* entry) {
+    return flash_mgr_log_get_by_id(&s_default, id, entry);
+}
+
+esp_err_t flash_mgr_read_id_range(uint32_t first_id, uint32_t last_id, flash_mgr_entry_t* buffer,
+                                  uint32_t max_entries, uint32_t* entries_read) {
+    return flash_mgr_log_read_id_range(&s_default, first_id, last_id, buffer, max_entries, entries_read);
+}
+
+esp_err_t flash_mgr_query_time_range(uint32_t t0, uint32_t t1, flash_mgr_entry_cb_t callback, void* ctx) {
+    return flash_mgr_log_query_time_range(&s_default, t0, t1, callback, ctx);
+}
+
+esp_err_t flash_mgr_scan(const flash_mgr_filter_t* filter, flash_mgr_entry_cb_t callback, void* ctx) {
+    return flash_mgr_log_scan(&s_default, filter, callback, ctx);
+}
+
+esp_err_t flash_mgr_foreach(uint32_t first_id, uint32_t last_id, const flash_mgr_filter_t* filter,
+                            flash_mgr_entry_cb_t callback, void* ctx) {
+    return flash_mgr_log_foreach(&s_default, first_id, last_id, filter, callback, ctx);
+}
+
+esp_err_t flash_mgr_get_rollups(uint8_t type, flash_mgr_rollup_window_t window, uint32_t from_ts, uint32_t to_ts,
+                                flash_mgr_rollup_t* rollups, uint32_t max_rollups, uint32_t* rollups_read) {
+    return flash_mgr_log_get_rollups(&s_default, type, window, from_ts, to_ts, rollups, max_rollups, rollups_read);
+}
+
+esp_err_t flash_mgr_iter_open(uint32_t start_index, flash_mgr_iter_t** iter) {
+    return flash_mgr_log_iter_open(&s_default, start_index, iter);
+}
+
+esp_err_t flash_mgr_stream(uint8_t type, flash_mgr_handle_t* stream) {
+    return flash_mgr_log_stream(&s_default, type, stream);
+}
+
+esp_err_t flash_mgr_merge_open(flash_mgr_merge_t** merge) {
+    return flash_mgr_log_merge_open(&s_default, merge);
+}
+
+esp_err_t flash_mgr_records_open(uint8_t schema_id, size_t record_size, uint32_t slots,
+                                 flash_mgr_records_t** records) {
+    return flash_mgr_log_records_open(&s_default, schema_id, record_size, slots, records);
+}
+
+esp_err_t flash_mgr_consumer_register(const char* name) {
+    return flash_mgr_log_consumer_register(&s_default, name);
+}
+
+esp_err_t flash_mgr_consumer_unregister(const char* name) {
+    return flash_mgr_log_consumer_unregister(&s_default, name);
+}
+
+esp_err_t flash_mgr_read_next(const char* name, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                              uint32_t* entries_read) {
+    return flash_mgr_log_read_next(&s_default, name, buffer, max_entries, entries_read);
+}
+
+esp_err_t flash_mgr_ack(const char* name, uint32_t count) {
+    return flash_mgr_log_ack(&s_default, name, count);
+}
+
+esp_err_t flash_mgr_delete(uint32_t count) {
+    return flash_mgr_log_delete(&s_default, count);
+}
+
+esp_err_t flash_mgr_reclaim(void) {
+    return flash_mgr_log_reclaim(&s_default);
+}
+
+esp_err_t flash_mgr_get_status(flash_mgr_status_t* status) {
+    return flash_mgr_log_get_status(&s_default, status);
+}
+
+esp_err_t flash_mgr_cleanup(uint32_t target_entries) {
+    return flash_mgr_log_cleanup(&s_default, target_entries);
+}
+
+esp_err_t flash_mgr_format(void) {
+    return flash_mgr_log_format(&s_default);
+}
+
 // =============================================================================
 // UTILITY FUNCTIONS IMPLEMENTATION - STANDALONE FILE/DIRECTORY OPERATIONS
 // =============================================================================
 
-#include <dirent.h>
-#include <sys/stat.h>
-#include <string.h>
 #include <fnmatch.h>
 
 static const char *UTIL_TAG = "gg_flash_util";
@@ -1052,26 +5651,16 @@ esp_err_t flash_mgr_util_file_checksum(const char* filepath, uint32_t* checksum)
         return ESP_FAIL;
     }
     
-    uint32_t crc = 0xFFFFFFFF;
+    uint32_t crc = 0;
     uint8_t buffer[1024];
     size_t bytes_read;
     
-    // Simple CRC32 calculation
     while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        for (size_t i = 0; i < bytes_read; i++) {
-            crc ^= buffer[i];
-            for (int j = 0; j < 8; j++) {
-                if (crc & 1) {
-                    crc = (crc >> 1) ^ 0xEDB88320;
-                } else {
-                    crc >>= 1;
-                }
-            }
-        }
+        crc = flash_mgr_crc32(crc, buffer, bytes_read);
     }
     
     fclose(file);
-    *checksum = crc ^ 0xFFFFFFFF;
+    *checksum = crc;
     
     return ESP_OK;
 }
@@ -0,0 +1,278 @@
+/**
+* @file gg_flash_mgr_blob.c
+* @brief Payload file implementation
+*/
+
+#include "gg_flash_mgr_blob.h"
+#include "gg_flash_mgr_crc.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "gg_flash_mgr_config.h"
+
+static const char *TAG = FLASH_MGR_LOG_TAG;
+
+/**
+* @brief File header, followed by the records
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t base;              ///< Offset of the first record
+} flash_mgr_blob_header_t;
+
+// Offsets wrap, so positions are always taken relative to base
+static off_t file_pos(const flash_mgr_blobs_t *blobs, uint32_t offset) {
+    return (off_t)sizeof(flash_mgr_blob_header_t) + (off_t)(offset - blobs->base);
+}
+
+static bool write_header(int fd, uint32_t base) {
+    flash_mgr_blob_header_t header = {
+        .magic = FLASH_MGR_BLOB_MAGIC,
+        .base = base
+    };
+    return pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+}
+
+static esp_err_t create(flash_mgr_blobs_t *blobs, const char *path) {
+    blobs->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (blobs->fd < 0) {
+        ESP_LOGE(TAG, "Failed to create blob file %s", path);
+        return ESP_FAIL;
+    }
+
+    if (!write_header(blobs->fd, 0) || fsync(blobs->fd) != 0) {
+        ESP_LOGE(TAG, "Failed to initialize blob file %s", path);
+        close(blobs->fd);
+        blobs->fd = -1;
+        remove(path);
+        return ESP_FAIL;
+    }
+
+    blobs->base = blobs->end = blobs->live = 0;
+    return ESP_OK;
+}
+
+static bool payload_intact(int fd, off_t pos, const flash_mgr_blob_rec_t *rec) {
+    uint8_t *payload = malloc(rec->len ? rec->len : 1);
+    bool intact = payload && pread(fd, payload, rec->len, pos + sizeof(*rec)) == rec->len &&
+                  flash_mgr_crc16(payload, rec->len) == rec->crc;
+    free(payload);
+    return intact;
+}
+
+esp_err_t flash_mgr_blobs_open(flash_mgr_blobs_t *blobs, const char *path, uint32_t head_id, uint32_t end_id) {
+    flash_mgr_blob_header_t header;
+    struct stat st;
+
+    blobs->fd = open(path, O_RDWR);
+    if (blobs->fd < 0) {
+        return create(blobs, path);
+    }
+    if (pread(blobs->fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != FLASH_MGR_BLOB_MAGIC ||
+        fstat(blobs->fd, &st) != 0) {
+        // Entries check the id of the record they point at, so stale offsets read nothing
+        ESP_LOGW(TAG, "Blob file %s is damaged, starting a new one", path);
+        close(blobs->fd);
+        return create(blobs, path);
+    }
+
+    blobs->base = header.base;
+    blobs->end = blobs->live = header.base;
+
+    // Walk the record headers; the first one that overruns the file or belongs to
+    // an entry that never reached flash starts the tail to cut
+    off_t size = st.st_size;
+    off_t last = -1;
+    bool live_found = false;
+    flash_mgr_blob_rec_t rec;
+    flash_mgr_blob_rec_t last_rec;
+    while (file_pos(blobs, blobs->end) + (off_t)sizeof(rec) <= size) {
+        off_t pos = file_pos(blobs, blobs->end);
+        if (pread(blobs->fd, &rec, sizeof(rec), pos) != sizeof(rec) || rec.id >= end_id ||
+            (last >= 0 && rec.id < last_rec.id) || pos + (off_t)sizeof(rec) + rec.len > size) {
+            break;
+        }
+        if (!live_found && rec.id >= head_id) {
+            blobs->live = blobs->end;
+            live_found = true;
+        }
+        last = pos;
+        last_rec = rec;
+        blobs->end += sizeof(rec) + rec.len;
+    }
+
+    // Only the newest record can be torn
+    if (last >= 0 && !payload_intact(blobs->fd, last, &last_rec)) {
+        blobs->end = blobs->base + (uint32_t)(last - (off_t)sizeof(header));
+    }
+    if (!live_found || blobs->live - blobs->base > blobs->end - blobs->base) {
+        blobs->live = blobs->end;
+    }
+
+    if (file_pos(blobs, blobs->end) != size) {
+        ESP_LOGW(TAG, "Cutting %ld bytes of unreferenced or torn blobs", (long)(size - file_pos(blobs, blobs->end)));
+        if (ftruncate(blobs->fd, file_pos(blobs, blobs->end)) != 0) {
+            ESP_LOGE(TAG, "Failed to truncate blob file %s", path);
+            close(blobs->fd);
+            blobs->fd = -1;
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_blobs_append(flash_mgr_blobs_t *blobs, uint32_t first_id, const void *data, size_t len,
+                                 uint32_t count, uint32_t *offset) {
+    if (blobs->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const uint8_t *payload = data;
+    off_t start = file_pos(blobs, blobs->end);
+    off_t pos = start;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < count; i++, payload += len) {
+        flash_mgr_blob_rec_t rec = {
+            .id = first_id + i,
+            .len = (uint16_t)len,
+            .crc = flash_mgr_crc16(payload, len)
+        };
+        ok = pwrite(blobs->fd, &rec, sizeof(rec), pos) == sizeof(rec) &&
+             pwrite(blobs->fd, payload, len, pos + sizeof(rec)) == (ssize_t)len;
+        pos += sizeof(rec) + len;
+    }
+
+    if (!ok || fsync(blobs->fd) != 0) {
+        ftruncate(blobs->fd, start);
+        return ESP_FAIL;
+    }
+
+    *offset = blobs->end;
+    blobs->end += (uint32_t)(pos - start);
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_blobs_truncate(flash_mgr_blobs_t *blobs, uint32_t offset) {
+    if (blobs->fd < 0 || offset - blobs->base > blobs->end - blobs->base) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ftruncate(blobs->fd, file_pos(blobs, offset)) != 0) {
+        return ESP_FAIL;
+    }
+
+    blobs->end = offset;
+    if (blobs->live - blobs->base > offset - blobs->base) {
+        blobs->live = offset;
+    }
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_blobs_read(const flash_mgr_blobs_t *blobs, uint32_t offset, uint32_t id, size_t pos,
+                               void *buffer, size_t size, size_t *bytes_read, size_t *len) {
+    *bytes_read = 0;
+    if (blobs->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Offsets compacted away fall outside [base, end) too
+    flash_mgr_blob_rec_t rec;
+    if (offset - blobs->base >= blobs->end - blobs->base ||
+        pread(blobs->fd, &rec, sizeof(rec), file_pos(blobs, offset)) != sizeof(rec) || rec.id != id) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (len) {
+        *len = rec.len;
+    }
+    if (pos >= rec.len) {
+        return ESP_OK;
+    }
+
+    size_t n = (size < rec.len - pos) ? size : rec.len - pos;
+    if (pread(blobs->fd, buffer, n, file_pos(blobs, offset) + sizeof(rec) + pos) != (ssize_t)n) {
+        return ESP_FAIL;
+    }
+    if (n == rec.len && flash_mgr_crc16(buffer, n) != rec.crc) {
+        ESP_LOGE(TAG, "Blob of entry %u is damaged", id);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    *bytes_read = n;
+    return ESP_OK;
+}
+
+uint32_t flash_mgr_blobs_advance(flash_mgr_blobs_t *blobs, uint32_t head_id) {
+    flash_mgr_blob_rec_t rec;
+    while (blobs->fd >= 0 && blobs->live != blobs->end &&
+           pread(blobs->fd, &rec, sizeof(rec), file_pos(blobs, blobs->live)) == sizeof(rec) && rec.id < head_id) {
+        blobs->live += sizeof(rec) + rec.len;
+    }
+    return blobs->live - blobs->base;
+}
+
+esp_err_t flash_mgr_blobs_copy_live(const flash_mgr_blobs_t *blobs, const char *tmp_path) {
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+
+    uint8_t chunk[256];
+    bool ok = write_header(fd, blobs->live);
+    off_t out = sizeof(flash_mgr_blob_header_t);
+    for (off_t pos = file_pos(blobs, blobs->live); ok && pos < file_pos(blobs, blobs->end); ) {
+        off_t left = file_pos(blobs, blobs->end) - pos;
+        size_t n = (left < (off_t)sizeof(chunk)) ? (size_t)left : sizeof(chunk);
+        ok = pread(blobs->fd, chunk, n, pos) == (ssize_t)n && pwrite(fd, chunk, n, out) == (ssize_t)n;
+        pos += n;
+        out += n;
+    }
+
+    if (ok) {
+        ok = fsync(fd) == 0;
+    }
+    close(fd);
+    if (!ok) {
+        remove(tmp_path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_blobs_swap(flash_mgr_blobs_t *blobs, const char *path, const char *tmp_path) {
+    close(blobs->fd);
+    bool renamed = rename(tmp_path, path) == 0;
+    if (!renamed) {
+        remove(tmp_path);
+    }
+
+    blobs->fd = open(path, O_RDWR);
+    if (blobs->fd < 0) {
+        ESP_LOGE(TAG, "Failed to reopen blob file %s", path);
+        return ESP_FAIL;
+    }
+    if (!renamed) {
+        return ESP_FAIL;
+    }
+
+    blobs->base = blobs->live;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_blobs_reset(flash_mgr_blobs_t *blobs, const char *path) {
+    flash_mgr_blobs_close(blobs);
+    return create(blobs, path);
+}
+
+void flash_mgr_blobs_close(flash_mgr_blobs_t *blobs) {
+    if (blobs->fd >= 0) {
+        close(blobs->fd);
+        blobs->fd = -1;
+    }
+}
@@ -0,0 +1,113 @@
+/**
+* @file gg_flash_mgr_blob.h
+* @brief Payload file behind blob entries (internal)
+*
+* A blob is an ordinary entry in the log (unit FLASH_MGR_UNIT_BLOB) whose
+* value holds the offset of its payload in this append-only file. Fixed
+* entries keep their 16-byte slots in every storage layout, and a blob gets
+* its id, retention and delete behavior from its entry.
+*
+* The file is a header naming the offset of its first byte, then records of a
+* flash_mgr_blob_rec_t and len payload bytes, in id order. Offsets only grow
+* (modulo 2^32), so compaction copies the records still referenced into a new
+* file with a larger base and the entries never change.
+*
+* Payload goes to flash before its entry is staged. After a reset, records
+* whose entry didn't make it (id at or past the end of the log) are cut.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_MGR_BLOB_MAGIC 0x424F4C42 // "BLOB"
+
+/**
+* @brief Record header, followed by the payload
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t id;                ///< Id of the entry referencing the record
+    uint16_t len;               ///< Payload bytes
+    uint16_t crc;               ///< CRC-16 of the payload
+} flash_mgr_blob_rec_t;
+
+/**
+* @brief Payload file state
+*/
+typedef struct {
+    int fd;                     ///< -1 when closed
+    uint32_t base;              ///< Offset of the first record
+    uint32_t end;               ///< Offset past the last record
+    uint32_t live;              ///< Offset of the first record not behind the head
+} flash_mgr_blobs_t;
+
+/**
+* @brief Open the payload file, creating it if missing, and cut records past the log
+*
+* @param head_id Oldest id in the log
+* @param end_id Id past the newest entry on flash
+*/
+esp_err_t flash_mgr_blobs_open(flash_mgr_blobs_t *blobs, const char *path, uint32_t head_id, uint32_t end_id);
+
+/**
+* @brief Append count payloads of len bytes each, for entries first_id on, and sync once
+*
+* @param[out] offset Offset of the first record; record i follows at offset + i * (8 + len)
+*/
+esp_err_t flash_mgr_blobs_append(flash_mgr_blobs_t *blobs, uint32_t first_id, const void *data, size_t len,
+                                 uint32_t count, uint32_t *offset);
+
+/**
+* @brief Drop everything from offset on (undoes an append whose entry wasn't stored)
+*/
+esp_err_t flash_mgr_blobs_truncate(flash_mgr_blobs_t *blobs, uint32_t offset);
+
+/**
+* @brief Read payload bytes [pos, pos + size) of the record at offset
+*
+* The payload check is only verified when one call reads the whole payload.
+*
+* @param id Entry id the record must belong to
+* @param[out] len Payload size, may be NULL
+* @return ESP_ERR_NOT_FOUND if the record doesn't belong to id, ESP_ERR_INVALID_CRC if it is damaged
+*/
+esp_err_t flash_mgr_blobs_read(const flash_mgr_blobs_t *blobs, uint32_t offset, uint32_t id, size_t pos,
+                               void *buffer, size_t size, size_t *bytes_read, size_t *len);
+
+/**
+* @brief Move live past the records of entries before head_id
+*
+* @return Bytes no entry references any more
+*/
+uint32_t flash_mgr_blobs_advance(flash_mgr_blobs_t *blobs, uint32_t head_id);
+
+/**
+* @brief Copy the records from live on into a new file at tmp_path
+*
+* Only reads the current file, so readers may keep using it meanwhile.
+*/
+esp_err_t flash_mgr_blobs_copy_live(const flash_mgr_blobs_t *blobs, const char *tmp_path);
+
+/**
+* @brief Replace the file with the copy made by flash_mgr_blobs_copy_live()
+*/
+esp_err_t flash_mgr_blobs_swap(flash_mgr_blobs_t *blobs, const char *path, const char *tmp_path);
+
+/**
+* @brief Drop every record; offsets start over
+*/
+esp_err_t flash_mgr_blobs_reset(flash_mgr_blobs_t *blobs, const char *path);
+
+void flash_mgr_blobs_close(flash_mgr_blobs_t *blobs);
+
+#ifdef __cplusplus
+}
+#endif
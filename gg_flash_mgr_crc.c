@@ -0,0 +1,66 @@
+/**
+* @file gg_flash_mgr_crc.c
+* @brief Check value implementation
+*/
+
+#include "gg_flash_mgr_crc.h"
+
+#include <stddef.h>
+
+// Nibble table: 32 bytes instead of 512, still two lookups per byte
+static const uint16_t s_crc_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static const uint32_t s_crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+#define CHECKED_BYTES offsetof(flash_mgr_entry_t, reserved)
+
+uint16_t flash_mgr_crc16(const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 4) ^ s_crc_nibble[(crc >> 12) ^ (bytes[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ s_crc_nibble[(crc >> 12) ^ (bytes[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+uint32_t flash_mgr_crc32(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    crc = ~crc;
+
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ s_crc32_nibble[(crc ^ bytes[i]) & 0x0F];
+        crc = (crc >> 4) ^ s_crc32_nibble[(crc ^ (bytes[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+static uint16_t entry_check(const flash_mgr_entry_t *entry) {
+    uint16_t crc = flash_mgr_crc16(entry, CHECKED_BYTES);
+    return crc ? crc : 1; // 0 means "not checked"
+}
+
+void flash_mgr_entry_seal(flash_mgr_entry_t *entry) {
+    uint16_t check = entry_check(entry);
+    entry->reserved[0] = (uint8_t)check;
+    entry->reserved[1] = (uint8_t)(check >> 8);
+}
+
+bool flash_mgr_entry_intact(const flash_mgr_entry_t *entry) {
+    uint16_t stored = (uint16_t)(entry->reserved[0] | (entry->reserved[1] << 8));
+    return stored == 0 || stored == entry_check(entry);
+}
+
+uint32_t flash_mgr_intact_prefix(const flash_mgr_entry_t *entries, uint32_t count) {
+    while (count > 0 && !flash_mgr_entry_intact(&entries[count - 1])) {
+        count--;
+    }
+    return count;
+}
@@ -0,0 +1,53 @@
+/**
+* @file gg_flash_mgr_crc.h
+* @brief Check values for entries and metadata (internal)
+*
+* Every entry is stored with a CRC-16/CCITT of its first 14 bytes in its two
+* reserved bytes, so the log keeps its fixed 16-byte slots: an entry's offset
+* still follows from its id in every storage layout, and the check costs no
+* space. Recovery only verifies the newest entries to cut a torn tail.
+*
+* A check value is never 0, so entries written before checks existed (reserved
+* bytes zero) still load. Erased flash (all 0xFF) never validates.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gg_flash_mgr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief CRC-16/CCITT (poly 0x1021, init 0xFFFF) of len bytes
+*/
+uint16_t flash_mgr_crc16(const void *data, size_t len);
+
+/**
+* @brief CRC-32 (IEEE) of len bytes, chained: start with crc 0, pass the result on
+*/
+uint32_t flash_mgr_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+* @brief Store the entry's check value in its reserved bytes
+*/
+void flash_mgr_entry_seal(flash_mgr_entry_t *entry);
+
+/**
+* @brief Whether the entry's reserved bytes match its contents (or predate checks)
+*/
+bool flash_mgr_entry_intact(const flash_mgr_entry_t *entry);
+
+/**
+* @brief Number of entries left once trailing entries that fail the check are cut
+*/
+uint32_t flash_mgr_intact_prefix(const flash_mgr_entry_t *entries, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
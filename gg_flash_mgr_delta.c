@@ -0,0 +1,167 @@
+/**
+* @file gg_flash_mgr_delta.c
+* @brief Delta/varint block codec implementation
+*/
+
+#include "gg_flash_mgr_delta.h"
+#include "gg_flash_mgr_crc.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define DICT_SIZE 32         // Pairs per block; more distinct pairs are stored literally
+#define LITERAL   0xFF       // Index byte of a pair outside the dictionary
+
+typedef struct {
+    uint8_t type;
+    uint8_t unit;
+    uint32_t last_value;        ///< Previous value of this pair, the base of its next delta
+} dict_slot_t;
+
+static uint32_t zigzag(uint32_t delta) {
+    return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static uint32_t unzigzag(uint32_t code) {
+    return (code >> 1) ^ (0u - (code & 1));
+}
+
+static size_t put_varint(uint8_t *out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static bool get_varint(const uint8_t *in, size_t len, size_t *pos, uint32_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= len) {
+            return false;
+        }
+        uint8_t byte = in[(*pos)++];
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t flash_mgr_delta_encode(const flash_mgr_entry_t *entries, uint32_t count, uint8_t *out) {
+    dict_slot_t dict[DICT_SIZE];
+    uint32_t dict_count = 0;
+    size_t pos = 8;
+
+    uint32_t first_ts = count > 0 ? entries[0].timestamp : 0;
+    memcpy(&out[4], &first_ts, sizeof(first_ts));
+
+    uint32_t prev_ts = first_ts;
+    uint32_t prev_delta = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const flash_mgr_entry_t *entry = &entries[i];
+
+        uint32_t slot = 0;
+        while (slot < dict_count && (dict[slot].type != entry->type || dict[slot].unit != entry->unit)) {
+            slot++;
+        }
+        if (slot == DICT_SIZE) {
+            out[pos++] = LITERAL;
+            out[pos++] = entry->type;
+            out[pos++] = entry->unit;
+        } else {
+            out[pos++] = (uint8_t)slot;
+            if (slot == dict_count) {
+                dict[slot].type = entry->type;
+                dict[slot].unit = entry->unit;
+                dict[slot].last_value = 0;
+                dict_count++;
+                out[pos++] = entry->type;
+                out[pos++] = entry->unit;
+            }
+        }
+
+        uint32_t delta = entry->timestamp - prev_ts;
+        pos += put_varint(&out[pos], zigzag(delta - prev_delta));
+        prev_ts = entry->timestamp;
+        prev_delta = delta;
+
+        // A literal pair's value is a delta against 0
+        uint32_t value = (uint32_t)entry->value_x1000;
+        uint32_t base = (slot < DICT_SIZE) ? dict[slot].last_value : 0;
+        pos += put_varint(&out[pos], zigzag(value - base));
+        if (slot < DICT_SIZE) {
+            dict[slot].last_value = value;
+        }
+    }
+
+    uint32_t crc = flash_mgr_crc32(0, &out[4], pos - 4);
+    memcpy(out, &crc, sizeof(crc));
+    return pos;
+}
+
+esp_err_t flash_mgr_delta_decode(const uint8_t *block, size_t len, uint32_t first_id, uint32_t block_count,
+                                 uint32_t skip, flash_mgr_entry_t *out, uint32_t count) {
+    uint32_t crc;
+    if (len < 8 || skip + count > block_count) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    memcpy(&crc, block, sizeof(crc));
+    if (crc != flash_mgr_crc32(0, &block[4], len - 4)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    dict_slot_t dict[DICT_SIZE];
+    uint32_t dict_count = 0;
+    size_t pos = 8;
+
+    uint32_t prev_ts;
+    memcpy(&prev_ts, &block[4], sizeof(prev_ts));
+    uint32_t prev_delta = 0;
+
+    // Every entry depends on the ones before it, so decoding starts at the block's first
+    for (uint32_t i = 0; i < skip + count; i++) {
+        if (pos >= len) {
+            return ESP_ERR_INVALID_CRC;
+        }
+        uint32_t slot = block[pos++];
+        bool literal = slot == LITERAL;
+        bool new_pair = literal || slot == dict_count;
+        if ((!literal && (slot > dict_count || slot == DICT_SIZE)) || (new_pair && pos + 2 > len)) {
+            return ESP_ERR_INVALID_CRC;
+        }
+        dict_slot_t pair = {0};
+        if (new_pair) {
+            pair.type = block[pos++];
+            pair.unit = block[pos++];
+        }
+        if (new_pair && !literal) {
+            dict[dict_count++] = pair;
+        }
+        dict_slot_t *current = literal ? &pair : &dict[slot];
+
+        uint32_t ts_code;
+        uint32_t value_code;
+        if (!get_varint(block, len, &pos, &ts_code) || !get_varint(block, len, &pos, &value_code)) {
+            return ESP_ERR_INVALID_CRC;
+        }
+        prev_delta += unzigzag(ts_code);
+        prev_ts += prev_delta;
+        current->last_value += unzigzag(value_code);
+
+        if (i >= skip) {
+            flash_mgr_entry_t *entry = &out[i - skip];
+            entry->timestamp = prev_ts;
+            entry->id = first_id + i;
+            entry->type = current->type;
+            entry->unit = current->unit;
+            entry->value_x1000 = (int32_t)current->last_value;
+            flash_mgr_entry_seal(entry);
+        }
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,75 @@
+/**
+* @file gg_flash_mgr_delta.h
+* @brief Delta/varint block codec for sealed segments (internal)
+*
+* A sealed segment file holds a flash_mgr_delta_header_t, a table of
+* blocks + 1 file offsets (start of every block, then the end of the file) and
+* the blocks. A block holds up to FLASH_MGR_DELTA_BLOCK_ENTRIES consecutive
+* entries, so a read seeks to one block and decodes only that:
+*   - CRC-32 of the rest of the block, then the first timestamp raw
+*   - ids are implicit: the block's first id plus the position
+*   - per entry, one byte indexing a dictionary of up to 32 (type, unit) pairs
+*     built up in the block; the index one past the end adds a pair, whose
+*     type and unit bytes follow (0xFF: a pair outside a full dictionary)
+*   - the timestamp as a zigzag varint delta-of-delta
+*   - the value as a zigzag varint delta against the last value of the same
+*     pair (against 0 for 0xFF)
+* Check bytes aren't stored; decoded entries are sealed again.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "gg_flash_mgr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_MGR_DELTA_MAGIC 0x544C4544 // "DELT"
+
+/**
+* @brief Worst case encoded size of a block of n entries
+*
+* Dictionary byte plus a new pair, and two 5 byte varints per entry.
+*/
+#define FLASH_MGR_DELTA_MAX_BLOCK_BYTES(n) (8 + 13 * (size_t)(n))
+
+/**
+* @brief Best case encoded size of an entry: dictionary byte and two 1 byte varints
+*/
+#define FLASH_MGR_DELTA_MIN_ENTRY_BYTES 3
+
+/**
+* @brief Sealed segment file header
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             ///< FLASH_MGR_DELTA_MAGIC
+    uint32_t first_id;          ///< Id of the first entry
+    uint32_t entries;           ///< Entries in the file
+    uint32_t block_entries;     ///< Entries per block, the last one may hold fewer
+} flash_mgr_delta_header_t;
+
+/**
+* @brief Encode one block of consecutive entries
+*
+* @param out At least FLASH_MGR_DELTA_MAX_BLOCK_BYTES(count) bytes
+* @return Bytes written to out
+*/
+size_t flash_mgr_delta_encode(const flash_mgr_entry_t *entries, uint32_t count, uint8_t *out);
+
+/**
+* @brief Decode entries [skip, skip + count) of a block of block_count entries
+*
+* @param first_id Id of the block's first entry
+* @return ESP_OK, or ESP_ERR_INVALID_CRC if the block is damaged
+*/
+esp_err_t flash_mgr_delta_decode(const uint8_t *block, size_t len, uint32_t first_id, uint32_t block_count,
+                                 uint32_t skip, flash_mgr_entry_t *out, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
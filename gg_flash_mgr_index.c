@@ -0,0 +1,129 @@
+/**
+* @file gg_flash_mgr_index.c
+* @brief Sparse block summary file implementation
+*/
+
+#include "gg_flash_mgr_index.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "gg_flash_mgr_config.h"
+
+static const char *TAG = FLASH_MGR_LOG_TAG;
+
+/**
+* @brief File header, followed by the slots
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t block_entries;
+    uint32_t slots;
+    uint32_t record_size;       ///< sizeof(flash_mgr_index_rec_t), a layout change rebuilds the file
+} flash_mgr_index_header_t;
+
+static off_t slot_offset(uint32_t slot) {
+    return (off_t)sizeof(flash_mgr_index_header_t) + (off_t)slot * sizeof(flash_mgr_index_rec_t);
+}
+
+static bool write_empty(flash_mgr_index_t *index) {
+    flash_mgr_index_header_t header = {
+        .magic = FLASH_MGR_INDEX_MAGIC,
+        .block_entries = index->block_entries,
+        .slots = index->slots,
+        .record_size = sizeof(flash_mgr_index_rec_t)
+    };
+    if (pwrite(index->fd, &header, sizeof(header), 0) != sizeof(header)) {
+        return false;
+    }
+
+    // All-0xFF records name block 0xFFFFFFFF, which is never looked up
+    uint8_t blank[256];
+    memset(blank, 0xFF, sizeof(blank));
+    off_t end = slot_offset(index->slots);
+    for (off_t pos = slot_offset(0); pos < end; pos += sizeof(blank)) {
+        size_t len = (end - pos < (off_t)sizeof(blank)) ? (size_t)(end - pos) : sizeof(blank);
+        if (pwrite(index->fd, blank, len, pos) != (ssize_t)len) {
+            return false;
+        }
+    }
+
+    return fsync(index->fd) == 0;
+}
+
+static esp_err_t create(flash_mgr_index_t *index, const char *path) {
+    index->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (index->fd < 0) {
+        ESP_LOGE(TAG, "Failed to create index file %s", path);
+        return ESP_FAIL;
+    }
+
+    if (!write_empty(index)) {
+        ESP_LOGE(TAG, "Failed to initialize index file %s", path);
+        close(index->fd);
+        index->fd = -1;
+        remove(path);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_index_open(flash_mgr_index_t *index, const char *path, uint32_t block_entries,
+                               uint32_t slots, bool *created) {
+    index->block_entries = block_entries;
+    index->slots = slots;
+    *created = false;
+
+    index->fd = open(path, O_RDWR);
+    if (index->fd >= 0) {
+        flash_mgr_index_header_t header;
+        if (pread(index->fd, &header, sizeof(header), 0) == sizeof(header) &&
+            header.magic == FLASH_MGR_INDEX_MAGIC &&
+            header.block_entries == block_entries && header.slots == slots &&
+            header.record_size == sizeof(flash_mgr_index_rec_t)) {
+            return ESP_OK;
+        }
+
+        ESP_LOGW(TAG, "Index file %s doesn't match the configuration, rebuilding", path);
+        close(index->fd);
+    }
+
+    *created = true;
+    return create(index, path);
+}
+
+bool flash_mgr_index_get(const flash_mgr_index_t *index, uint32_t block, flash_mgr_index_rec_t *rec) {
+    if (index->fd < 0) {
+        return false;
+    }
+
+    if (pread(index->fd, rec, sizeof(*rec), slot_offset(block % index->slots)) != sizeof(*rec)) {
+        return false;
+    }
+
+    return rec->block == block;
+}
+
+esp_err_t flash_mgr_index_put(flash_mgr_index_t *index, const flash_mgr_index_rec_t *rec) {
+    if (index->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (pwrite(index->fd, rec, sizeof(*rec), slot_offset(rec->block % index->slots)) != sizeof(*rec) ||
+        fsync(index->fd) != 0) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void flash_mgr_index_close(flash_mgr_index_t *index) {
+    if (index->fd >= 0) {
+        close(index->fd);
+        index->fd = -1;
+    }
+}
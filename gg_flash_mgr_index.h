@@ -0,0 +1,76 @@
+/**
+* @file gg_flash_mgr_index.h
+* @brief Sparse block summary file (internal)
+*
+* The entry log is cut into blocks of block_entries ids (block n holds ids
+* [n * block_entries, (n + 1) * block_entries)). Every closed block gets one
+* fixed-size record in a file of pre-allocated slots, block n in slot
+* n % slots, so the file never grows and records of blocks that dropped off the
+* head are simply overwritten. A record names its block, so a slot that still
+* holds an older lap (or was never written) doesn't validate.
+*
+* Records are read and written with pread/pwrite on one descriptor, so readers
+* on several tasks don't share a file position.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Summary of one block: time range plus a zone map of its contents
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t block;             ///< Block number, validates the slot
+    uint32_t min_ts;            ///< Smallest timestamp in the block
+    uint32_t max_ts;            ///< Largest timestamp in the block
+    uint32_t run_max_ts;        ///< Largest timestamp in this and every earlier block (never decreases)
+    int32_t min_value;          ///< Smallest value_x1000 in the block
+    int32_t max_value;          ///< Largest value_x1000 in the block
+    uint8_t types[32];          ///< Bit t set if the block holds an entry of type t
+    uint8_t units[32];          ///< Bit u set if the block holds an entry of unit u
+} flash_mgr_index_rec_t;
+
+#define FLASH_MGR_INDEX_MAGIC 0x58444E49 // "INDX"
+
+/**
+* @brief Index file state
+*/
+typedef struct {
+    int fd;                     ///< -1 when closed
+    uint32_t block_entries;
+    uint32_t slots;
+} flash_mgr_index_t;
+
+/**
+* @brief Open the index file, (re)creating it if it is missing or was built for another layout
+*
+* @param created[out] Set when every slot starts out empty
+*/
+esp_err_t flash_mgr_index_open(flash_mgr_index_t *index, const char *path, uint32_t block_entries,
+                               uint32_t slots, bool *created);
+
+/**
+* @brief Read the record of a block
+*
+* @return false if the slot doesn't hold this block
+*/
+bool flash_mgr_index_get(const flash_mgr_index_t *index, uint32_t block, flash_mgr_index_rec_t *rec);
+
+/**
+* @brief Store the record of rec->block and sync it
+*/
+esp_err_t flash_mgr_index_put(flash_mgr_index_t *index, const flash_mgr_index_rec_t *rec);
+
+void flash_mgr_index_close(flash_mgr_index_t *index);
+
+#ifdef __cplusplus
+}
+#endif
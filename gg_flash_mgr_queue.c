@@ -0,0 +1,109 @@
+/**
+* @file gg_flash_mgr_queue.c
+* @brief Lock-free multi-producer entry queue implementation
+*/
+
+#include "gg_flash_mgr_queue.h"
+
+#include "esp_err.h"
+#include "esp_attr.h"
+
+esp_err_t flash_mgr_queue_init(flash_mgr_queue_t *queue, flash_mgr_queue_slot_t *slots, uint32_t slot_count) {
+    if (!queue || !slots || slot_count < 2 || (slot_count & (slot_count - 1)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    queue->slots = slots;
+    queue->mask = slot_count - 1;
+    for (uint32_t i = 0; i < slot_count; i++) {
+        atomic_init(&slots[i].seq, i);
+    }
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    atomic_init(&queue->dropped, 0);
+
+    return ESP_OK;
+}
+
+/**
+* @brief Claim a slot and publish the entry (max_attempts == 0: retry until claimed or full)
+*/
+static inline IRAM_ATTR bool queue_push(flash_mgr_queue_t *queue, const flash_mgr_entry_t *entry,
+                                        bool count_drop, uint32_t max_attempts) {
+    unsigned int pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    flash_mgr_queue_slot_t *slot;
+    uint32_t attempts = 0;
+
+    for (;;) {
+        if (max_attempts > 0 && attempts++ == max_attempts) {
+            // Lost the race too often; give up to keep the caller's latency bounded
+            if (count_drop) {
+                atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            }
+            return false;
+        }
+
+        slot = &queue->slots[pos & queue->mask];
+        unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0) {
+            // Slot is free for this lap; claim it (pos is reloaded on failure)
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Consumer hasn't freed this slot from the previous lap: full
+            if (count_drop) {
+                atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            }
+            return false;
+        } else {
+            // Another producer got here first
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->entry = *entry;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+bool flash_mgr_queue_push(flash_mgr_queue_t *queue, const flash_mgr_entry_t *entry, bool count_drop) {
+    return queue_push(queue, entry, count_drop, 0);
+}
+
+bool IRAM_ATTR flash_mgr_queue_push_bounded(flash_mgr_queue_t *queue, const flash_mgr_entry_t *entry,
+                                            uint32_t max_attempts) {
+    return queue_push(queue, entry, true, max_attempts);
+}
+
+uint32_t flash_mgr_queue_pop(flash_mgr_queue_t *queue, flash_mgr_entry_t *entries, uint32_t max) {
+    unsigned int pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    uint32_t count = 0;
+
+    while (count < max) {
+        flash_mgr_queue_slot_t *slot = &queue->slots[pos & queue->mask];
+        unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if ((int32_t)(seq - (pos + 1)) < 0) {
+            // Empty, or claimed by a producer that is still copying
+            break;
+        }
+
+        entries[count++] = slot->entry;
+        // Free the slot for the producer one lap ahead
+        atomic_store_explicit(&slot->seq, pos + queue->mask + 1, memory_order_release);
+        pos++;
+    }
+
+    atomic_store_explicit(&queue->dequeue_pos, pos, memory_order_relaxed);
+    return count;
+}
+
+uint32_t IRAM_ATTR flash_mgr_queue_depth(flash_mgr_queue_t *queue) {
+    unsigned int head = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    return tail - head;
+}
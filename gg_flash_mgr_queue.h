@@ -0,0 +1,81 @@
+/**
+* @file gg_flash_mgr_queue.h
+* @brief Lock-free multi-producer entry queue (internal)
+*
+* Bounded ring of flash_mgr_entry_t where any number of tasks push and a single
+* consumer pops. Every slot carries a sequence number: a producer claims a
+* position with one compare-and-swap on the enqueue index and publishes the
+* slot by storing its sequence, so pushing never blocks or allocates.
+*/
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "gg_flash_mgr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* @brief Queue slot
+*/
+typedef struct {
+    atomic_uint seq;            ///< == position when free, position + 1 once filled
+    flash_mgr_entry_t entry;
+} flash_mgr_queue_slot_t;
+
+/**
+* @brief Queue state
+*/
+typedef struct {
+    flash_mgr_queue_slot_t *slots;
+    uint32_t mask;              ///< Slot count - 1 (slot count is a power of two)
+    atomic_uint enqueue_pos;    ///< Next position a producer claims
+    atomic_uint dequeue_pos;    ///< Next position the consumer reads
+    atomic_uint dropped;        ///< Pushes rejected because the queue was full
+} flash_mgr_queue_t;
+
+/**
+* @brief Set up a queue over caller-provided slots
+*
+* @param slot_count Power of two
+*/
+esp_err_t flash_mgr_queue_init(flash_mgr_queue_t *queue, flash_mgr_queue_slot_t *slots, uint32_t slot_count);
+
+/**
+* @brief Push one entry; safe from any task or core
+*
+* @return false if the queue is full (counted in dropped when count_drop is set)
+*/
+bool flash_mgr_queue_push(flash_mgr_queue_t *queue, const flash_mgr_entry_t *entry, bool count_drop);
+
+/**
+* @brief Push with at most max_attempts claim attempts; safe from ISRs (IRAM)
+*
+* Contention with other producers can't stretch the call: after max_attempts
+* lost races the entry is dropped like on a full queue.
+*
+* @return false if the entry was dropped (always counted in dropped)
+*/
+bool flash_mgr_queue_push_bounded(flash_mgr_queue_t *queue, const flash_mgr_entry_t *entry,
+                                  uint32_t max_attempts);
+
+/**
+* @brief Pop up to max entries, oldest first (single consumer only)
+*
+* Stops early at a slot a producer has claimed but not filled yet.
+*
+* @return Number of entries popped
+*/
+uint32_t flash_mgr_queue_pop(flash_mgr_queue_t *queue, flash_mgr_entry_t *entries, uint32_t max);
+
+/**
+* @brief Entries currently queued (approximate while producers are active)
+*/
+uint32_t flash_mgr_queue_depth(flash_mgr_queue_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,539 @@
+/**
+* @file gg_flash_mgr_raw.c
+* @brief Raw flash entry log implementation
+*/
+
+#include "gg_flash_mgr_raw.h"
+#include "gg_flash_mgr_config.h"
+#include "gg_flash_mgr_crc.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+static const char *TAG = FLASH_MGR_LOG_TAG;
+
+#define SLOTS FLASH_MGR_RAW_SLOTS_PER_SECTOR
+
+// =============================================================================
+// INTERNAL HELPERS
+// =============================================================================
+
+static uint32_t header_crc(const flash_mgr_raw_sector_header_t *header) {
+    const uint8_t *data = (const uint8_t *)header;
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < offsetof(flash_mgr_raw_sector_header_t, crc); i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            if (crc & 1) {
+                crc = (crc >> 1) ^ 0xEDB88320;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+static uint32_t sector_addr(const flash_mgr_raw_log_t *log, uint32_t sector) {
+    return log->base + sector * FLASH_MGR_RAW_SECTOR_SIZE;
+}
+
+static uint32_t slot_addr(const flash_mgr_raw_log_t *log, uint32_t sector, uint32_t slot) {
+    return sector_addr(log, sector) + sizeof(flash_mgr_raw_sector_header_t) + slot * sizeof(flash_mgr_entry_t);
+}
+
+/**
+* @brief Read a sector header; returns false if it's erased, retired or torn
+*/
+static bool read_header(flash_mgr_raw_log_t *log, uint32_t sector, flash_mgr_raw_sector_header_t *header) {
+    if (log->io.read(log->io.ctx, sector_addr(log, sector), header, sizeof(*header)) != ESP_OK) {
+        return false;
+    }
+    return header->magic == FLASH_MGR_RAW_SECTOR_MAGIC && header->crc == header_crc(header);
+}
+
+static bool slot_erased(flash_mgr_raw_log_t *log, uint32_t sector, uint32_t slot) {
+    uint8_t raw[sizeof(flash_mgr_entry_t)];
+    if (log->io.read(log->io.ctx, slot_addr(log, sector, slot), raw, sizeof(raw)) != ESP_OK) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        if (raw[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* @brief Find the sector holding id, along with the ids it covers
+*
+* Sectors from head to tail have increasing first_id, so this is a binary
+* search over their headers.
+*/
+static esp_err_t locate(flash_mgr_raw_log_t *log, uint32_t id, uint32_t *sector,
+                        uint32_t *sector_first, uint32_t *sector_end) {
+    if (log->empty || id < log->first_id || id >= log->end_id) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    flash_mgr_raw_sector_header_t header;
+    uint32_t used = (log->tail_sector + log->sector_count - log->head_sector) % log->sector_count + 1;
+    uint32_t lo = 0;
+    uint32_t hi = used - 1;
+    uint32_t lo_first = log->first_id;
+
+    // Invariant: first_id of logical sector lo <= id
+    if (id >= log->tail_first_id) {
+        lo = hi;
+        lo_first = log->tail_first_id;
+    }
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        uint32_t phys = (log->head_sector + mid) % log->sector_count;
+        if (!read_header(log, phys, &header)) {
+            return ESP_FAIL;
+        }
+        if (header.first_id <= id) {
+            lo = mid;
+            lo_first = header.first_id;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    *sector = (log->head_sector + lo) % log->sector_count;
+    *sector_first = lo_first;
+
+    // A sector ends where the next one starts (sectors can be closed early)
+    if (*sector == log->tail_sector) {
+        *sector_end = log->end_id;
+    } else {
+        uint32_t next = (*sector + 1) % log->sector_count;
+        if (!read_header(log, next, &header)) {
+            return ESP_FAIL;
+        }
+        *sector_end = header.first_id;
+    }
+    if (*sector_end - *sector_first > SLOTS) {
+        *sector_end = *sector_first + SLOTS;
+    }
+
+    return ESP_OK;
+}
+
+/**
+* @brief Erase the sector after the tail and make it the new tail
+*
+* If that sector is the head, its entries are overwritten and the head moves on.
+*/
+static esp_err_t open_sector(flash_mgr_raw_log_t *log, uint32_t first_id) {
+    uint32_t next = (log->tail_sector + 1) % log->sector_count;
+
+    if (!log->empty && next == log->head_sector) {
+        flash_mgr_raw_sector_header_t head;
+        log->head_sector = (log->head_sector + 1) % log->sector_count;
+        if (log->head_sector == next || !read_header(log, log->head_sector, &head)) {
+            return ESP_FAIL;
+        }
+        log->first_id = head.first_id;
+    }
+
+    esp_err_t ret = log->io.erase(log->io.ctx, sector_addr(log, next), FLASH_MGR_RAW_SECTOR_SIZE);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Raw log: erase of sector %u failed: %s", next, esp_err_to_name(ret));
+        return ret;
+    }
+
+    flash_mgr_raw_sector_header_t header = {
+        .magic = FLASH_MGR_RAW_SECTOR_MAGIC,
+        .seq = log->tail_seq + 1,
+        .first_id = first_id,
+        .crc = 0
+    };
+    header.crc = header_crc(&header);
+
+    ret = log->io.write(log->io.ctx, sector_addr(log, next), &header, sizeof(header));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Raw log: header write to sector %u failed: %s", next, esp_err_to_name(ret));
+        return ret;
+    }
+
+    if (log->empty) {
+        log->head_sector = next;
+        log->first_id = first_id;
+        log->empty = false;
+    }
+    log->tail_sector = next;
+    log->tail_seq = header.seq;
+    log->tail_first_id = first_id;
+    log->tail_closed = false;
+    log->end_id = first_id;
+
+    return ESP_OK;
+}
+
+// =============================================================================
+// RAW LOG API
+// =============================================================================
+
+esp_err_t flash_mgr_raw_log_init(flash_mgr_raw_log_t *log, const flash_mgr_raw_io_t *io,
+                                 uint32_t base, uint32_t size) {
+    if (!log || !io || !io->read || !io->write || !io->erase) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (base % FLASH_MGR_RAW_SECTOR_SIZE != 0 || size < 2 * FLASH_MGR_RAW_SECTOR_SIZE) {
+        ESP_LOGE(TAG, "Raw log region 0x%x+%u must be sector aligned and at least 2 sectors", base, size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(log, 0, sizeof(*log));
+    log->io = *io;
+    log->base = base;
+    log->sector_count = size / FLASH_MGR_RAW_SECTOR_SIZE;
+    log->empty = true;
+    // The first sector opened is sector 0 with seq 0
+    log->tail_sector = log->sector_count - 1;
+    log->tail_seq = UINT32_MAX;
+
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_raw_log_recover(flash_mgr_raw_log_t *log, uint32_t *first_id, uint32_t *end_id) {
+    flash_mgr_raw_sector_header_t header;
+    bool found = false;
+    uint32_t tail = 0;
+    uint32_t tail_seq = 0;
+    uint32_t tail_first = 0;
+
+    log->empty = true;
+    log->tail_closed = false;
+    *first_id = *end_id = 0;
+
+    // The tail is the valid sector with the highest seq
+    for (uint32_t sector = 0; sector < log->sector_count; sector++) {
+        if (read_header(log, sector, &header) && (!found || header.seq > tail_seq)) {
+            found = true;
+            tail = sector;
+            tail_seq = header.seq;
+            tail_first = header.first_id;
+        }
+    }
+
+    if (!found) {
+        return ESP_OK;
+    }
+
+    // Walk back while the seq chain is unbroken to find the head
+    uint32_t head = tail;
+    uint32_t head_first = tail_first;
+    for (uint32_t k = 1; k < log->sector_count; k++) {
+        uint32_t prev = (tail + log->sector_count - k) % log->sector_count;
+        if (!read_header(log, prev, &header) || header.seq != tail_seq - k || header.first_id >= head_first) {
+            break;
+        }
+        head = prev;
+        head_first = header.first_id;
+    }
+
+    // Written slots are a prefix of the sector, so the first erased slot is the tail
+    uint32_t lo = 0;
+    uint32_t hi = SLOTS;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (slot_erased(log, tail, mid)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    uint32_t count = lo;
+
+    // Only the last programmed slot can be torn
+    if (count > 0) {
+        flash_mgr_entry_t last;
+        esp_err_t ret = log->io.read(log->io.ctx, slot_addr(log, tail, count - 1), &last, sizeof(last));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        if (last.id != tail_first + count - 1 || !flash_mgr_entry_intact(&last)) {
+            ESP_LOGW(TAG, "Raw log: dropping torn entry in sector %u slot %u", tail, count - 1);
+            count--;
+            log->tail_closed = true;
+        }
+    }
+
+    log->empty = false;
+    log->head_sector = head;
+    log->tail_sector = tail;
+    log->tail_seq = tail_seq;
+    log->tail_first_id = tail_first;
+    log->first_id = head_first;
+    log->end_id = tail_first + count;
+
+    *first_id = log->first_id;
+    *end_id = log->end_id;
+
+    ESP_LOGI(TAG, "Raw log: sectors %u-%u, ids %u-%u", head, tail, *first_id, *end_id);
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_raw_log_append(flash_mgr_raw_log_t *log, const flash_mgr_entry_t *entries,
+                                   uint32_t count, uint32_t *written) {
+    *written = 0;
+
+    while (*written < count) {
+        uint32_t id = entries[*written].id;
+
+        // New sector when the tail is full or closed, or the ids don't continue it
+        if (log->empty || log->tail_closed || id != log->end_id || log->end_id - log->tail_first_id >= SLOTS) {
+            esp_err_t ret = open_sector(log, id);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+
+        uint32_t slot = log->end_id - log->tail_first_id;
+        uint32_t room = SLOTS - slot;
+        uint32_t batch = (count - *written < room) ? (count - *written) : room;
+
+        esp_err_t ret = log->io.write(log->io.ctx, slot_addr(log, log->tail_sector, slot),
+                                      &entries[*written], batch * sizeof(flash_mgr_entry_t));
+        if (ret != ESP_OK) {
+            // Unknown how much got programmed, so don't append behind it
+            ESP_LOGE(TAG, "Raw log: write to sector %u failed: %s", log->tail_sector, esp_err_to_name(ret));
+            log->tail_closed = true;
+            return ret;
+        }
+
+        log->end_id += batch;
+        *written += batch;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_raw_log_read(flash_mgr_raw_log_t *log, uint32_t id, flash_mgr_entry_t *buffer,
+                                 uint32_t count, uint32_t *entries_read) {
+    *entries_read = 0;
+
+    while (*entries_read < count && id < log->end_id) {
+        uint32_t sector, sector_first, sector_end;
+        esp_err_t ret = locate(log, id, &sector, &sector_first, &sector_end);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        uint32_t avail = sector_end - id;
+        uint32_t batch = (count - *entries_read < avail) ? (count - *entries_read) : avail;
+
+        ret = log->io.read(log->io.ctx, slot_addr(log, sector, id - sector_first),
+                           &buffer[*entries_read], batch * sizeof(flash_mgr_entry_t));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        *entries_read += batch;
+        id += batch;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_raw_log_truncate(flash_mgr_raw_log_t *log, uint32_t end_id) {
+    const uint32_t retired = 0;
+
+    if (log->empty || end_id >= log->end_id) {
+        return ESP_OK;
+    }
+
+    // Ids programmed in the sector that ends up as the tail
+    uint32_t tail_end = log->end_id;
+
+    // Retire sectors that only hold cut entries so first_id keeps increasing head to tail
+    while (log->tail_first_id >= end_id) {
+        esp_err_t ret = log->io.write(log->io.ctx, sector_addr(log, log->tail_sector), &retired, sizeof(retired));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        bool was_head = log->tail_sector == log->head_sector;
+        tail_end = log->tail_first_id;
+        log->tail_sector = (log->tail_sector + log->sector_count - 1) % log->sector_count;
+        log->tail_seq--;
+
+        if (was_head) {
+            // The next sector opened is the one just retired
+            log->empty = true;
+            log->tail_closed = false;
+            log->first_id = log->end_id = 0;
+            return ESP_OK;
+        }
+
+        flash_mgr_raw_sector_header_t header;
+        if (!read_header(log, log->tail_sector, &header)) {
+            return ESP_FAIL;
+        }
+        log->tail_first_id = header.first_id;
+    }
+
+    if (tail_end > end_id) {
+        // Recovery would count the cut entries back in, unless a newer sector starts at end_id
+        log->end_id = tail_end;
+        log->tail_closed = true;
+        return open_sector(log, end_id);
+    }
+
+    log->end_id = end_id;
+    log->tail_closed = true;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_raw_log_erase(flash_mgr_raw_log_t *log) {
+    flash_mgr_raw_sector_header_t header;
+    const uint32_t retired = 0;
+
+    // Programming the magic to zero needs no erase; sectors are erased when reused
+    for (uint32_t sector = 0; sector < log->sector_count; sector++) {
+        if (!read_header(log, sector, &header)) {
+            continue;
+        }
+        esp_err_t ret = log->io.write(log->io.ctx, sector_addr(log, sector), &retired, sizeof(retired));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    // Keep tail_sector/tail_seq so the next sector opened continues the wear rotation
+    log->empty = true;
+    log->tail_closed = false;
+    log->first_id = log->end_id = 0;
+    return ESP_OK;
+}
+
+uint32_t flash_mgr_raw_log_capacity(const flash_mgr_raw_log_t *log) {
+    return (log->sector_count - 1) * SLOTS;
+}
+
+// =============================================================================
+// FILE-BACKED FLASH
+// =============================================================================
+
+static esp_err_t file_seek(flash_mgr_raw_file_t *image, uint32_t addr, uint32_t len) {
+    if (addr > image->size || len > image->size - addr) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return fseek(image->file, (long)addr, SEEK_SET) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_read(void *ctx, uint32_t addr, void *buffer, uint32_t len) {
+    flash_mgr_raw_file_t *image = ctx;
+    esp_err_t ret = file_seek(image, addr, len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return fread(buffer, 1, len, image->file) == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_write(void *ctx, uint32_t addr, const void *data, uint32_t len) {
+    flash_mgr_raw_file_t *image = ctx;
+    const uint8_t *src = data;
+    uint8_t chunk[256];
+
+    // Programming only clears bits
+    while (len > 0) {
+        uint32_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        esp_err_t ret = file_read(image, addr, chunk, n);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            chunk[i] &= src[i];
+        }
+        if (file_seek(image, addr, n) != ESP_OK || fwrite(chunk, 1, n, image->file) != n) {
+            return ESP_FAIL;
+        }
+        addr += n;
+        src += n;
+        len -= n;
+    }
+
+    return fflush(image->file) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_fill(flash_mgr_raw_file_t *image, uint32_t addr, uint32_t len) {
+    uint8_t erased[256];
+    memset(erased, 0xFF, sizeof(erased));
+
+    esp_err_t ret = file_seek(image, addr, len);
+    while (ret == ESP_OK && len > 0) {
+        uint32_t n = len < sizeof(erased) ? len : sizeof(erased);
+        if (fwrite(erased, 1, n, image->file) != n) {
+            ret = ESP_FAIL;
+        }
+        len -= n;
+    }
+
+    if (ret == ESP_OK && fflush(image->file) != 0) {
+        ret = ESP_FAIL;
+    }
+    return ret;
+}
+
+static esp_err_t file_erase(void *ctx, uint32_t addr, uint32_t len) {
+    if (addr % FLASH_MGR_RAW_SECTOR_SIZE != 0 || len % FLASH_MGR_RAW_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return file_fill(ctx, addr, len);
+}
+
+esp_err_t flash_mgr_raw_file_open(flash_mgr_raw_file_t *image, const char *path, uint32_t size,
+                                  flash_mgr_raw_io_t *io) {
+    if (!image || !path || !io || size == 0 || size % FLASH_MGR_RAW_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    image->size = size;
+    image->file = fopen(path, "r+b");
+    if (!image->file) {
+        image->file = fopen(path, "w+b");
+    }
+    if (!image->file) {
+        ESP_LOGE(TAG, "Failed to open flash image %s", path);
+        return ESP_FAIL;
+    }
+
+    // A new or short image is topped up with erased sectors
+    long end = -1;
+    if (fseek(image->file, 0, SEEK_END) == 0) {
+        end = ftell(image->file);
+    }
+    esp_err_t ret = end >= 0 ? ESP_OK : ESP_FAIL;
+    if (ret == ESP_OK && (uint32_t)end < size) {
+        ret = file_fill(image, (uint32_t)end, size - (uint32_t)end);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to size flash image %s", path);
+        flash_mgr_raw_file_close(image);
+        return ret;
+    }
+
+    io->ctx = image;
+    io->read = file_read;
+    io->write = file_write;
+    io->erase = file_erase;
+    return ESP_OK;
+}
+
+void flash_mgr_raw_file_close(flash_mgr_raw_file_t *image) {
+    if (image && image->file) {
+        fclose(image->file);
+        image->file = NULL;
+    }
+}
@@ -0,0 +1,153 @@
+/**
+* @file gg_flash_mgr_raw.h
+* @brief Raw flash entry log (internal)
+*
+* Stores flash_mgr_entry_t records straight into a sector-aligned flash region,
+* without a filesystem. Flash access goes through flash_mgr_raw_io_t so the log
+* can run on esp_flash or on a file-backed image on a host
+* (flash_mgr_raw_file_open()).
+*
+* Region layout: a ring of 4 KB sectors, each starting with a
+* flash_mgr_raw_sector_header_t followed by entry slots. Sectors are filled in
+* order; the newest sector (highest seq) is the tail and its first erased
+* (all 0xFF) slot is the append position.
+*/
+
+#pragma once
+
+#include "gg_flash_mgr.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_MGR_RAW_SECTOR_SIZE 4096
+
+/**
+* @brief Flash access used by the raw log
+*
+* Semantics follow NOR flash: erase sets a sector to 0xFF, write can only
+* clear bits.
+*/
+typedef struct {
+    void *ctx;
+    esp_err_t (*read)(void *ctx, uint32_t addr, void *buffer, uint32_t len);
+    esp_err_t (*write)(void *ctx, uint32_t addr, const void *data, uint32_t len);
+    esp_err_t (*erase)(void *ctx, uint32_t addr, uint32_t len);
+} flash_mgr_raw_io_t;
+
+/**
+* @brief Header at the start of every used sector
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             ///< FLASH_MGR_RAW_SECTOR_MAGIC, zeroed to retire a sector
+    uint32_t seq;               ///< Sector sequence number, +1 for every sector opened
+    uint32_t first_id;          ///< Id of the first entry in this sector
+    uint32_t crc;               ///< CRC32 of the fields above
+} flash_mgr_raw_sector_header_t;
+
+#define FLASH_MGR_RAW_SECTOR_MAGIC 0x57415253 // "SRAW"
+#define FLASH_MGR_RAW_SLOTS_PER_SECTOR \
+    ((FLASH_MGR_RAW_SECTOR_SIZE - sizeof(flash_mgr_raw_sector_header_t)) / sizeof(flash_mgr_entry_t))
+
+/**
+* @brief Raw log state
+*/
+typedef struct {
+    flash_mgr_raw_io_t io;
+    uint32_t base;              ///< Region start address (sector aligned)
+    uint32_t sector_count;      ///< Sectors in the region
+
+    bool empty;                 ///< No valid sector on flash
+    uint32_t head_sector;       ///< Oldest valid sector
+    uint32_t tail_sector;       ///< Newest sector, appends go here
+    uint32_t tail_seq;          ///< seq of the tail sector
+    uint32_t tail_first_id;     ///< first_id of the tail sector
+    bool tail_closed;           ///< Tail can't take more entries (torn slot), open a new sector next
+    uint32_t first_id;          ///< First id still on flash
+    uint32_t end_id;            ///< One past the last id on flash
+} flash_mgr_raw_log_t;
+
+/**
+* @brief Set up a raw log over [base, base + size); nothing is read yet
+*/
+esp_err_t flash_mgr_raw_log_init(flash_mgr_raw_log_t *log, const flash_mgr_raw_io_t *io,
+                                 uint32_t base, uint32_t size);
+
+/**
+* @brief Find head and tail from the sector headers
+*
+* Reads one header per sector plus a binary search in the tail sector. A torn
+* last slot is dropped and its sector closed.
+*
+* @param first_id[out] First id on flash
+* @param end_id[out] One past the last id on flash (== first_id when empty)
+*/
+esp_err_t flash_mgr_raw_log_recover(flash_mgr_raw_log_t *log, uint32_t *first_id, uint32_t *end_id);
+
+/**
+* @brief Append entries; opening a sector may erase the oldest one
+*
+* @param written[out] Entries written, also on failure
+*/
+esp_err_t flash_mgr_raw_log_append(flash_mgr_raw_log_t *log, const flash_mgr_entry_t *entries,
+                                   uint32_t count, uint32_t *written);
+
+/**
+* @brief Read count entries starting at id
+*
+* @param entries_read[out] Entries read, short at the end of the log
+*/
+esp_err_t flash_mgr_raw_log_read(flash_mgr_raw_log_t *log, uint32_t id, flash_mgr_entry_t *buffer,
+                                 uint32_t count, uint32_t *entries_read);
+
+/**
+* @brief Forget entries from end_id on, after a failed multi-entry append
+*
+* Sectors holding only cut entries are retired. Cut entries sharing the tail
+* sector with kept ones stay programmed, so a new sector starting at end_id is
+* opened right away; it takes precedence for the ids it shares with the old
+* one, also after a reset.
+*/
+esp_err_t flash_mgr_raw_log_truncate(flash_mgr_raw_log_t *log, uint32_t end_id);
+
+/**
+* @brief Retire every sector by zeroing its magic (no erase)
+*/
+esp_err_t flash_mgr_raw_log_erase(flash_mgr_raw_log_t *log);
+
+/**
+* @brief Entries the region can hold while one sector is being recycled
+*/
+uint32_t flash_mgr_raw_log_capacity(const flash_mgr_raw_log_t *log);
+
+/**
+* @brief NOR flash emulated in a file
+*/
+typedef struct {
+    FILE *file;
+    uint32_t size;              ///< Image size in bytes
+} flash_mgr_raw_file_t;
+
+/**
+* @brief Open a flash image file, creating it erased, and point io at it
+*
+* Writes AND into the image like programming NOR flash, so writing over
+* unerased bytes gives what the chip would. For host tests and for building
+* or inspecting images.
+*
+* @param size Image size, a multiple of FLASH_MGR_RAW_SECTOR_SIZE
+*/
+esp_err_t flash_mgr_raw_file_open(flash_mgr_raw_file_t *image, const char *path, uint32_t size,
+                                  flash_mgr_raw_io_t *io);
+
+/**
+* @brief Close a flash image file
+*/
+void flash_mgr_raw_file_close(flash_mgr_raw_file_t *image);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,240 @@
+/**
+* @file gg_flash_mgr_record.c
+* @brief Fixed-size record file implementation
+*/
+
+#include "gg_flash_mgr_record.h"
+#include "gg_flash_mgr.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "gg_flash_mgr_config.h"
+
+static const char *TAG = FLASH_MGR_LOG_TAG;
+
+/**
+* @brief File header, followed by the slots
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t record_size;       ///< Record bytes in a slot, without header and padding
+    uint32_t slots;
+    uint32_t reserved;
+} flash_mgr_record_file_header_t;
+
+static off_t slot_pos(const flash_mgr_record_file_t *file, uint32_t id) {
+    return (off_t)sizeof(flash_mgr_record_file_header_t) + (off_t)(id % file->slots) * file->stride;
+}
+
+/**
+* @brief Id stored in a slot; UINT32_MAX for a never written or unreadable one
+*/
+static uint32_t slot_id(const flash_mgr_record_file_t *file, uint32_t slot) {
+    uint32_t id;
+    off_t pos = (off_t)sizeof(flash_mgr_record_file_header_t) + (off_t)slot * file->stride;
+    if (pread(file->fd, &id, sizeof(id), pos) != sizeof(id)) {
+        return UINT32_MAX;
+    }
+    return id;
+}
+
+/**
+* @brief Create the file and pre-allocate every slot erased, so LittleFS never grows it again
+*/
+static esp_err_t create(flash_mgr_record_file_t *file, const char *path, uint32_t record_size) {
+    file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file->fd < 0) {
+        ESP_LOGE(TAG, "Failed to create record file %s", path);
+        return ESP_FAIL;
+    }
+
+    flash_mgr_record_file_header_t header = {
+        .magic = FLASH_MGR_RECORD_MAGIC,
+        .record_size = record_size,
+        .slots = file->slots,
+        .reserved = 0
+    };
+    bool ok = pwrite(file->fd, &header, sizeof(header), 0) == sizeof(header);
+
+    uint8_t erased[256];
+    memset(erased, 0xFF, sizeof(erased));
+    off_t pos = sizeof(header);
+    off_t end = pos + (off_t)file->slots * file->stride;
+    while (ok && pos < end) {
+        size_t n = (end - pos < (off_t)sizeof(erased)) ? (size_t)(end - pos) : sizeof(erased);
+        ok = pwrite(file->fd, erased, n, pos) == (ssize_t)n;
+        pos += n;
+    }
+
+    if (!ok || fsync(file->fd) != 0) {
+        ESP_LOGE(TAG, "Failed to pre-allocate record file %s", path);
+        close(file->fd);
+        file->fd = -1;
+        remove(path);
+        return ESP_FAIL;
+    }
+
+    file->first_id = file->end_id = 0;
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_record_file_open(flash_mgr_record_file_t *file, const char *path, uint32_t record_size,
+                                     uint32_t slots) {
+    flash_mgr_record_file_header_t header;
+
+    file->stride = FLASH_MGR_RECORD_STRIDE(record_size);
+    file->slots = slots;
+    file->fd = open(path, O_RDWR);
+    if (file->fd < 0) {
+        return create(file, path, record_size);
+    }
+    if (pread(file->fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != FLASH_MGR_RECORD_MAGIC ||
+        header.slots == 0) {
+        ESP_LOGW(TAG, "Record file %s is damaged, starting a new one", path);
+        close(file->fd);
+        return create(file, path, record_size);
+    }
+
+    if (header.record_size != record_size) {
+        ESP_LOGE(TAG, "Record file %s holds %u byte records, not %u", path, header.record_size, record_size);
+        close(file->fd);
+        file->fd = -1;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (header.slots != slots) {
+        // Keep existing records readable; a new size takes effect after a reset
+        ESP_LOGW(TAG, "Record file %s has %u slots, asked for %u - keeping %u", path, header.slots, slots,
+                 header.slots);
+        file->slots = header.slots;
+    }
+
+    // Slot 0 holds a multiple of slots on every lap
+    uint32_t lap_base = slot_id(file, 0);
+    if (lap_base == UINT32_MAX || lap_base % file->slots != 0) {
+        file->first_id = file->end_id = 0;
+        return ESP_OK; // Nothing written yet
+    }
+
+    // Slots [0, tail) belong to slot 0's lap; binary search for the first one that doesn't
+    uint32_t lo = 1;
+    uint32_t hi = file->slots;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (slot_id(file, mid) == lap_base + mid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    file->end_id = lap_base + lo;
+
+    // Everything after the tail is either the previous lap or never written (there is none on the first lap)
+    if (lo < file->slots && file->end_id >= file->slots && slot_id(file, lo) == file->end_id - file->slots) {
+        file->first_id = file->end_id - file->slots;
+    } else {
+        file->first_id = lap_base;
+    }
+
+    ESP_LOGI(TAG, "Record file %s: ids %u-%u", path, file->first_id, file->end_id);
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_record_file_write(flash_mgr_record_file_t *file, const void *data, uint32_t count) {
+    if (file->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const uint8_t *src = data;
+    while (count > 0) {
+        // Contiguous run up to the end of the ring, then wrap to slot 0
+        uint32_t room = file->slots - file->end_id % file->slots;
+        uint32_t batch = (count < room) ? count : room;
+        size_t len = (size_t)batch * file->stride;
+
+        if (pwrite(file->fd, src, len, slot_pos(file, file->end_id)) != (ssize_t)len) {
+            // Slots only ever hold the id they belong to, so a partial run reads as the old lap
+            return ESP_FAIL;
+        }
+
+        file->end_id += batch;
+        if (file->end_id - file->first_id > file->slots) {
+            file->first_id = file->end_id - file->slots;
+        }
+        src += len;
+        count -= batch;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_record_file_read(const flash_mgr_record_file_t *file, uint32_t id, void *buffer,
+                                     uint32_t count, uint32_t *records_read) {
+    *records_read = 0;
+    if (file->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (id - file->first_id > file->end_id - file->first_id) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (count > file->end_id - id) {
+        count = file->end_id - id;
+    }
+
+    uint8_t *dst = buffer;
+    while (*records_read < count) {
+        uint32_t room = file->slots - id % file->slots;
+        uint32_t batch = (count - *records_read < room) ? (count - *records_read) : room;
+        size_t len = (size_t)batch * file->stride;
+
+        if (pread(file->fd, dst, len, slot_pos(file, id)) != (ssize_t)len) {
+            return ESP_FAIL;
+        }
+
+        // A slot not holding the requested id was hit by a failed write
+        uint32_t valid = 0;
+        while (valid < batch) {
+            flash_mgr_record_header_t header;
+            memcpy(&header, dst + (size_t)valid * file->stride, sizeof(header));
+            if (header.id != id + valid) {
+                break;
+            }
+            valid++;
+        }
+        *records_read += valid;
+        if (valid != batch) {
+            break;
+        }
+        id += batch;
+        dst += len;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t flash_mgr_record_file_sync(flash_mgr_record_file_t *file) {
+    if (file->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return fsync(file->fd) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t flash_mgr_record_file_reset(flash_mgr_record_file_t *file, const char *path, uint32_t record_size,
+                                      uint32_t slots) {
+    flash_mgr_record_file_close(file);
+    file->stride = FLASH_MGR_RECORD_STRIDE(record_size);
+    file->slots = slots;
+    return create(file, path, record_size);
+}
+
+void flash_mgr_record_file_close(flash_mgr_record_file_t *file) {
+    if (file->fd >= 0) {
+        fsync(file->fd);
+        close(file->fd);
+        file->fd = -1;
+    }
+}
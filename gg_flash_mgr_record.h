@@ -0,0 +1,76 @@
+/**
+* @file gg_flash_mgr_record.h
+* @brief Fixed-size record files (internal)
+*
+* A record file keeps the records of one schema, all of the same size, in a
+* ring of pre-allocated slots like the RING layout: slot n holds ids n,
+* n + slots, n + 2 * slots, ... so the place of a record follows from its id
+* and appending one is a single write. Each slot is a
+* flash_mgr_record_header_t and the record, padded to FLASH_MGR_RECORD_STRIDE.
+*
+* The file starts with a header naming the record size and slot count. The
+* tail is found where the id sequence breaks; never written slots are 0xFF.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_MGR_RECORD_MAGIC 0x44434552 // "RECD"
+
+/**
+* @brief Record file state
+*/
+typedef struct {
+    int fd;                     ///< -1 when closed
+    uint32_t stride;            ///< Bytes per slot
+    uint32_t slots;             ///< Slots in the ring
+    uint32_t first_id;          ///< Oldest id still in the ring
+    uint32_t end_id;            ///< Id the next record gets
+} flash_mgr_record_file_t;
+
+/**
+* @brief Open a record file, creating it if missing, and find its tail
+*
+* An existing file keeps its slot count; a new one takes effect once the file
+* is reset.
+*
+* @return ESP_ERR_INVALID_SIZE if the file holds records of another size
+*/
+esp_err_t flash_mgr_record_file_open(flash_mgr_record_file_t *file, const char *path, uint32_t record_size,
+                                     uint32_t slots);
+
+/**
+* @brief Write count slots, filled in for ids end_id on; one write per lap
+*/
+esp_err_t flash_mgr_record_file_write(flash_mgr_record_file_t *file, const void *data, uint32_t count);
+
+/**
+* @brief Read up to count slots starting at id, short at the end of the ring
+*
+* @return ESP_ERR_NOT_FOUND if id was overwritten
+*/
+esp_err_t flash_mgr_record_file_read(const flash_mgr_record_file_t *file, uint32_t id, void *buffer,
+                                     uint32_t count, uint32_t *records_read);
+
+esp_err_t flash_mgr_record_file_sync(flash_mgr_record_file_t *file);
+
+/**
+* @brief Re-create the file empty with this geometry; ids start over at 0
+*/
+esp_err_t flash_mgr_record_file_reset(flash_mgr_record_file_t *file, const char *path, uint32_t record_size,
+                                      uint32_t slots);
+
+void flash_mgr_record_file_close(flash_mgr_record_file_t *file);
+
+#ifdef __cplusplus
+}
+#endif
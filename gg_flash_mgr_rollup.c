@@ -0,0 +1,458 @@
+/**
+* @file gg_flash_mgr_rollup.c
+* @brief Per-type time-window rollups implementation
+*/
+
+#include "gg_flash_mgr_rollup.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "gg_flash_mgr_config.h"
+
+static const char *TAG = FLASH_MGR_LOG_TAG;
+
+static const uint32_t window_seconds[FLASH_MGR_ROLLUP_WINDOWS] = { 60, 3600, 86400 };
+
+/**
+* @brief File header, followed by the state and the rings
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t types;
+    uint32_t record_size;       ///< sizeof(flash_mgr_rollup_t), a layout change rebuilds the file
+    uint32_t capacity[FLASH_MGR_ROLLUP_WINDOWS];
+} flash_mgr_rollup_header_t;
+
+/**
+* @brief Ring record, record seq lives in slot seq % capacity
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t seq;               ///< 0xFFFFFFFF = never written
+    flash_mgr_rollup_t rollup;
+} flash_mgr_rollup_rec_t;
+
+#define EMPTY_SEQ 0xFFFFFFFF
+#define QUERY_BATCH 16          // Records read per pread while querying
+
+// State: through_id, slot_type[types], open[types * FLASH_MGR_ROLLUP_WINDOWS]
+static size_t state_size(uint32_t types) {
+    return sizeof(uint32_t) + types * sizeof(uint16_t) +
+           (size_t)types * FLASH_MGR_ROLLUP_WINDOWS * sizeof(flash_mgr_rollup_t);
+}
+
+static off_t ring_offset(const flash_mgr_rollups_t *rollups, int window) {
+    off_t pos = (off_t)sizeof(flash_mgr_rollup_header_t) + (off_t)state_size(rollups->types);
+    for (int w = 0; w < window; w++) {
+        pos += (off_t)rollups->capacity[w] * sizeof(flash_mgr_rollup_rec_t);
+    }
+    return pos;
+}
+
+static off_t record_offset(const flash_mgr_rollups_t *rollups, int window, uint32_t seq) {
+    return ring_offset(rollups, window) + (off_t)(seq % rollups->capacity[window]) * sizeof(flash_mgr_rollup_rec_t);
+}
+
+static bool write_state(flash_mgr_rollups_t *rollups) {
+    off_t pos = sizeof(flash_mgr_rollup_header_t);
+    size_t slots_len = rollups->types * sizeof(uint16_t);
+    size_t open_len = (size_t)rollups->types * FLASH_MGR_ROLLUP_WINDOWS * sizeof(flash_mgr_rollup_t);
+
+    return pwrite(rollups->fd, &rollups->through_id, sizeof(uint32_t), pos) == sizeof(uint32_t) &&
+           pwrite(rollups->fd, rollups->slot_type, slots_len, pos + sizeof(uint32_t)) == (ssize_t)slots_len &&
+           pwrite(rollups->fd, rollups->open, open_len, pos + sizeof(uint32_t) + slots_len) == (ssize_t)open_len;
+}
+
+static bool read_state(flash_mgr_rollups_t *rollups) {
+    off_t pos = sizeof(flash_mgr_rollup_header_t);
+    size_t slots_len = rollups->types * sizeof(uint16_t);
+    size_t open_len = (size_t)rollups->types * FLASH_MGR_ROLLUP_WINDOWS * sizeof(flash_mgr_rollup_t);
+
+    return pread(rollups->fd, &rollups->through_id, sizeof(uint32_t), pos) == sizeof(uint32_t) &&
+           pread(rollups->fd, rollups->slot_type, slots_len, pos + sizeof(uint32_t)) == (ssize_t)slots_len &&
+           pread(rollups->fd, rollups->open, open_len, pos + sizeof(uint32_t) + slots_len) == (ssize_t)open_len;
+}
+
+static bool read_seq(const flash_mgr_rollups_t *rollups, int window, uint32_t slot, uint32_t *seq) {
+    off_t pos = ring_offset(rollups, window) + (off_t)slot * sizeof(flash_mgr_rollup_rec_t);
+    return pread(rollups->fd, seq, sizeof(*seq), pos) == sizeof(*seq);
+}
+
+/**
+* @brief Find the next sequence number of a ring
+*
+* Slot 0 holds the newest lap's first record s0, the slots after it hold
+* s0 + 1, s0 + 2, ... up to the write position, which is the first slot that
+* doesn't (an older lap or never written).
+*/
+static bool find_next_seq(flash_mgr_rollups_t *rollups, int window) {
+    uint32_t s0;
+    if (!read_seq(rollups, window, 0, &s0)) {
+        return false;
+    }
+    if (s0 == EMPTY_SEQ) {
+        rollups->next_seq[window] = 0;
+        return true;
+    }
+
+    uint32_t lo = 1;
+    uint32_t hi = rollups->capacity[window];
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t seq;
+        if (!read_seq(rollups, window, mid, &seq)) {
+            return false;
+        }
+        if (seq == s0 + mid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    rollups->next_seq[window] = s0 + lo;
+    return true;
+}
+
+static void reset_state(flash_mgr_rollups_t *rollups, uint32_t first_id) {
+    rollups->through_id = first_id;
+    for (uint32_t i = 0; i < rollups->types; i++) {
+        rollups->slot_type[i] = FLASH_MGR_ROLLUP_FREE;
+    }
+    memset(rollups->open, 0, (size_t)rollups->types * FLASH_MGR_ROLLUP_WINDOWS * sizeof(flash_mgr_rollup_t));
+}
+
+static bool write_empty(flash_mgr_rollups_t *rollups) {
+    flash_mgr_rollup_header_t header = {
+        .magic = FLASH_MGR_ROLLUP_MAGIC,
+        .types = rollups->types,
+        .record_size = sizeof(flash_mgr_rollup_t)
+    };
+    memcpy(header.capacity, rollups->capacity, sizeof(header.capacity));
+    if (pwrite(rollups->fd, &header, sizeof(header), 0) != sizeof(header) || !write_state(rollups)) {
+        return false;
+    }
+
+    // All-0xFF records carry EMPTY_SEQ
+    uint8_t blank[256];
+    memset(blank, 0xFF, sizeof(blank));
+    off_t end = ring_offset(rollups, FLASH_MGR_ROLLUP_WINDOWS);
+    for (off_t pos = ring_offset(rollups, 0); pos < end; pos += sizeof(blank)) {
+        size_t len = (end - pos < (off_t)sizeof(blank)) ? (size_t)(end - pos) : sizeof(blank);
+        if (pwrite(rollups->fd, blank, len, pos) != (ssize_t)len) {
+            return false;
+        }
+    }
+
+    return fsync(rollups->fd) == 0;
+}
+
+static esp_err_t create(flash_mgr_rollups_t *rollups, const char *path, uint32_t first_id) {
+    reset_state(rollups, first_id);
+    memset(rollups->next_seq, 0, sizeof(rollups->next_seq));
+
+    rollups->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (rollups->fd < 0) {
+        ESP_LOGE(TAG, "Failed to create rollup file %s", path);
+        return ESP_FAIL;
+    }
+
+    if (!write_empty(rollups)) {
+        ESP_LOGE(TAG, "Failed to initialize rollup file %s", path);
+        close(rollups->fd);
+        rollups->fd = -1;
+        remove(path);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static bool load(flash_mgr_rollups_t *rollups) {
+    flash_mgr_rollup_header_t header;
+    if (pread(rollups->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != FLASH_MGR_ROLLUP_MAGIC || header.types != rollups->types ||
+        header.record_size != sizeof(flash_mgr_rollup_t) ||
+        memcmp(header.capacity, rollups->capacity, sizeof(header.capacity)) != 0) {
+        return false;
+    }
+
+    if (!read_state(rollups)) {
+        return false;
+    }
+
+    for (int w = 0; w < FLASH_MGR_ROLLUP_WINDOWS; w++) {
+        if (!find_next_seq(rollups, w)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+esp_err_t flash_mgr_rollups_open(flash_mgr_rollups_t *rollups, const char *path, uint32_t types,
+                                 const uint32_t capacity[FLASH_MGR_ROLLUP_WINDOWS], uint32_t first_id) {
+    memset(rollups, 0, sizeof(*rollups));
+    rollups->fd = -1;
+    rollups->types = types;
+    memcpy(rollups->capacity, capacity, sizeof(rollups->capacity));
+
+    rollups->slot_type = malloc(types * sizeof(uint16_t));
+    rollups->open = calloc((size_t)types * FLASH_MGR_ROLLUP_WINDOWS, sizeof(flash_mgr_rollup_t));
+    if (!rollups->slot_type || !rollups->open) {
+        flash_mgr_rollups_close(rollups);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    rollups->fd = open(path, O_RDWR);
+    if (rollups->fd < 0 || !load(rollups)) {
+        if (rollups->fd >= 0) {
+            ESP_LOGW(TAG, "Rollup file %s doesn't match the configuration, starting over", path);
+            close(rollups->fd);
+        }
+        ret = create(rollups, path, first_id);
+    }
+
+    if (ret != ESP_OK) {
+        flash_mgr_rollups_close(rollups);
+        return ret;
+    }
+
+    rollups->saved_through_id = rollups->through_id;
+    return ESP_OK;
+}
+
+static int lookup_slot(const flash_mgr_rollups_t *rollups, uint8_t type) {
+    for (uint32_t i = 0; i < rollups->types; i++) {
+        if (rollups->slot_type[i] == type) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static int claim_slot(flash_mgr_rollups_t *rollups, uint8_t type) {
+    int slot = lookup_slot(rollups, type);
+    if (slot >= 0) {
+        return slot;
+    }
+
+    for (uint32_t i = 0; i < rollups->types; i++) {
+        if (rollups->slot_type[i] == FLASH_MGR_ROLLUP_FREE) {
+            rollups->slot_type[i] = type;
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/**
+* @brief Write a closed window to its ring (synced by the next state save)
+*/
+static void close_window(flash_mgr_rollups_t *rollups, int window, const flash_mgr_rollup_t *acc) {
+    flash_mgr_rollup_rec_t rec = {
+        .seq = rollups->next_seq[window],
+        .rollup = *acc
+    };
+    if (pwrite(rollups->fd, &rec, sizeof(rec), record_offset(rollups, window, rec.seq)) != sizeof(rec)) {
+        ESP_LOGE(TAG, "Failed to write rollup of type %u at %u", acc->type, acc->window_start);
+        return;
+    }
+    rollups->next_seq[window]++;
+}
+
+static bool fold(flash_mgr_rollups_t *rollups, int slot, int window, const flash_mgr_entry_t *entry) {
+    flash_mgr_rollup_t *acc = &rollups->open[slot * FLASH_MGR_ROLLUP_WINDOWS + window];
+    uint32_t start = entry->timestamp - entry->timestamp % window_seconds[window];
+    bool closed = false;
+
+    if (acc->count > 0 && acc->window_start != start) {
+        close_window(rollups, window, acc);
+        acc->count = 0;
+        closed = true;
+    }
+
+    if (acc->count == 0) {
+        acc->window_start = start;
+        acc->type = entry->type;
+        acc->window = (uint8_t)window;
+        acc->reserved = 0;
+        acc->min_value_x1000 = entry->value_x1000;
+        acc->max_value_x1000 = entry->value_x1000;
+        acc->sum_value_x1000 = 0;
+    }
+    if (entry->value_x1000 < acc->min_value_x1000) {
+        acc->min_value_x1000 = entry->value_x1000;
+    }
+    if (entry->value_x1000 > acc->max_value_x1000) {
+        acc->max_value_x1000 = entry->value_x1000;
+    }
+    acc->sum_value_x1000 += entry->value_x1000;
+    acc->count++;
+
+    return closed;
+}
+
+void flash_mgr_rollups_add(flash_mgr_rollups_t *rollups, const flash_mgr_entry_t *entries, uint32_t count) {
+    if (rollups->fd < 0) {
+        return;
+    }
+
+    bool closed = false;
+    for (uint32_t i = 0; i < count; i++) {
+        const flash_mgr_entry_t *entry = &entries[i];
+        if (entry->id < rollups->through_id) {
+            continue;
+        }
+        rollups->through_id = entry->id + 1;
+        rollups->dirty = true;
+        if (entry->unit == FLASH_MGR_UNIT_BLOB) {
+            continue; // The value is a file offset
+        }
+
+        int slot = claim_slot(rollups, entry->type);
+        if (slot < 0) {
+            if (!rollups->warned_full) {
+                ESP_LOGW(TAG, "All %u rollup types in use, type %u isn't rolled up", rollups->types, entry->type);
+                rollups->warned_full = true;
+            }
+            continue;
+        }
+
+        for (int w = 0; w < FLASH_MGR_ROLLUP_WINDOWS; w++) {
+            closed |= fold(rollups, slot, w, entry);
+        }
+    }
+
+    // The new ring records and the state that no longer holds them are synced
+    // together, so a reset never leaves a window in both
+    if (closed) {
+        flash_mgr_rollups_save(rollups);
+    }
+}
+
+esp_err_t flash_mgr_rollups_save(flash_mgr_rollups_t *rollups) {
+    if (rollups->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!rollups->dirty) {
+        return ESP_OK;
+    }
+
+    if (!write_state(rollups) || fsync(rollups->fd) != 0) {
+        ESP_LOGE(TAG, "Failed to save rollup state");
+        return ESP_FAIL;
+    }
+
+    rollups->saved_through_id = rollups->through_id;
+    rollups->dirty = false;
+    return ESP_OK;
+}
+
+/**
+* @brief Merge a window into out, which is sorted by window_start
+*/
+static void merge(flash_mgr_rollup_t *out, uint32_t max_rollups, uint32_t *n, const flash_mgr_rollup_t *rollup) {
+    uint32_t lo = 0;
+    uint32_t hi = *n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (out[mid].window_start < rollup->window_start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < *n && out[lo].window_start == rollup->window_start) {
+        flash_mgr_rollup_t *dst = &out[lo];
+        if (rollup->min_value_x1000 < dst->min_value_x1000) {
+            dst->min_value_x1000 = rollup->min_value_x1000;
+        }
+        if (rollup->max_value_x1000 > dst->max_value_x1000) {
+            dst->max_value_x1000 = rollup->max_value_x1000;
+        }
+        dst->sum_value_x1000 += rollup->sum_value_x1000;
+        dst->count += rollup->count;
+        return;
+    }
+
+    // Full: keep the oldest windows
+    if (lo >= max_rollups) {
+        return;
+    }
+    uint32_t keep = (*n < max_rollups) ? *n : max_rollups - 1;
+    if (keep > lo) {
+        memmove(&out[lo + 1], &out[lo], (keep - lo) * sizeof(*out));
+    }
+    out[lo] = *rollup;
+    *n = keep + 1;
+}
+
+esp_err_t flash_mgr_rollups_query(const flash_mgr_rollups_t *rollups, uint8_t type, flash_mgr_rollup_window_t window,
+                                  uint32_t from_ts, uint32_t to_ts, flash_mgr_rollup_t *out, uint32_t max_rollups,
+                                  uint32_t *rollups_read) {
+    *rollups_read = 0;
+    if (rollups->fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t capacity = rollups->capacity[window];
+    uint32_t end = rollups->next_seq[window];
+    uint32_t seq = (end > capacity) ? end - capacity : 0;
+    flash_mgr_rollup_rec_t recs[QUERY_BATCH];
+
+    while (seq < end) {
+        // Batches stop at the ring's end so one pread stays contiguous
+        uint32_t slot = seq % capacity;
+        uint32_t batch = end - seq;
+        if (batch > QUERY_BATCH) {
+            batch = QUERY_BATCH;
+        }
+        if (batch > capacity - slot) {
+            batch = capacity - slot;
+        }
+
+        size_t len = batch * sizeof(flash_mgr_rollup_rec_t);
+        if (pread(rollups->fd, recs, len, record_offset(rollups, window, seq)) != (ssize_t)len) {
+            ESP_LOGE(TAG, "Failed to read rollups");
+            return ESP_FAIL;
+        }
+
+        for (uint32_t i = 0; i < batch; i++) {
+            const flash_mgr_rollup_t *rollup = &recs[i].rollup;
+            if (recs[i].seq == seq + i && rollup->type == type &&
+                rollup->window_start >= from_ts && rollup->window_start <= to_ts) {
+                merge(out, max_rollups, rollups_read, rollup);
+            }
+        }
+        seq += batch;
+    }
+
+    // The window still filling
+    int slot = lookup_slot(rollups, type);
+    if (slot >= 0) {
+        const flash_mgr_rollup_t *acc = &rollups->open[slot * FLASH_MGR_ROLLUP_WINDOWS + window];
+        if (acc->count > 0 && acc->window_start >= from_ts && acc->window_start <= to_ts) {
+            merge(out, max_rollups, rollups_read, acc);
+        }
+    }
+
+    return ESP_OK;
+}
+
+void flash_mgr_rollups_close(flash_mgr_rollups_t *rollups) {
+    if (rollups->fd >= 0) {
+        close(rollups->fd);
+        rollups->fd = -1;
+    }
+    free(rollups->slot_type);
+    free(rollups->open);
+    rollups->slot_type = NULL;
+    rollups->open = NULL;
+}
@@ -0,0 +1,84 @@
+/**
+* @file gg_flash_mgr_rollup.h
+* @brief Per-type time-window rollups (internal)
+*
+* Every flushed entry is folded into a min/max/sum/count accumulator for its
+* type and the minute, hour and day window its timestamp falls in. When an
+* entry lands in another window than the accumulator's, the accumulator is
+* closed into that window length's record ring and starts over. Out-of-order
+* timestamps therefore only split a window into several records, which
+* queries merge back together.
+*
+* File layout: header, state (open accumulators and through_id), then one ring
+* of records per window length. Records carry a sequence number, so the write
+* position is found again with a binary search on open. The state is saved
+* whenever a window closes, so the rings never hold a window the state hasn't
+* let go of; entries from through_id on are replayed from the log after a reset.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gg_flash_mgr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_MGR_ROLLUP_MAGIC 0x50554C52 // "RLUP"
+
+/**
+* @brief Rollup engine state
+*/
+typedef struct {
+    int fd;                                         ///< -1 when closed
+    uint32_t types;                                 ///< Accumulator slots, one per distinct type
+    uint32_t capacity[FLASH_MGR_ROLLUP_WINDOWS];    ///< Records per ring
+    uint32_t next_seq[FLASH_MGR_ROLLUP_WINDOWS];    ///< Sequence number of the next record per ring
+    uint16_t *slot_type;                            ///< Type owning each slot, FLASH_MGR_ROLLUP_FREE if none
+    flash_mgr_rollup_t *open;                       ///< types * FLASH_MGR_ROLLUP_WINDOWS accumulators (count 0 = empty)
+    uint32_t through_id;                            ///< Entries below this id are folded in
+    uint32_t saved_through_id;                      ///< through_id of the state on flash
+    bool dirty;                                     ///< State changed since it was saved
+    bool warned_full;                               ///< "Out of type slots" was logged
+} flash_mgr_rollups_t;
+
+#define FLASH_MGR_ROLLUP_FREE 0xFFFF
+
+/**
+* @brief Open (or create) the rollup file and load the saved state
+*
+* @param first_id through_id to start from when the file is (re)created
+*/
+esp_err_t flash_mgr_rollups_open(flash_mgr_rollups_t *rollups, const char *path, uint32_t types,
+                                 const uint32_t capacity[FLASH_MGR_ROLLUP_WINDOWS], uint32_t first_id);
+
+/**
+* @brief Fold flushed entries in; entries below through_id are skipped
+*
+* Closed windows are written to their ring and the state is saved right after.
+*/
+void flash_mgr_rollups_add(flash_mgr_rollups_t *rollups, const flash_mgr_entry_t *entries, uint32_t count);
+
+/**
+* @brief Save the open accumulators and through_id if they changed
+*/
+esp_err_t flash_mgr_rollups_save(flash_mgr_rollups_t *rollups);
+
+/**
+* @brief Closed and open windows of one type starting in [from_ts, to_ts], oldest first
+*
+* Records of the same window are merged. At most max_rollups windows, the
+* oldest ones, are returned.
+*/
+esp_err_t flash_mgr_rollups_query(const flash_mgr_rollups_t *rollups, uint8_t type, flash_mgr_rollup_window_t window,
+                                  uint32_t from_ts, uint32_t to_ts, flash_mgr_rollup_t *out, uint32_t max_rollups,
+                                  uint32_t *rollups_read);
+
+void flash_mgr_rollups_close(flash_mgr_rollups_t *rollups);
+
+#ifdef __cplusplus
+}
+#endif
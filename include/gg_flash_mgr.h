@@ -7,13 +7,66 @@
 #pragma once
 
 #include "esp_err.h"
+#include "gg_flash_mgr_config.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+* @brief Physical layout of the entry log
+*/
+typedef enum {
+    FLASH_MGR_STORAGE_FILE = 0,     ///< Single data file; delete copies the remaining entries
+    FLASH_MGR_STORAGE_SEGMENTED,    ///< Fixed-size segment files; delete unlinks whole segments
+    FLASH_MGR_STORAGE_RING,         ///< Pre-allocated max_data_size file; oldest entries are overwritten when full
+    FLASH_MGR_STORAGE_RAW,          ///< Sector log written with esp_flash at the top of the chip, outside LittleFS
+} flash_mgr_storage_mode_t;
+
+/**
+* @brief What an async append does when the writer queue is full
+*/
+typedef enum {
+    FLASH_MGR_OVERFLOW_DROP = 0,    ///< Drop the new entry and return ESP_ERR_NO_MEM
+    FLASH_MGR_OVERFLOW_BLOCK,       ///< Wait up to overflow_block_ms for room, then drop with ESP_ERR_TIMEOUT
+} flash_mgr_overflow_policy_t;
+
+/**
+* @brief What auto-cleanup does with entries a named consumer hasn't acked
+*/
+typedef enum {
+    FLASH_MGR_CONSUMER_CLEANUP_ADVANCE = 0, ///< Delete them anyway, lagging cursors skip to the oldest entry left
+    FLASH_MGR_CONSUMER_CLEANUP_PROTECT,     ///< Keep them, cleanup only removes what every consumer acked and appends fail with ESP_ERR_NO_MEM at max_data_size
+} flash_mgr_consumer_policy_t;
+
+/**
+* @brief Window lengths rollups are kept for
+*/
+typedef enum {
+    FLASH_MGR_ROLLUP_MINUTE = 0,    ///< 60 s windows
+    FLASH_MGR_ROLLUP_HOUR,          ///< 3600 s windows
+    FLASH_MGR_ROLLUP_DAY,           ///< 86400 s windows
+    FLASH_MGR_ROLLUP_WINDOWS,       ///< Number of window lengths
+} flash_mgr_rollup_window_t;
+
+/**
+* @brief An entry type kept in a stream of its own
+* 
+* The stream is a sub-log next to the log's files (data.t042.bin for type 42
+* and so on), so its entries are only evicted by its own cleanup and reads of
+* it never touch the other types.
+*/
+typedef struct {
+    uint8_t type;               ///< Entry type routed to the stream
+    uint32_t max_data_size;     ///< Quota in bytes, apart from the log's own max_data_size
+    float cleanup_threshold;    ///< Auto-cleanup starts at this ratio of the quota (0 = the log's thresholds)
+    float cleanup_target;       ///< Ratio auto-cleanup brings the stream down to
+} flash_mgr_stream_config_t;
+
 /**
 * @brief Flash manager configuration structure
 */
@@ -31,30 +84,86 @@ typedef struct {
     const char* partition_label;
     const char* data_file;
     const char* meta_file;
+    const char* index_file;     // Block index, see time_index_block
+    const char* rollup_file;    // Closed rollup windows, see rollup_types
+    const char* blob_file;      // Payloads of flash_mgr_append_blob() (NULL = no blobs)
 
     // Memory Limits
     uint32_t max_data_size; // How much data storage in the data file in bytes
-    uint32_t chunk_buffer_size; // Max buffer in ram for holding data from flash (default: 4096)
+    uint32_t chunk_buffer_size; // Max buffer in ram for holding data from flash, also the read-ahead window (default: 4096)
     
     // Behavior Configuration
     bool format_on_init;        // Format filesystem on first initialization
     bool auto_cleanup;          // Enable automatic cleanup when storage is full
     float cleanup_threshold;    // Cleanup when storage exceeds this ratio (0.0-1.0)
     float cleanup_target;       // Target storage ratio after cleanup (0.0-1.0)
+
+    // Write Staging Configuration
+    uint32_t staging_entries;   // Entries collected in RAM before one flash write (0 or 1 = write-through, default);
+                                // staged entries are lost on reset until flushed
+    uint32_t staging_max_age_ms; // Flush on append once the oldest staged entry is this old (0 = size only)
+    
+    // Metadata Checkpoint Configuration (counters are rebuilt from the data file on mount)
+    uint32_t meta_checkpoint_entries;     // Save metadata after this many flushed entries (0 = off)
+    uint32_t meta_checkpoint_interval_ms; // Save metadata when this much time has passed (0 = off)
+    
+    // Storage Layout (layouts don't read each other's files - format when switching)
+    flash_mgr_storage_mode_t storage_mode;
+    uint32_t segment_size;      // Bytes per segment file in SEGMENTED mode, e.g. data.000123.bin
+    bool compress_segments;     // SEGMENTED mode: delta encode full segments into data.000123.dlt (capacity only, entries are written twice)
+    bool logical_delete;        // FILE mode: delete only advances the head, compaction runs later
+    float reclaim_threshold;    // Compact once this fraction of the data file is deleted (or acked) entries (0.0-1.0)
+    
+    // Asynchronous Writer (appends only queue the entry; a writer task stages and flushes)
+    bool async_writer;          // Enable the writer task
+    uint32_t writer_queue_entries; // Queue size in entries, power of two
+    int writer_task_priority;   // FreeRTOS priority of the writer task
+    int writer_task_core;       // Core to pin the writer task to (-1 = no affinity)
+    uint32_t writer_task_stack; // Writer task stack size in bytes
+    flash_mgr_overflow_policy_t overflow_policy; // Queue full: drop or block
+    uint32_t overflow_block_ms; // FLASH_MGR_OVERFLOW_BLOCK: longest an append waits for room
+    
+    // ISR Appends
+    uint32_t isr_queue_entries; // Ring for flash_mgr_append_from_isr(), power of two (0 = disabled)
+    
+    // Block Index (time range, types, units and value range per block of entries, for flash_mgr_scan())
+    uint32_t time_index_block;  // Entries per index block (0 = no index, scans read everything)
+    
+    // Rollups (min/max/sum/count per type and minute, hour and day, kept after the entries are deleted)
+    uint32_t rollup_types;      // Distinct entry types tracked, the rest are ignored (0 = no rollups)
+    uint32_t rollup_records[FLASH_MGR_ROLLUP_WINDOWS]; // Closed windows kept per window length, all types together
+    
+    // Named Consumers (see flash_mgr_consumer_register())
+    flash_mgr_consumer_policy_t consumer_cleanup_policy; // Auto-cleanup and entries some consumer hasn't acked
+    
+    // Streams (see flash_mgr_stream()): appends of these types go to sub-logs of their own
+    uint32_t stream_count;      // Entries used in streams (0 = every type in the one log)
+    flash_mgr_stream_config_t streams[FLASH_MGR_MAX_STREAMS];
 } flash_mgr_config_t;
 
 /**
 * @brief Data entry structure to stored under the data file
+* 
+* reserved carries a CRC-16 of the other fields, set when the entry is
+* appended. Mount checks the newest entries with it and cuts a torn tail.
 */
 typedef struct __attribute__((packed)) {
     uint32_t timestamp;     ///< Entry timestamp
     uint32_t id;           ///< Unique entry ID
     uint8_t type;          ///< Data type identifier
-    uint8_t unit;          ///< Data unit identifier
+    uint8_t unit;          ///< Data unit identifier; FLASH_MGR_UNIT_BLOB is reserved for blob entries
     int32_t value_x1000;   ///< Value multiplied by 1000 for precision
-    uint8_t reserved[2];   ///< Reserved bytes for alignment
+    uint8_t reserved[2];   ///< Check value, filled in on append (input is ignored)
 } flash_mgr_entry_t;
 
+/**
+* @brief Unit of the entries flash_mgr_append_blob() adds (reserved)
+* 
+* Their value is where the payload is stored; read it with flash_mgr_read_blob().
+* The other appends reject it with ESP_ERR_INVALID_ARG.
+*/
+#define FLASH_MGR_UNIT_BLOB 0xFF
+
 /**
 * @brief Flash manager status information
 */
@@ -64,9 +173,85 @@ typedef struct {
     uint32_t deleted_entries;   ///< Total entries deleted
     uint32_t free_space_bytes;  ///< Available storage space in bytes
     uint32_t used_space_bytes;  ///< Used storage space in bytes
+    uint32_t pending_entries;   ///< Entries staged in RAM, not yet written to flash
+    uint32_t queued_entries;    ///< Entries waiting in the async writer queue (not yet counted above)
+    uint32_t dropped_entries;   ///< Async appends rejected because the writer queue was full
+    uint32_t isr_queued_entries; ///< Entries waiting in the ISR queue
+    uint32_t isr_dropped_entries; ///< ISR appends dropped (queue full or too much contention)
     bool initialized;           ///< Whether manager is initialized
 } flash_mgr_status_t;
 
+/**
+* @brief Read cursor over the stored entries (opaque, see flash_mgr_iter_open())
+*/
+typedef struct flash_mgr_iter flash_mgr_iter_t;
+
+/**
+* @brief Read cursor over a log and its streams together (opaque, see flash_mgr_merge_open())
+*/
+typedef struct flash_mgr_merge flash_mgr_merge_t;
+
+/**
+* @brief Header of every slot in a record file, see flash_mgr_records_open()
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t id;                ///< Record id, per record file
+    uint32_t timestamp;         ///< Seconds since epoch at append
+} flash_mgr_record_header_t;
+
+/**
+* @brief Bytes per record slot: the header and the record padded to 4 bytes
+*/
+#define FLASH_MGR_RECORD_STRIDE(record_size) \
+    (sizeof(flash_mgr_record_header_t) + (((size_t)(record_size) + 3) & ~(size_t)3))
+
+/**
+* @brief Fixed-size records of one schema (opaque, see flash_mgr_records_open())
+*/
+typedef struct flash_mgr_records flash_mgr_records_t;
+
+/**
+* @brief An open log (opaque, see flash_mgr_open())
+*/
+typedef struct flash_mgr_log* flash_mgr_handle_t;
+
+/**
+* @brief Called for every entry a query returns, oldest first
+* 
+* @return true to continue, false to stop the query
+*/
+typedef bool (*flash_mgr_entry_cb_t)(const flash_mgr_entry_t* entry, void* ctx);
+
+/**
+* @brief Aggregate of the entries of one type in one time window
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t window_start;      ///< First timestamp of the window (a multiple of its length)
+    uint8_t type;               ///< Entry type
+    uint8_t window;             ///< flash_mgr_rollup_window_t
+    uint16_t reserved;          ///< Reserved, 0
+    uint32_t count;             ///< Entries in the window
+    int32_t min_value_x1000;    ///< Smallest value
+    int32_t max_value_x1000;    ///< Largest value
+    int64_t sum_value_x1000;    ///< Sum of the values, divide by count for the mean
+} flash_mgr_rollup_t;
+
+#define FLASH_MGR_FILTER_ANY (-1)
+
+/**
+* @brief Entry filter for flash_mgr_scan(), an entry must meet every condition
+* 
+* Start from flash_mgr_get_default_filter(), which matches everything.
+*/
+typedef struct {
+    uint32_t min_timestamp;     ///< Inclusive
+    uint32_t max_timestamp;     ///< Inclusive
+    int type;                   ///< Entry type to match, or FLASH_MGR_FILTER_ANY
+    int unit;                   ///< Entry unit to match, or FLASH_MGR_FILTER_ANY
+    int32_t min_value_x1000;    ///< Inclusive
+    int32_t max_value_x1000;    ///< Inclusive
+} flash_mgr_filter_t;
+
 /**
 * @brief Get default configuration
 * 
@@ -77,6 +262,9 @@ flash_mgr_config_t flash_mgr_get_default_config(void);
 /**
 * @brief Initialize flash manager with configuration
 * 
+* Opens the default log, the one every call without a handle uses. More
+* logs can be opened with flash_mgr_open().
+* 
 * @param config Configuration structure
 * @return ESP_OK on success, error code otherwise
 */
@@ -100,7 +288,7 @@ bool flash_mgr_is_initialized(void);
 * @brief Append data entry to flash storage
 * 
 * @param type Data type identifier
-* @param unit Data unit identifier  
+* @param unit Data unit identifier, anything but FLASH_MGR_UNIT_BLOB
 * @param value_x1000 Value multiplied by 1000
 * @return ESP_OK on success, error code otherwise
 */
@@ -109,17 +297,135 @@ esp_err_t flash_mgr_append(uint8_t type, uint8_t unit, int32_t value_x1000);
 /**
 * @brief Append data entry with custom timestamp
 * 
+* With async_writer the entry is only pushed to the writer queue (lock-free)
+* and gets its id, and becomes readable, once the writer task picks it up.
+* 
 * @param timestamp Custom timestamp
 * @param type Data type identifier
-* @param unit Data unit identifier
+* @param unit Data unit identifier, anything but FLASH_MGR_UNIT_BLOB
 * @param value_x1000 Value multiplied by 1000
-* @return ESP_OK on success, error code otherwise
+* @return ESP_OK on success, ESP_ERR_NO_MEM / ESP_ERR_TIMEOUT if the writer
+*         queue was full (see overflow_policy), error code otherwise
 */
 esp_err_t flash_mgr_append_with_timestamp(uint32_t timestamp, uint8_t type, uint8_t unit, int32_t value_x1000);
 
+/**
+* @brief Append an entry from interrupt context
+* 
+* Lock-free and allocation-free with a bounded number of steps, and placed in
+* IRAM, so it's usable from high-priority (IRAM) interrupts. The entry goes to
+* a RAM ring (isr_queue_entries) and is staged by the next append, flush or
+* writer task pass, which assigns its id; without async_writer, call
+* flash_mgr_flush() periodically if no other appends happen.
+* 
+* @param timestamp Entry timestamp, 0 to use the time the entry is staged
+* @param type Data type identifier
+* @param unit Data unit identifier, anything but FLASH_MGR_UNIT_BLOB
+* @param value_x1000 Value multiplied by 1000
+* @return ESP_OK on success, ESP_ERR_NO_MEM if dropped (counted in
+*         isr_dropped_entries), ESP_ERR_INVALID_STATE if the ISR queue is disabled
+*/
+esp_err_t flash_mgr_append_from_isr(uint32_t timestamp, uint8_t type, uint8_t unit, int32_t value_x1000);
+
+/**
+* @brief Append a variable-length payload (GPS fix, fault dump, ...) as one entry
+* 
+* The entry gets the next id, the current time, type and unit
+* FLASH_MGR_UNIT_BLOB, and is staged, deleted and cleaned up like any other;
+* the payload goes to blob_file right away and is dropped with its entry.
+* Fixed entries take no extra space. Blob bytes count against max_data_size.
+* 
+* @param type Data type identifier
+* @param data Payload
+* @param len Payload size, 1 to FLASH_MGR_MAX_BLOB_SIZE bytes
+* @return ESP_OK on success, ESP_ERR_INVALID_STATE without a blob_file,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_append_blob(uint8_t type, const void* data, size_t len);
+
+/**
+* @brief Append count payloads of record_size bytes each, one blob entry per record
+* 
+* The payloads go to flash with a single sync and the entries get consecutive
+* ids. On error, records whose entry wasn't staged are dropped again.
+* 
+* @param type Data type identifier of every entry
+* @param records count records back to back
+* @param record_size Bytes per record, 1 to FLASH_MGR_MAX_BLOB_SIZE
+* @param count Number of records
+* @return ESP_OK on success, ESP_ERR_INVALID_STATE without a blob_file,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_append_blobs(uint8_t type, const void* records, size_t record_size, uint32_t count);
+
+/**
+* @brief Read part of the payload of a blob entry
+* 
+* Reads payload bytes [offset, offset + size), so a large blob can be
+* streamed through a small buffer by advancing offset by bytes_read until it
+* reaches blob_len. The payload check is verified when one call reads the
+* whole payload.
+* 
+* @param id Id of the blob entry
+* @param offset First payload byte to read
+* @param buffer Output buffer
+* @param size Size of buffer
+* @param bytes_read Bytes read, 0 once offset reaches the end
+* @param blob_len Total payload size, may be NULL
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if id is gone or not a blob,
+*         ESP_ERR_INVALID_CRC if the payload is damaged, error code otherwise
+*/
+esp_err_t flash_mgr_read_blob(uint32_t id, size_t offset, void* buffer, size_t size, size_t* bytes_read,
+                              size_t* blob_len);
+
+/**
+* @brief Append a batch of entries as one unit
+* 
+* Ids are assigned as one contiguous range (the id field of the input is
+* ignored), the batch goes to flash in a single write together with anything
+* still staged, and metadata is updated once. On error no entry of the batch
+* is kept: ids, counters and reads are as before the call, and on RING the
+* older entries the batch overwrote are put back. Only if removing the
+* written part fails as well is it kept and counted (on RING together with
+* the loss of the oldest entry it reached).
+* 
+* With streams, each run of entries going to the same log is one such batch,
+* and the runs before a failed one are kept.
+* 
+* @param entries Entries to append; timestamp, type, unit and value are used
+* @param count Number of entries, at most the storage capacity
+* @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the batch can never fit,
+*         ESP_ERR_INVALID_ARG if an entry has unit FLASH_MGR_UNIT_BLOB (nothing
+*         is appended then), error code otherwise
+*/
+esp_err_t flash_mgr_append_batch(const flash_mgr_entry_t* entries, uint32_t count);
+
+/**
+* @brief Same as flash_mgr_append_batch(), stamping every entry with the current time
+*/
+esp_err_t flash_mgr_append_batch_now(const flash_mgr_entry_t* entries, uint32_t count);
+
+/**
+* @brief Write all staged entries to flash
+* 
+* Appends are collected in a RAM staging buffer and written in one go when
+* staging_entries is reached or the oldest entry exceeds staging_max_age_ms.
+* The age limit is only checked on append, so call this before sleep/reset
+* or from a periodic task if appends can stop for long periods. With
+* async_writer the writer task checks it, and this also drains the writer queue.
+* 
+* @return ESP_OK on success, error code otherwise
+*/
+esp_err_t flash_mgr_flush(void);
+
 /**
 * @brief Read entries in chunks (oldest first)
 * 
+* Entries still held in the staging buffer are returned after the ones on flash.
+* Safe from any task: readers run concurrently with each other and with the
+* flash writes of appends, deletes and compaction, and only wait while the
+* writer updates the in-memory state (RING/RAW appends wait for the write).
+* 
 * @param buffer Buffer to store read entries
 * @param max_entries Maximum number of entries to read
 * @param entries_read[out] Number of entries actually read
@@ -127,20 +433,362 @@ esp_err_t flash_mgr_append_with_timestamp(uint32_t timestamp, uint8_t type, uint
 */
 esp_err_t flash_mgr_read_chunk(flash_mgr_entry_t* buffer, uint32_t max_entries, uint32_t* entries_read);
 
+/**
+* @brief Read entries starting start_index entries after the oldest one
+* 
+* Same as flash_mgr_read_chunk() but seeks straight to start_index, so
+* paging through the store doesn't re-read everything before the page.
+* 
+* @param start_index Position relative to the oldest active entry (0 = oldest)
+* @param buffer Buffer to store read entries
+* @param max_entries Maximum number of entries to read
+* @param entries_read[out] Number of entries actually read (0 past the newest entry)
+* @return ESP_OK on success, error code otherwise
+*/
+esp_err_t flash_mgr_read_at(uint32_t start_index, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                            uint32_t* entries_read);
+
+/**
+* @brief Read the entry with the given id
+* 
+* The position is computed from the id, so only that entry is read.
+* 
+* @param id Entry id
+* @param entry[out] The entry
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if the id was deleted or not
+*         assigned yet, error code otherwise
+*/
+esp_err_t flash_mgr_get_by_id(uint32_t id, flash_mgr_entry_t* entry);
+
+/**
+* @brief Read the entries with ids first_id..last_id (inclusive)
+* 
+* Stops early at max_entries or at the newest entry.
+* 
+* @param first_id Id of the first entry to read
+* @param last_id Id of the last entry to read
+* @param buffer Buffer to store read entries
+* @param max_entries Maximum number of entries to read
+* @param entries_read[out] Number of entries actually read
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if first_id was deleted or not
+*         assigned yet, error code otherwise
+*/
+esp_err_t flash_mgr_read_id_range(uint32_t first_id, uint32_t last_id, flash_mgr_entry_t* buffer,
+                                  uint32_t max_entries, uint32_t* entries_read);
+
+/**
+* @brief Call callback for every entry with t0 <= timestamp <= t1
+* 
+* Same as flash_mgr_scan() with a filter on the timestamp only.
+* 
+* @param t0 First timestamp of the range
+* @param t1 Last timestamp of the range (inclusive)
+* @param callback Called for each matching entry
+* @param ctx Passed to callback
+* @return ESP_OK on success (also when callback stopped the query), error code otherwise
+*/
+esp_err_t flash_mgr_query_time_range(uint32_t t0, uint32_t t1, flash_mgr_entry_cb_t callback, void* ctx);
+
+/**
+* @brief Get a filter that matches every entry
+* 
+* @return Filter with the full timestamp and value ranges and any type and unit
+*/
+flash_mgr_filter_t flash_mgr_get_default_filter(void);
+
+/**
+* @brief Call callback for every entry that matches filter
+* 
+* With time_index_block set, every block of entries has a summary (time
+* range, types and units present, value range). A binary search over the
+* summaries finds the first block that can match min_timestamp, and blocks
+* that can't hold a match aren't read at all. Timestamps don't have to
+* increase: a block is only skipped by its own summary. The callback runs
+* without any lock held and may call other flash_mgr functions.
+* 
+* @param filter Conditions an entry must meet
+* @param callback Called for each matching entry
+* @param ctx Passed to callback
+* @return ESP_OK on success (also when callback stopped the scan), error code otherwise
+*/
+esp_err_t flash_mgr_scan(const flash_mgr_filter_t* filter, flash_mgr_entry_cb_t callback, void* ctx);
+
+/**
+* @brief Call callback for the entries with ids first_id..last_id that match filter
+* 
+* Entries are read a chunk at a time into one internal buffer of
+* chunk_buffer_size bytes and callback gets a pointer into it, so nothing is
+* copied and no memory is allocated per call (unless another scan is using
+* the buffer). The pointer is only valid until callback returns. Ids already
+* deleted are skipped; the walk ends at last_id or the newest entry.
+* 
+* @param first_id Id of the first entry to visit
+* @param last_id Id of the last entry to visit (inclusive, UINT32_MAX = up to the newest)
+* @param filter Conditions an entry must meet, NULL for every entry
+* @param callback Called for each matching entry, oldest first; returns false to stop
+* @param ctx Passed to callback
+* @return ESP_OK on success (also when callback stopped the walk), error code otherwise
+*/
+esp_err_t flash_mgr_foreach(uint32_t first_id, uint32_t last_id, const flash_mgr_filter_t* filter,
+                            flash_mgr_entry_cb_t callback, void* ctx);
+
+/**
+* @brief Get the rollups of one entry type, oldest window first
+* 
+* With rollup_types set, every entry written to flash is also added to a
+* min/max/sum/count per type for the minute, hour and day it falls in.
+* Closed windows go to rollup_file, which flash_mgr_delete() and cleanup
+* don't touch, so trends stay available after the entries are gone; the
+* window still filling is returned from RAM. Only rollup_file is read.
+* 
+* @param type Entry type
+* @param window Window length
+* @param from_ts First window start to return
+* @param to_ts Last window start to return (inclusive)
+* @param rollups Buffer for the windows
+* @param max_rollups Maximum number of windows, the oldest ones are returned
+* @param rollups_read[out] Number of windows returned
+* @return ESP_OK on success, ESP_ERR_INVALID_STATE if rollups are disabled,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_get_rollups(uint8_t type, flash_mgr_rollup_window_t window, uint32_t from_ts, uint32_t to_ts,
+                                flash_mgr_rollup_t* rollups, uint32_t max_rollups, uint32_t* rollups_read);
+
+/**
+* @brief Open a read cursor at start_index entries after the oldest one
+* 
+* The cursor keeps its data file open between flash_mgr_iter_next() calls
+* (FILE and SEGMENTED modes), so each page costs one seek and one read. It
+* follows entries, not positions: deleting from the head doesn't shift it,
+* and if the entries under it get deleted it continues at the oldest one.
+* A cursor must only be used by one task at a time.
+* 
+* @param start_index Position relative to the oldest active entry (0 = oldest)
+* @param iter[out] New cursor, release with flash_mgr_iter_close()
+* @return ESP_OK on success, ESP_ERR_NO_MEM if it can't be allocated
+*/
+esp_err_t flash_mgr_iter_open(uint32_t start_index, flash_mgr_iter_t** iter);
+
+/**
+* @brief Read the next entries and advance the cursor
+* 
+* Entries appended after the cursor was opened are returned too.
+* 
+* @param iter Cursor from flash_mgr_iter_open()
+* @param buffer Buffer to store read entries
+* @param max_entries Maximum number of entries to read
+* @param entries_read[out] Number of entries actually read (0 at the newest entry)
+* @return ESP_OK on success, error code otherwise
+*/
+esp_err_t flash_mgr_iter_next(flash_mgr_iter_t* iter, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                              uint32_t* entries_read);
+
+/**
+* @brief Close a read cursor and free it
+* 
+* @param iter Cursor from flash_mgr_iter_open() (NULL is ignored)
+*/
+void flash_mgr_iter_close(flash_mgr_iter_t* iter);
+
+/**
+* @brief Get the stream an entry type is kept in
+* 
+* Appends of the type go to the stream on their own; everything that reads or
+* drops entries by id (reads, cursors, consumers, delete, cleanup, status)
+* works on one log, so pass the stream's handle to the flash_mgr_log_*()
+* calls for its entries. They only touch the stream's files. Ids are the
+* stream's own. flash_mgr_flush() and flash_mgr_format() cover the streams too.
+* 
+* @param type Entry type from config.streams
+* @param stream[out] Handle of the stream, valid until the log is closed
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if the type has no stream
+*/
+esp_err_t flash_mgr_stream(uint8_t type, flash_mgr_handle_t* stream);
+
+/**
+* @brief Open a cursor over the log and all of its streams, oldest first
+* 
+* Ids are per stream, so the entries are merged by timestamp (entries with the
+* same timestamp: the log's first, then the streams in config order). Each
+* entry keeps the id it has in its own log.
+* 
+* @param merge[out] New cursor, release with flash_mgr_merge_close()
+* @return ESP_OK on success, ESP_ERR_NO_MEM if it can't be allocated
+*/
+esp_err_t flash_mgr_merge_open(flash_mgr_merge_t** merge);
+
+/**
+* @brief Read the next entries of a merged cursor
+* 
+* @param merge Cursor from flash_mgr_merge_open()
+* @param buffer Buffer to store read entries
+* @param max_entries Maximum number of entries to read
+* @param entries_read[out] Number of entries actually read (0 once every stream is read up)
+* @return ESP_OK on success, error code otherwise
+*/
+esp_err_t flash_mgr_merge_next(flash_mgr_merge_t* merge, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                               uint32_t* entries_read);
+
+/**
+* @brief Close a merged cursor and free it
+* 
+* @param merge Cursor from flash_mgr_merge_open() (NULL is ignored)
+*/
+void flash_mgr_merge_close(flash_mgr_merge_t* merge);
+
+/**
+* @brief Open the record file of a schema: fixed-size records addressed by id
+* 
+* The records live next to the log's data file (data.r010.bin for schema 10)
+* in a ring of slots pre-allocated when the file is created, so an append is
+* a copy into a buffer and one write, and slot n holds ids n, n + slots, ...
+* Once the ring is full the oldest record is overwritten. Records are not
+* entries: they have ids of their own and no consumers, streams or rollups.
+* 
+* The file keeps the record size and slot count it was created with; reopening
+* it with another record size fails, another slot count is ignored until
+* flash_mgr_format(). Records are synced by flash_mgr_flush() and on close.
+* 
+* @param schema_id Schema number, one record file each
+* @param record_size Bytes per record, 1 to FLASH_MGR_MAX_RECORD_SIZE
+* @param slots Records kept, 0 for FLASH_MGR_DEFAULT_RECORD_SLOTS
+* @param records[out] Open record file, release with flash_mgr_records_close()
+*                     before the log is closed
+* @return ESP_OK on success, ESP_ERR_INVALID_SIZE if the file holds records of
+*         another size, ESP_ERR_INVALID_STATE if the schema is open already,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_records_open(uint8_t schema_id, size_t record_size, uint32_t slots,
+                                 flash_mgr_records_t** records);
+
+/**
+* @brief Append records with consecutive ids, stamped with the current time
+* 
+* @param records Record file from flash_mgr_records_open()
+* @param data count records of record_size bytes, back to back
+* @param count Number of records
+* @return ESP_OK on success, error code otherwise
+*/
+esp_err_t flash_mgr_records_append(flash_mgr_records_t* records, const void* data, uint32_t count);
+
+/**
+* @brief Read records starting at an id
+* 
+* Every record is read as a slot of FLASH_MGR_RECORD_STRIDE(record_size)
+* bytes: a flash_mgr_record_header_t, the record and its padding.
+* 
+* @param records Record file from flash_mgr_records_open()
+* @param id Id of the first record
+* @param buffer Room for max_records slots
+* @param max_records Maximum number of records to read
+* @param records_read[out] Records read, 0 at the end
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if id was overwritten,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_records_read(flash_mgr_records_t* records, uint32_t id, void* buffer, uint32_t max_records,
+                                 uint32_t* records_read);
+
+/**
+* @brief Ids of the records kept: [first_id, end_id)
+*/
+esp_err_t flash_mgr_records_bounds(flash_mgr_records_t* records, uint32_t* first_id, uint32_t* end_id);
+
+/**
+* @brief Sync and close a record file
+* 
+* @param records Record file from flash_mgr_records_open() (NULL is ignored)
+*/
+void flash_mgr_records_close(flash_mgr_records_t* records);
+
+/**
+* @brief Register a named consumer, or keep the existing one of that name
+* 
+* Every consumer has its own cursor, stored with the metadata, that
+* flash_mgr_read_next() reads from and flash_mgr_ack() advances. Once there
+* is a consumer, entries are only deleted after every consumer acked them
+* (or by flash_mgr_delete(), auto-cleanup as consumer_cleanup_policy says,
+* or RING/RAW overwrites, which move lagging cursors to the oldest entry left).
+* A new consumer starts at the oldest entry.
+* 
+* @param name Up to FLASH_MGR_CONSUMER_NAME_LEN - 1 characters
+* @return ESP_OK on success, ESP_ERR_NO_MEM if FLASH_MGR_MAX_CONSUMERS are
+*         registered, error code otherwise
+*/
+esp_err_t flash_mgr_consumer_register(const char* name);
+
+/**
+* @brief Remove a named consumer; entries only it held back are deleted
+* 
+* @param name Consumer name
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such consumer,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_consumer_unregister(const char* name);
+
+/**
+* @brief Read the entries at a consumer's cursor (oldest first)
+* 
+* Like flash_mgr_read_chunk(), but for one consumer: the cursor doesn't
+* move, so the same entries come back until they're acked.
+* 
+* @param name Consumer name
+* @param buffer Buffer to store read entries
+* @param max_entries Maximum number of entries to read
+* @param entries_read[out] Number of entries actually read (0 when the consumer is caught up)
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such consumer,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_read_next(const char* name, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                              uint32_t* entries_read);
+
+/**
+* @brief Advance a consumer's cursor past count entries
+* 
+* Only the cursor moves; entries every consumer has acked are deleted with
+* the next flushed batch (in FILE mode once they are reclaim_threshold of the
+* log, as deleting there rewrites the data file). The cursor is saved with the
+* metadata checkpoints, so after a reset a consumer may get entries it acked
+* since the last checkpoint again, but never misses any.
+* 
+* @param name Consumer name
+* @param count Entries processed, usually entries_read of flash_mgr_read_next()
+* @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such consumer,
+*         error code otherwise
+*/
+esp_err_t flash_mgr_ack(const char* name, uint32_t count);
+
 /**
 * @brief Delete processed entries from storage
 * 
-* This function actually removes data from the file to free up space.
-* Uses RAM-efficient chunked operations to handle large files.
+* This function actually removes data from flash to free up space.
+* In FILE mode the remaining entries are copied to a new file in
+* RAM-efficient chunks, unless logical_delete is set, in which case only
+* the head moves and flash_mgr_reclaim() compacts later. In SEGMENTED
+* mode only fully deleted segment files are unlinked and nothing is copied.
 * 
 * @param count Number of entries to delete (from oldest probably start of file)
 * @return ESP_OK on success, error code otherwise
 */
 esp_err_t flash_mgr_delete(uint32_t count);
 
+/**
+* @brief Physically free logically deleted entries
+* 
+* With logical_delete, flash_mgr_delete only advances the head. The dead
+* prefix is compacted automatically during a flush once it exceeds
+* reclaim_threshold; call this from a low-priority task to do it earlier,
+* off the append path. No-op for other storage modes.
+* 
+* @return ESP_OK on success, error code otherwise
+*/
+esp_err_t flash_mgr_reclaim(void);
+
 /**
 * @brief Get current storage status
 * 
+* Lock-free: reads a snapshot the writer publishes after each operation, so it
+* never waits for a flush, delete or compaction in progress.
+* 
 * @param status[out] Status information structure
 * @return ESP_OK on success, error code otherwise
 */
@@ -155,7 +803,7 @@ esp_err_t flash_mgr_get_status(flash_mgr_status_t* status);
 esp_err_t flash_mgr_cleanup(uint32_t target_entries);
 
 /**
-* @brief Format the storage (WARNING: Deletes all data)
+* @brief Format the storage (WARNING: Deletes all data, rollups and record files included)
 * 
 * @return ESP_OK on success, error code otherwise
 */
@@ -170,6 +818,95 @@ esp_err_t flash_mgr_format(void);
 */
 esp_err_t flash_mgr_get_fs_info(size_t* total_bytes, size_t* used_bytes);
 
+// =============================================================================
+// MULTIPLE LOGS
+// =============================================================================
+
+/**
+* @brief Open a log of its own, next to the default one and any others
+* 
+* Every log has its own files, staging buffer, locks and writer task; all of
+* them share one LittleFS mount. The first log opened (by flash_mgr_init() or
+* here) mounts it with its configuration, later ones must name the same
+* mount_point and partition_label and different files. format_on_init on a
+* later log erases only that log's files. Only the first log can use
+* FLASH_MGR_STORAGE_RAW.
+* 
+* Opening and closing logs must not race each other.
+* 
+* @param config Configuration of the new log
+* @param handle[out] Handle for the flash_mgr_log_*() calls
+* @return ESP_OK on success, ESP_ERR_INVALID_ARG if the log doesn't fit the open ones
+*/
+esp_err_t flash_mgr_open(const flash_mgr_config_t* config, flash_mgr_handle_t* handle);
+
+/**
+* @brief Flush and close a log from flash_mgr_open() and free its handle
+* 
+* Close its cursors and record files first. Its streams are closed with it,
+* their handles can't be closed on their own. The last log closed unmounts the
+* filesystem.
+* 
+* @param handle Log from flash_mgr_open()
+* @return ESP_OK on success, error code otherwise
+*/
+esp_err_t flash_mgr_close(flash_mgr_handle_t handle);
+
+/**
+* @brief The calls above, on a log from flash_mgr_open()
+* 
+* flash_mgr_log_X(handle, ...) is flash_mgr_X(...) on that log; the calls
+* without a handle use the log of flash_mgr_init(). Cursors remember their
+* log, so flash_mgr_iter_next(), flash_mgr_merge_next() and the close calls
+* take no handle. A NULL handle gets ESP_ERR_INVALID_ARG (false from
+* flash_mgr_log_is_initialized()).
+*/
+bool flash_mgr_log_is_initialized(flash_mgr_handle_t handle);
+esp_err_t flash_mgr_log_append(flash_mgr_handle_t handle, uint8_t type, uint8_t unit, int32_t value_x1000);
+esp_err_t flash_mgr_log_append_with_timestamp(flash_mgr_handle_t handle, uint32_t timestamp, uint8_t type,
+                                              uint8_t unit, int32_t value_x1000);
+esp_err_t flash_mgr_log_append_from_isr(flash_mgr_handle_t handle, uint32_t timestamp, uint8_t type, uint8_t unit,
+                                        int32_t value_x1000);
+esp_err_t flash_mgr_log_append_blob(flash_mgr_handle_t handle, uint8_t type, const void* data, size_t len);
+esp_err_t flash_mgr_log_append_blobs(flash_mgr_handle_t handle, uint8_t type, const void* records, size_t record_size,
+                                     uint32_t count);
+esp_err_t flash_mgr_log_read_blob(flash_mgr_handle_t handle, uint32_t id, size_t offset, void* buffer, size_t size,
+                                  size_t* bytes_read, size_t* blob_len);
+esp_err_t flash_mgr_log_append_batch(flash_mgr_handle_t handle, const flash_mgr_entry_t* entries, uint32_t count);
+esp_err_t flash_mgr_log_append_batch_now(flash_mgr_handle_t handle, const flash_mgr_entry_t* entries, uint32_t count);
+esp_err_t flash_mgr_log_flush(flash_mgr_handle_t handle);
+esp_err_t flash_mgr_log_read_chunk(flash_mgr_handle_t handle, flash_mgr_entry_t* buffer, uint32_t max_entries,
+                                   uint32_t* entries_read);
+esp_err_t flash_mgr_log_read_at(flash_mgr_handle_t handle, uint32_t start_index, flash_mgr_entry_t* buffer,
+                                uint32_t max_entries, uint32_t* entries_read);
+esp_err_t flash_mgr_log_get_by_id(flash_mgr_handle_t handle, uint32_t id, flash_mgr_entry_t* entry);
+esp_err_t flash_mgr_log_read_id_range(flash_mgr_handle_t handle, uint32_t first_id, uint32_t last_id,
+                                      flash_mgr_entry_t* buffer, uint32_t max_entries, uint32_t* entries_read);
+esp_err_t flash_mgr_log_query_time_range(flash_mgr_handle_t handle, uint32_t t0, uint32_t t1,
+                                         flash_mgr_entry_cb_t callback, void* ctx);
+esp_err_t flash_mgr_log_scan(flash_mgr_handle_t handle, const flash_mgr_filter_t* filter,
+                             flash_mgr_entry_cb_t callback, void* ctx);
+esp_err_t flash_mgr_log_foreach(flash_mgr_handle_t handle, uint32_t first_id, uint32_t last_id,
+                                const flash_mgr_filter_t* filter, flash_mgr_entry_cb_t callback, void* ctx);
+esp_err_t flash_mgr_log_get_rollups(flash_mgr_handle_t handle, uint8_t type, flash_mgr_rollup_window_t window,
+                                    uint32_t from_ts, uint32_t to_ts, flash_mgr_rollup_t* rollups,
+                                    uint32_t max_rollups, uint32_t* rollups_read);
+esp_err_t flash_mgr_log_iter_open(flash_mgr_handle_t handle, uint32_t start_index, flash_mgr_iter_t** iter);
+esp_err_t flash_mgr_log_stream(flash_mgr_handle_t handle, uint8_t type, flash_mgr_handle_t* stream);
+esp_err_t flash_mgr_log_merge_open(flash_mgr_handle_t handle, flash_mgr_merge_t** merge);
+esp_err_t flash_mgr_log_records_open(flash_mgr_handle_t handle, uint8_t schema_id, size_t record_size, uint32_t slots,
+                                     flash_mgr_records_t** records);
+esp_err_t flash_mgr_log_consumer_register(flash_mgr_handle_t handle, const char* name);
+esp_err_t flash_mgr_log_consumer_unregister(flash_mgr_handle_t handle, const char* name);
+esp_err_t flash_mgr_log_read_next(flash_mgr_handle_t handle, const char* name, flash_mgr_entry_t* buffer,
+                                  uint32_t max_entries, uint32_t* entries_read);
+esp_err_t flash_mgr_log_ack(flash_mgr_handle_t handle, const char* name, uint32_t count);
+esp_err_t flash_mgr_log_delete(flash_mgr_handle_t handle, uint32_t count);
+esp_err_t flash_mgr_log_reclaim(flash_mgr_handle_t handle);
+esp_err_t flash_mgr_log_get_status(flash_mgr_handle_t handle, flash_mgr_status_t* status);
+esp_err_t flash_mgr_log_cleanup(flash_mgr_handle_t handle, uint32_t target_entries);
+esp_err_t flash_mgr_log_format(flash_mgr_handle_t handle);
+
 // =============================================================================
 // UTILITY FUNCTIONS - STANDALONE FILE/DIRECTORY OPERATIONS
 // =============================================================================
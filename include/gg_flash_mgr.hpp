@@ -0,0 +1,226 @@
+/**
+* @file gg_flash_mgr.hpp
+* @brief Typed records for C++ over record files (header only)
+*
+* A TypedLog<T, SchemaId> keeps its records in the record file of SchemaId
+* (see flash_mgr_records_open()): fixed-size slots holding a header and the
+* sizeof(T) bytes of the record, addressed by id. Appending copies the record
+* into a slot buffer and writes it; reading copies slots straight into
+* TypedRecord<T>, which has the slot layout.
+*
+* Every method returns esp_err_t, nothing throws.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "gg_flash_mgr.h"
+#include "gg_flash_mgr_config.h"
+
+namespace flash_mgr {
+
+/**
+* @brief One record as stored in its slot
+*/
+template <typename T>
+struct TypedRecord {
+    uint32_t id;            ///< Record id, per schema
+    uint32_t timestamp;     ///< Seconds since epoch at append
+    T value;
+};
+
+/**
+* @brief Log of T records in the record file of SchemaId
+*
+* Move-only, owns the open record file. Open it once, with the log it belongs
+* to or the default one, and close it (or destroy the TypedLog) before that
+* log is closed. Use one SchemaId per record type: the file remembers the
+* record size and refuses to open for another T.
+*/
+template <typename T, uint8_t SchemaId>
+class TypedLog {
+    static_assert(std::is_trivially_copyable<T>::value, "TypedLog records are stored as raw bytes");
+    static_assert(sizeof(T) <= FLASH_MGR_MAX_RECORD_SIZE, "TypedLog record larger than FLASH_MGR_MAX_RECORD_SIZE");
+    static_assert(alignof(T) <= 8 && sizeof(TypedRecord<T>) == FLASH_MGR_RECORD_STRIDE(sizeof(T)),
+                  "TypedRecord<T> must have the layout of a record slot");
+
+public:
+    static constexpr uint8_t schema_id = SchemaId;
+    static constexpr size_t record_size = sizeof(T);
+
+    using Record = TypedRecord<T>;
+
+    TypedLog() = default;
+
+    TypedLog(TypedLog&& other) noexcept : records_(other.records_) {
+        other.records_ = nullptr;
+    }
+
+    TypedLog& operator=(TypedLog&& other) noexcept {
+        if (this != &other) {
+            close();
+            records_ = other.records_;
+            other.records_ = nullptr;
+        }
+        return *this;
+    }
+
+    TypedLog(const TypedLog&) = delete;
+    TypedLog& operator=(const TypedLog&) = delete;
+
+    ~TypedLog() {
+        close();
+    }
+
+    /**
+    * @brief Open the record file
+    *
+    * @param slots Records kept, 0 for FLASH_MGR_DEFAULT_RECORD_SLOTS
+    * @param log Log from flash_mgr_open(), nullptr for the default log
+    * @return ESP_ERR_INVALID_SIZE if the file holds records of another size,
+    *         see flash_mgr_records_open()
+    */
+    esp_err_t open(uint32_t slots = 0, flash_mgr_handle_t log = nullptr) {
+        close();
+        return log ? flash_mgr_log_records_open(log, SchemaId, record_size, slots, &records_)
+                   : flash_mgr_records_open(SchemaId, record_size, slots, &records_);
+    }
+
+    void close() {
+        flash_mgr_records_close(records_);
+        records_ = nullptr;
+    }
+
+    bool is_open() const { return records_ != nullptr; }
+
+    /**
+    * @brief Append one record
+    */
+    esp_err_t append(const T& record) {
+        return flash_mgr_records_append(records_, &record, 1);
+    }
+
+    /**
+    * @brief Append count records with consecutive ids
+    */
+    esp_err_t append(const T* records, uint32_t count) {
+        return flash_mgr_records_append(records_, records, count);
+    }
+
+    template <size_t N>
+    esp_err_t append(const T (&records)[N]) {
+        return flash_mgr_records_append(records_, records, N);
+    }
+
+    /**
+    * @brief Read the record with this id
+    *
+    * @return ESP_ERR_NOT_FOUND if id was overwritten or not written yet
+    */
+    esp_err_t get(uint32_t id, Record& out) const {
+        uint32_t records_read;
+        esp_err_t ret = flash_mgr_records_read(records_, id, &out, 1, &records_read);
+        if (ret == ESP_OK && records_read == 0) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        return ret;
+    }
+
+    esp_err_t get(uint32_t id, T& out) const {
+        Record record;
+        esp_err_t ret = get(id, record);
+        if (ret == ESP_OK) {
+            out = record.value;
+        }
+        return ret;
+    }
+
+    /**
+    * @brief Ids of the records kept: [first_id, end_id)
+    */
+    esp_err_t bounds(uint32_t& first_id, uint32_t& end_id) const {
+        return flash_mgr_records_bounds(records_, &first_id, &end_id);
+    }
+
+    /**
+    * @brief Forward iterator over the records, oldest first
+    *
+    * Reads FLASH_MGR_RECORD_READ_BUFFER bytes of records at a time. Records
+    * overwritten under it are skipped. Iteration stops at the first error,
+    * see status().
+    */
+    class iterator {
+    public:
+        iterator() = default;
+
+        iterator(flash_mgr_records_t* records, uint32_t start_index) : records_(records), done_(false) {
+            uint32_t end_id;
+            status_ = flash_mgr_records_bounds(records_, &next_id_, &end_id);
+            next_id_ += start_index;
+            fill();
+        }
+
+        const Record& operator*() const { return batch_[pos_]; }
+        const Record* operator->() const { return &batch_[pos_]; }
+
+        iterator& operator++() {
+            if (!done_ && ++pos_ == count_) {
+                fill();
+            }
+            return *this;
+        }
+
+        // Only meaningful against end(): iterators are equal once both are exhausted
+        bool operator==(const iterator& other) const { return done_ == other.done_; }
+        bool operator!=(const iterator& other) const { return done_ != other.done_; }
+
+        /**
+        * @brief ESP_OK, or the error that ended the iteration early
+        */
+        esp_err_t status() const { return status_; }
+
+    private:
+        static constexpr uint32_t batch_records =
+            (sizeof(Record) < FLASH_MGR_RECORD_READ_BUFFER) ? FLASH_MGR_RECORD_READ_BUFFER / sizeof(Record) : 1;
+
+        void fill() {
+            pos_ = 0;
+            count_ = 0;
+            if (status_ == ESP_OK) {
+                status_ = flash_mgr_records_read(records_, next_id_, batch_, batch_records, &count_);
+            }
+            if (status_ == ESP_ERR_NOT_FOUND) {
+                // Overwritten since the last read: carry on with the oldest
+                uint32_t end_id;
+                status_ = flash_mgr_records_bounds(records_, &next_id_, &end_id);
+                if (status_ == ESP_OK) {
+                    status_ = flash_mgr_records_read(records_, next_id_, batch_, batch_records, &count_);
+                }
+            }
+            next_id_ += count_;
+            done_ = (status_ != ESP_OK || count_ == 0);
+        }
+
+        flash_mgr_records_t* records_ = nullptr;
+        uint32_t next_id_ = 0;
+        Record batch_[batch_records];
+        uint32_t count_ = 0;
+        uint32_t pos_ = 0;
+        bool done_ = true;
+        esp_err_t status_ = ESP_OK;
+    };
+
+    /**
+    * @brief Iterate from an index of the records kept (0 = oldest)
+    */
+    iterator begin(uint32_t start_index = 0) const { return iterator(records_, start_index); }
+    iterator end() const { return iterator(); }
+
+private:
+    flash_mgr_records_t* records_ = nullptr;
+};
+
+} // namespace flash_mgr
@@ -1,336 +1,164 @@
 /**
-* @file gg_flash_mgr.h
-* @brief ESP32 External Flash Memory Manager Component
+* @file gg_flash_mgr_config.h
+* @brief Default configuration and compile-time limits for the Flash Manager
 * @date 2025
 */
 
 #pragma once
 
-#include "esp_err.h"
-#include <stdint.h>
-#include <stdbool.h>
+// =============================================================================
+// LOGGING
+// =============================================================================
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+#define FLASH_MGR_LOG_TAG                   "gg_flash_mgr"
+#define FLASH_MGR_ENABLE_DEBUG_LOGS         0
 
-/**
-* @brief Flash manager configuration structure
-*/
-typedef struct {
-    // SPI Flash Pin Configuration
-    int mosi_pin;
-    int miso_pin;
-    int sclk_pin;
-    int cs_pin;
-    int spi_host;
-    int freq_mhz;
-    
-    // Storage Configuration
-    const char* mount_point;
-    const char* partition_label;
-    const char* data_file;
-    const char* meta_file;
-
-    // Memory Limits
-    uint32_t max_data_size; // How much data storage in the data file in bytes
-    uint32_t chunk_buffer_size; // Max buffer in ram for holding data from flash (default: 4096)
-    
-    // Behavior Configuration
-    bool format_on_init;        // Format filesystem on first initialization
-    bool auto_cleanup;          // Enable automatic cleanup when storage is full
-    float cleanup_threshold;    // Cleanup when storage exceeds this ratio (0.0-1.0)
-    float cleanup_target;       // Target storage ratio after cleanup (0.0-1.0)
-} flash_mgr_config_t;
+// =============================================================================
+// DEFAULT SPI FLASH PIN CONFIGURATION
+// =============================================================================
 
-/**
-* @brief Data entry structure to stored under the data file
-*/
-typedef struct __attribute__((packed)) {
-    uint32_t timestamp;     ///< Entry timestamp
-    uint32_t id;           ///< Unique entry ID
-    uint8_t type;          ///< Data type identifier
-    uint8_t unit;          ///< Data unit identifier
-    int32_t value_x1000;   ///< Value multiplied by 1000 for precision
-    uint8_t reserved[2];   ///< Reserved bytes for alignment
-} flash_mgr_entry_t;
+#define FLASH_MGR_DEFAULT_MOSI_PIN          23
+#define FLASH_MGR_DEFAULT_MISO_PIN          19
+#define FLASH_MGR_DEFAULT_SCLK_PIN          18
+#define FLASH_MGR_DEFAULT_CS_PIN            5
+#define FLASH_MGR_DEFAULT_SPI_HOST          SPI2_HOST
+#define FLASH_MGR_DEFAULT_FREQ_MHZ          40
+#define FLASH_MGR_EXT_FLASH_SIZE            (16 * 1024 * 1024)
 
-/**
-* @brief Flash manager status information
-*/
-typedef struct {
-    uint32_t total_entries;     ///< Total entries ever written
-    uint32_t active_entries;    ///< Currently active entries
-    uint32_t deleted_entries;   ///< Total entries deleted
-    uint32_t free_space_bytes;  ///< Available storage space in bytes
-    uint32_t used_space_bytes;  ///< Used storage space in bytes
-    bool initialized;           ///< Whether manager is initialized
-} flash_mgr_status_t;
+// =============================================================================
+// DEFAULT STORAGE CONFIGURATION
+// =============================================================================
 
-/**
-* @brief Get default configuration
-* 
-* @return Default configuration structure
-*/
-flash_mgr_config_t flash_mgr_get_default_config(void);
+#define FLASH_MGR_DEFAULT_MOUNT_POINT       "/ext"
+#define FLASH_MGR_DEFAULT_PARTITION_LABEL   "gg_flash_storage"
+#define FLASH_MGR_DEFAULT_DATA_FILE         "/ext/data.bin"
+#define FLASH_MGR_DEFAULT_META_FILE         "/ext/meta.bin"
+#define FLASH_MGR_DEFAULT_INDEX_FILE        "/ext/index.bin"
+#define FLASH_MGR_DEFAULT_ROLLUP_FILE       "/ext/rollup.bin"
+#define FLASH_MGR_DEFAULT_BLOB_FILE         "/ext/blob.bin"
 
-/**
-* @brief Initialize flash manager with configuration
-* 
-* @param config Configuration structure
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_init(const flash_mgr_config_t* config);
+// =============================================================================
+// DEFAULT MEMORY LIMITS
+// =============================================================================
 
-/**
-* @brief Deinitialize flash manager
-* 
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_deinit(void);
+#define FLASH_MGR_DEFAULT_MAX_DATA_SIZE     (8 * 1024 * 1024)
+#define FLASH_MGR_DEFAULT_CHUNK_BUFFER_SIZE 4096
 
-/**
-* @brief Check if flash manager is initialized
-* 
-* @return true if initialized, false otherwise
-*/
-bool flash_mgr_is_initialized(void);
+#define FLASH_MGR_MIN_DATA_SIZE             (4 * 1024)
+#define FLASH_MGR_MAX_DATA_SIZE             (16 * 1024 * 1024)
+#define FLASH_MGR_MIN_CHUNK_BUFFER_SIZE     512
+#define FLASH_MGR_MAX_CHUNK_BUFFER_SIZE     (64 * 1024)
 
-/**
-* @brief Append data entry to flash storage
-* 
-* @param type Data type identifier
-* @param unit Data unit identifier  
-* @param value_x1000 Value multiplied by 1000
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_append(uint8_t type, uint8_t unit, int32_t value_x1000);
+// =============================================================================
+// DEFAULT BEHAVIOR CONFIGURATION
+// =============================================================================
 
-/**
-* @brief Append data entry with custom timestamp
-* 
-* @param timestamp Custom timestamp
-* @param type Data type identifier
-* @param unit Data unit identifier
-* @param value_x1000 Value multiplied by 1000
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_append_with_timestamp(uint32_t timestamp, uint8_t type, uint8_t unit, int32_t value_x1000);
+#define FLASH_MGR_DEFAULT_FORMAT_ON_INIT    false
+#define FLASH_MGR_DEFAULT_AUTO_CLEANUP      true
+#define FLASH_MGR_DEFAULT_CLEANUP_THRESHOLD 0.90f
+#define FLASH_MGR_DEFAULT_CLEANUP_TARGET    0.70f
 
-/**
-* @brief Read entries in chunks (oldest first)
-* 
-* @param buffer Buffer to store read entries
-* @param max_entries Maximum number of entries to read
-* @param entries_read[out] Number of entries actually read
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_read_chunk(flash_mgr_entry_t* buffer, uint32_t max_entries, uint32_t* entries_read);
+// =============================================================================
+// WRITE STAGING
+// =============================================================================
 
-/**
-* @brief Delete processed entries from storage
-* 
-* This function actually removes data from the file to free up space.
-* Uses RAM-efficient chunked operations to handle large files.
-* 
-* @param count Number of entries to delete (from oldest probably start of file)
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_delete(uint32_t count);
+#define FLASH_MGR_DEFAULT_STAGING_ENTRIES   0       // Write-through: an append is on flash when it returns
+#define FLASH_MGR_DEFAULT_STAGING_MAX_AGE_MS 1000   // Flush staged entries older than this (once staging is on)
+#define FLASH_MGR_MAX_STAGING_ENTRIES       1024
 
-/**
-* @brief Get current storage status
-* 
-* @param status[out] Status information structure
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_get_status(flash_mgr_status_t* status);
+// =============================================================================
+// METADATA CHECKPOINTING
+// =============================================================================
 
-/**
-* @brief Force cleanup of old entries
-* 
-* @param target_entries Target number of entries to keep (probably end of file)
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_cleanup(uint32_t target_entries);
+#define FLASH_MGR_DEFAULT_META_CHECKPOINT_ENTRIES     512
+#define FLASH_MGR_DEFAULT_META_CHECKPOINT_INTERVAL_MS (60 * 1000)
 
-/**
-* @brief Format the storage (WARNING: Deletes all data)
-* 
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_format(void);
+// =============================================================================
+// STORAGE LAYOUT
+// =============================================================================
 
-/**
-* @brief Get filesystem information
-* 
-* @param total_bytes[out] Total filesystem size
-* @param used_bytes[out] Used filesystem space
-* @return ESP_OK on success, error code otherwise
-*/
-esp_err_t flash_mgr_get_fs_info(size_t* total_bytes, size_t* used_bytes);
+#define FLASH_MGR_DEFAULT_STORAGE_MODE      FLASH_MGR_STORAGE_FILE
+#define FLASH_MGR_DEFAULT_SEGMENT_SIZE      (64 * 1024)
+#define FLASH_MGR_MIN_SEGMENT_SIZE          1024
+#define FLASH_MGR_DEFAULT_COMPRESS_SEGMENTS false
+#define FLASH_MGR_DELTA_BLOCK_ENTRIES       128     // Entries per independently decodable block of a sealed segment
+#define FLASH_MGR_DEFAULT_LOGICAL_DELETE    false
+#define FLASH_MGR_DEFAULT_RECLAIM_THRESHOLD 0.50f   // Dead fraction of the data file that triggers compaction
+#define FLASH_MGR_MIN_LITTLEFS_SIZE         (256 * 1024) // RAW mode: LittleFS space left below the raw region
 
 // =============================================================================
-// UTILITY FUNCTIONS - STANDALONE FILE/DIRECTORY OPERATIONS
+// ASYNCHRONOUS WRITER
 // =============================================================================
 
-/**
- * @brief File information structure
- */
-typedef struct {
-    size_t size;        ///< File size in bytes
-    time_t mtime;       ///< Last modification time
-    bool is_directory;  ///< True if this is a directory
-} flash_mgr_file_info_t;
+#define FLASH_MGR_DEFAULT_ASYNC_WRITER          false
+#define FLASH_MGR_DEFAULT_WRITER_QUEUE_ENTRIES  256
+#define FLASH_MGR_MAX_WRITER_QUEUE_ENTRIES      16384
+#define FLASH_MGR_DEFAULT_WRITER_TASK_PRIORITY  5
+#define FLASH_MGR_DEFAULT_WRITER_TASK_CORE      -1      // No affinity
+#define FLASH_MGR_DEFAULT_WRITER_TASK_STACK     4096
+#define FLASH_MGR_DEFAULT_OVERFLOW_POLICY       FLASH_MGR_OVERFLOW_DROP
+#define FLASH_MGR_DEFAULT_OVERFLOW_BLOCK_MS     100
+#define FLASH_MGR_WRITER_RETRY_MS               1000    // Back-off after a failed flush
 
-/**
- * @brief Directory listing callback function
- * @param path Full path of the file/directory
- * @param info File information
- * @param user_data User-provided data pointer
- * @return true to continue listing, false to stop
- */
-typedef bool (*flash_mgr_dir_callback_t)(const char* path, const flash_mgr_file_info_t* info, void* user_data);
-
-// Directory Operations
-/**
- * @brief Create a directory (supports nested directories)
- * @param path Directory path (e.g., "/ext/logs/sensors")
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_mkdir(const char* path);
+// =============================================================================
+// ISR APPENDS
+// =============================================================================
 
-/**
- * @brief Remove a directory (recursive removal supported)
- * @param path Directory path to remove
- * @param recursive If true, removes directory and all contents
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_rmdir(const char* path, bool recursive);
+#define FLASH_MGR_DEFAULT_ISR_QUEUE_ENTRIES     0       // Disabled
+#define FLASH_MGR_MAX_ISR_QUEUE_ENTRIES         4096
+#define FLASH_MGR_ISR_PUSH_ATTEMPTS             8       // Claim attempts before an ISR append is dropped
 
-/**
- * @brief Check if directory exists
- * @param path Directory path to check
- * @return true if directory exists, false otherwise
- */
-bool flash_mgr_util_dir_exists(const char* path);
+// =============================================================================
+// BLOCK INDEX (time range and zone map per block)
+// =============================================================================
 
-/**
- * @brief List directory contents
- * @param path Directory path to list
- * @param callback Callback function called for each entry
- * @param user_data User data passed to callback
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_list_dir(const char* path, flash_mgr_dir_callback_t callback, void* user_data);
-
-// File Operations
-/**
- * @brief Write data to file (creates directories if needed)
- * @param filepath Full file path
- * @param data Data to write
- * @param size Size of data in bytes
- * @param append If true, append to file; if false, overwrite
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_write_file(const char* filepath, const void* data, size_t size, bool append);
+#define FLASH_MGR_DEFAULT_TIME_INDEX_BLOCK      256     // One 88 byte record per 4 KB of entries
+#define FLASH_MGR_MIN_TIME_INDEX_BLOCK          16
+#define FLASH_MGR_MAX_TIME_INDEX_BLOCK          65536
 
-/**
- * @brief Read entire file into buffer
- * @param filepath Full file path
- * @param buffer[out] Buffer to store data (allocated by function)
- * @param size[out] Size of data read
- * @return ESP_OK on success, error code otherwise
- * @note Caller must free the returned buffer
- */
-esp_err_t flash_mgr_util_read_file(const char* filepath, void** buffer, size_t* size);
+// =============================================================================
+// ROLLUPS (min/max/sum/count per type and window)
+// =============================================================================
 
-/**
- * @brief Write text string to file
- * @param filepath Full file path
- * @param text Text string to write
- * @param append If true, append to file; if false, overwrite
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_write_text(const char* filepath, const char* text, bool append);
+#define FLASH_MGR_DEFAULT_ROLLUP_TYPES          0       // Disabled
+#define FLASH_MGR_MAX_ROLLUP_TYPES              256
+#define FLASH_MGR_DEFAULT_ROLLUP_MINUTE_RECORDS 2048    // 32 bytes each, ~34 h of one type
+#define FLASH_MGR_DEFAULT_ROLLUP_HOUR_RECORDS   1024    // ~42 days of one type
+#define FLASH_MGR_DEFAULT_ROLLUP_DAY_RECORDS    512     // ~1.4 years of one type
 
-/**
- * @brief Read text file into string
- * @param filepath Full file path
- * @param text[out] Text string (allocated by function)
- * @return ESP_OK on success, error code otherwise
- * @note Caller must free the returned string
- */
-esp_err_t flash_mgr_util_read_text(const char* filepath, char** text);
+// =============================================================================
+// BLOBS (variable-length payloads behind blob entries)
+// =============================================================================
 
-/**
- * @brief Delete a file
- * @param filepath Full file path
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_delete_file(const char* filepath);
+#define FLASH_MGR_MAX_BLOB_SIZE                 4096    // Bytes per payload
 
-/**
- * @brief Check if file exists
- * @param filepath File path to check
- * @return true if file exists, false otherwise
- */
-bool flash_mgr_util_file_exists(const char* filepath);
+// =============================================================================
+// STREAMS (entry types kept in sub-logs of their own)
+// =============================================================================
 
-/**
- * @brief Get file information
- * @param filepath Full file path
- * @param info[out] File information structure
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_get_file_info(const char* filepath, flash_mgr_file_info_t* info);
+#define FLASH_MGR_DEFAULT_STREAM_COUNT          0       // Disabled
+#define FLASH_MGR_MAX_STREAMS                   4       // Each one a sub-log with its own files and retention
+#define FLASH_MGR_MERGE_READ_ENTRIES            16      // Entries a merged cursor reads ahead per stream
 
-/**
- * @brief Copy a file
- * @param src_path Source file path
- * @param dst_path Destination file path
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_copy_file(const char* src_path, const char* dst_path);
+// =============================================================================
+// RECORD FILES (fixed-size records per schema, see flash_mgr_records_open())
+// =============================================================================
 
-/**
- * @brief Move/rename a file
- * @param old_path Current file path
- * @param new_path New file path
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_move_file(const char* old_path, const char* new_path);
-
-// Advanced File Operations
-/**
- * @brief Calculate file checksum (CRC32)
- * @param filepath Full file path
- * @param checksum[out] Calculated CRC32 checksum
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_file_checksum(const char* filepath, uint32_t* checksum);
+#define FLASH_MGR_MAX_RECORD_SIZE               1024    // Bytes per record
+#define FLASH_MGR_DEFAULT_RECORD_SLOTS          1024    // Records kept per schema
+#define FLASH_MGR_RECORD_WRITE_BUFFER           512     // Bytes of slots an append writes at once (at least one slot)
+#define FLASH_MGR_RECORD_READ_BUFFER            512     // Bytes of records a C++ TypedLog iterator reads at once
 
-/**
- * @brief Get directory size (recursive)
- * @param path Directory path
- * @param total_size[out] Total size in bytes
- * @param file_count[out] Number of files (optional, can be NULL)
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_get_dir_size(const char* path, size_t* total_size, uint32_t* file_count);
+// =============================================================================
+// NAMED CONSUMERS
+// =============================================================================
 
-/**
- * @brief Find files matching pattern
- * @param base_path Base directory to search
- * @param pattern File pattern (supports * and ? wildcards)
- * @param recursive Search subdirectories
- * @param callback Callback for each matching file
- * @param user_data User data for callback
- * @return ESP_OK on success, error code otherwise
- */
-esp_err_t flash_mgr_util_find_files(const char* base_path, const char* pattern, bool recursive, 
-                                   flash_mgr_dir_callback_t callback, void* user_data);
-
-#ifdef __cplusplus
-}
-#endif
+#define FLASH_MGR_MAX_CONSUMERS                 8       // Cursors stored in the metadata file
+#define FLASH_MGR_CONSUMER_NAME_LEN             16      // Including the terminating NUL
+#define FLASH_MGR_DEFAULT_CONSUMER_CLEANUP      FLASH_MGR_CONSUMER_CLEANUP_ADVANCE
+
+// =============================================================================
+// MISC
+// =============================================================================
+
+#define FLASH_MGR_PROGRESS_LOG_INTERVAL     (64 * 1024) // Log copy progress every N bytes
@@ -0,0 +1,263 @@
+/**
+* @file test_raw_log.c
+* @brief Host test of the raw flash log on a file-backed flash image
+*
+* Every check reopens the image and recovers, so it sees what a reset would.
+*/
+
+#include "gg_flash_mgr_raw.h"
+#include "gg_flash_mgr_crc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_PATH "raw_log.img"
+#define IMAGE_SECTORS 4
+#define IMAGE_SIZE (IMAGE_SECTORS * FLASH_MGR_RAW_SECTOR_SIZE)
+#define SLOTS ((uint32_t)FLASH_MGR_RAW_SLOTS_PER_SECTOR)
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+typedef struct {
+    flash_mgr_raw_file_t image;
+    flash_mgr_raw_log_t log;
+    uint32_t first_id;
+    uint32_t end_id;
+} test_log_t;
+
+static flash_mgr_entry_t make_entry(uint32_t id, int32_t value) {
+    flash_mgr_entry_t entry = {
+        .timestamp = 1000 + id,
+        .id = id,
+        .type = 1,
+        .unit = 2,
+        .value_x1000 = value
+    };
+    flash_mgr_entry_seal(&entry);
+    return entry;
+}
+
+/**
+* @brief Open the image (kept from earlier runs unless fresh) and recover the log on it
+*/
+static void log_open(test_log_t *t, bool fresh) {
+    if (fresh) {
+        remove(IMAGE_PATH);
+    }
+
+    flash_mgr_raw_io_t io;
+    CHECK(flash_mgr_raw_file_open(&t->image, IMAGE_PATH, IMAGE_SIZE, &io) == ESP_OK);
+    CHECK(flash_mgr_raw_log_init(&t->log, &io, 0, IMAGE_SIZE) == ESP_OK);
+    CHECK(flash_mgr_raw_log_recover(&t->log, &t->first_id, &t->end_id) == ESP_OK);
+}
+
+static void log_reopen(test_log_t *t) {
+    flash_mgr_raw_file_close(&t->image);
+    log_open(t, false);
+}
+
+static void append_range(test_log_t *t, uint32_t first_id, uint32_t count, int32_t value_base) {
+    flash_mgr_entry_t batch[64];
+
+    while (count > 0) {
+        uint32_t n = count < 64 ? count : 64;
+        for (uint32_t i = 0; i < n; i++) {
+            batch[i] = make_entry(first_id + i, value_base + (int32_t)(first_id + i));
+        }
+
+        uint32_t written = 0;
+        CHECK(flash_mgr_raw_log_append(&t->log, batch, n, &written) == ESP_OK);
+        CHECK(written == n);
+        first_id += n;
+        count -= n;
+    }
+}
+
+/**
+* @brief Read [first_id, end_id) and check every entry is intact and carries value_base + id
+*/
+static void expect_range(test_log_t *t, uint32_t first_id, uint32_t end_id, int32_t value_base) {
+    flash_mgr_entry_t buffer[64];
+
+    for (uint32_t id = first_id; id < end_id;) {
+        uint32_t want = end_id - id < 64 ? end_id - id : 64;
+        uint32_t got = 0;
+        CHECK(flash_mgr_raw_log_read(&t->log, id, buffer, want, &got) == ESP_OK);
+        CHECK(got == want);
+        for (uint32_t i = 0; i < got; i++) {
+            CHECK(buffer[i].id == id + i);
+            CHECK(buffer[i].value_x1000 == value_base + (int32_t)(id + i));
+            CHECK(flash_mgr_entry_intact(&buffer[i]));
+        }
+        id += got;
+    }
+}
+
+static void test_recovery(void) {
+    test_log_t t;
+    log_open(&t, true);
+    CHECK(t.first_id == 0 && t.end_id == 0);
+
+    append_range(&t, 0, 300, 0);
+    log_reopen(&t);
+    CHECK(t.first_id == 0 && t.end_id == 300);
+    expect_range(&t, 0, 300, 0);
+
+    // Appends continue where recovery left off
+    append_range(&t, 300, 10, 0);
+    log_reopen(&t);
+    CHECK(t.end_id == 310);
+    expect_range(&t, 0, 310, 0);
+
+    flash_mgr_raw_file_close(&t.image);
+}
+
+static void test_torn_last_slot(void) {
+    test_log_t t;
+    log_open(&t, true);
+    append_range(&t, 0, 300, 0);
+
+    // Half of the next entry reached flash before the reset
+    flash_mgr_entry_t torn = make_entry(300, 300);
+    uint32_t slot = t.log.end_id - t.log.tail_first_id;
+    uint32_t addr = t.log.tail_sector * FLASH_MGR_RAW_SECTOR_SIZE + sizeof(flash_mgr_raw_sector_header_t) +
+                    slot * sizeof(flash_mgr_entry_t);
+    CHECK(t.log.io.write(t.log.io.ctx, addr, &torn, sizeof(torn) / 2) == ESP_OK);
+
+    log_reopen(&t);
+    CHECK(t.first_id == 0 && t.end_id == 300);
+    CHECK(t.log.tail_closed);
+    expect_range(&t, 0, 300, 0);
+
+    // The torn slot can't be programmed again, so id 300 opens a new sector
+    uint32_t torn_sector = t.log.tail_sector;
+    append_range(&t, 300, 5, 1000);
+    CHECK(t.log.tail_sector != torn_sector);
+    log_reopen(&t);
+    CHECK(t.end_id == 305);
+    expect_range(&t, 0, 300, 0);
+    expect_range(&t, 300, 305, 1000);
+
+    flash_mgr_raw_file_close(&t.image);
+}
+
+static void test_sector_recycling(void) {
+    test_log_t t;
+    log_open(&t, true);
+    uint32_t capacity = flash_mgr_raw_log_capacity(&t.log);
+    CHECK(capacity == (IMAGE_SECTORS - 1) * SLOTS);
+
+    // Several laps over the region
+    uint32_t total = 3 * IMAGE_SECTORS * SLOTS + 17;
+    append_range(&t, 0, total, 0);
+    CHECK(t.log.end_id == total);
+    CHECK(total - t.log.first_id >= capacity && total - t.log.first_id <= IMAGE_SECTORS * SLOTS);
+    uint32_t first_id = t.log.first_id;
+
+    log_reopen(&t);
+    CHECK(t.first_id == first_id && t.end_id == total);
+    expect_range(&t, first_id, total, 0);
+
+    // Ids older than the head were overwritten
+    flash_mgr_entry_t entry;
+    uint32_t got = 0;
+    CHECK(flash_mgr_raw_log_read(&t.log, first_id - 1, &entry, 1, &got) == ESP_ERR_NOT_FOUND);
+
+    flash_mgr_raw_file_close(&t.image);
+}
+
+static void test_truncate(void) {
+    test_log_t t;
+    flash_mgr_entry_t entry;
+    uint32_t got = 0;
+
+    // Inside the tail sector: the cut entries stay cut after a reset
+    log_open(&t, true);
+    append_range(&t, 0, 300, 0);
+    CHECK(flash_mgr_raw_log_truncate(&t.log, 290) == ESP_OK);
+    CHECK(t.log.end_id == 290);
+    CHECK(flash_mgr_raw_log_read(&t.log, 290, &entry, 1, &got) == ESP_OK && got == 0);
+    log_reopen(&t);
+    CHECK(t.first_id == 0 && t.end_id == 290);
+    expect_range(&t, 0, 290, 0);
+
+    // The cut ids are written again with new values
+    append_range(&t, 290, 20, 1000);
+    log_reopen(&t);
+    CHECK(t.end_id == 310);
+    expect_range(&t, 0, 290, 0);
+    expect_range(&t, 290, 310, 1000);
+    flash_mgr_raw_file_close(&t.image);
+
+    // Across a sector boundary: the sector holding only cut entries is retired
+    log_open(&t, true);
+    append_range(&t, 0, 300, 0);
+    CHECK(flash_mgr_raw_log_truncate(&t.log, SLOTS - 5) == ESP_OK);
+    log_reopen(&t);
+    CHECK(t.first_id == 0 && t.end_id == SLOTS - 5);
+    expect_range(&t, 0, SLOTS - 5, 0);
+    flash_mgr_raw_file_close(&t.image);
+
+    // Exactly at a sector boundary
+    log_open(&t, true);
+    append_range(&t, 0, 300, 0);
+    CHECK(flash_mgr_raw_log_truncate(&t.log, SLOTS) == ESP_OK);
+    log_reopen(&t);
+    CHECK(t.first_id == 0 && t.end_id == SLOTS);
+    append_range(&t, SLOTS, 3, 1000);
+    log_reopen(&t);
+    expect_range(&t, 0, SLOTS, 0);
+    expect_range(&t, SLOTS, SLOTS + 3, 1000);
+    flash_mgr_raw_file_close(&t.image);
+
+    // Everything: the log is empty
+    log_open(&t, true);
+    append_range(&t, 0, 10, 0);
+    CHECK(flash_mgr_raw_log_truncate(&t.log, 0) == ESP_OK);
+    CHECK(t.log.empty);
+    log_reopen(&t);
+    CHECK(t.first_id == 0 && t.end_id == 0 && t.log.empty);
+    flash_mgr_raw_file_close(&t.image);
+}
+
+static void test_nor_semantics(void) {
+    flash_mgr_raw_file_t image;
+    flash_mgr_raw_io_t io;
+    uint8_t byte;
+
+    remove(IMAGE_PATH);
+    CHECK(flash_mgr_raw_file_open(&image, IMAGE_PATH, IMAGE_SIZE, &io) == ESP_OK);
+    CHECK(io.read(io.ctx, IMAGE_SIZE - 1, &byte, 1) == ESP_OK && byte == 0xFF);
+
+    // Writes only clear bits, erase sets the sector back to 0xFF
+    byte = 0x0F;
+    CHECK(io.write(io.ctx, 10, &byte, 1) == ESP_OK);
+    byte = 0xF3;
+    CHECK(io.write(io.ctx, 10, &byte, 1) == ESP_OK);
+    CHECK(io.read(io.ctx, 10, &byte, 1) == ESP_OK && byte == 0x03);
+    CHECK(io.erase(io.ctx, 0, FLASH_MGR_RAW_SECTOR_SIZE) == ESP_OK);
+    CHECK(io.read(io.ctx, 10, &byte, 1) == ESP_OK && byte == 0xFF);
+
+    CHECK(io.erase(io.ctx, 10, FLASH_MGR_RAW_SECTOR_SIZE) == ESP_ERR_INVALID_ARG);
+    CHECK(io.read(io.ctx, IMAGE_SIZE, &byte, 1) == ESP_ERR_INVALID_SIZE);
+
+    flash_mgr_raw_file_close(&image);
+}
+
+int main(void) {
+    test_nor_semantics();
+    test_recovery();
+    test_torn_last_slot();
+    test_sector_recycling();
+    test_truncate();
+
+    remove(IMAGE_PATH);
+    printf("raw log: all tests passed\n");
+    return 0;
+}
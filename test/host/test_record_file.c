@@ -0,0 +1,127 @@
+/**
+* @file test_record_file.c
+* @brief Host test of the fixed-size record files
+*
+* Like the raw log test, checks reopen the file and recover, so they see what
+* a reset would.
+*/
+
+#include "gg_flash_mgr_record.h"
+#include "gg_flash_mgr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILE_PATH "records.bin"
+#define RECORD_SIZE 6
+#define SLOTS 7
+#define STRIDE FLASH_MGR_RECORD_STRIDE(RECORD_SIZE)
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+static void file_open(flash_mgr_record_file_t *file, bool fresh) {
+    if (fresh) {
+        remove(FILE_PATH);
+    }
+    CHECK(flash_mgr_record_file_open(file, FILE_PATH, RECORD_SIZE, SLOTS) == ESP_OK);
+}
+
+static void file_reopen(flash_mgr_record_file_t *file) {
+    flash_mgr_record_file_close(file);
+    file_open(file, false);
+}
+
+/**
+* @brief Append count records with ids from end_id on, each filled with its id's low byte
+*/
+static void append_records(flash_mgr_record_file_t *file, uint32_t count) {
+    uint8_t slots[3 * STRIDE];
+
+    while (count > 0) {
+        uint32_t n = count < 3 ? count : 3;
+        memset(slots, 0, sizeof(slots));
+        for (uint32_t i = 0; i < n; i++) {
+            flash_mgr_record_header_t header = { .id = file->end_id + i, .timestamp = 1000 + file->end_id + i };
+            memcpy(slots + i * STRIDE, &header, sizeof(header));
+            memset(slots + i * STRIDE + sizeof(header), (uint8_t)header.id, RECORD_SIZE);
+        }
+        CHECK(flash_mgr_record_file_write(file, slots, n) == ESP_OK);
+        count -= n;
+    }
+}
+
+/**
+* @brief Read [first_id, end_id) in one call and check every record
+*/
+static void expect_records(const flash_mgr_record_file_t *file, uint32_t first_id, uint32_t end_id) {
+    uint8_t slots[SLOTS * STRIDE];
+    uint32_t got = 0;
+
+    CHECK(file->first_id == first_id && file->end_id == end_id);
+    CHECK(flash_mgr_record_file_read(file, first_id, slots, SLOTS, &got) == ESP_OK);
+    CHECK(got == end_id - first_id);
+    for (uint32_t i = 0; i < got; i++) {
+        flash_mgr_record_header_t header;
+        memcpy(&header, slots + i * STRIDE, sizeof(header));
+        CHECK(header.id == first_id + i && header.timestamp == 1000 + first_id + i);
+        CHECK(slots[i * STRIDE + sizeof(header)] == (uint8_t)header.id);
+    }
+}
+
+static void test_recovery(void) {
+    flash_mgr_record_file_t file;
+    file_open(&file, true);
+    expect_records(&file, 0, 0);
+
+    // Every tail position over a few laps, including exact lap ends
+    for (uint32_t end = 1; end <= 4 * SLOTS; end++) {
+        append_records(&file, 1);
+        file_reopen(&file);
+        expect_records(&file, end > SLOTS ? end - SLOTS : 0, end);
+    }
+
+    // Overwritten and unwritten ids
+    uint8_t slot[STRIDE];
+    uint32_t got = 0;
+    CHECK(flash_mgr_record_file_read(&file, file.first_id - 1, slot, 1, &got) == ESP_ERR_NOT_FOUND);
+    CHECK(flash_mgr_record_file_read(&file, file.end_id, slot, 1, &got) == ESP_OK && got == 0);
+    CHECK(flash_mgr_record_file_read(&file, file.end_id + 1, slot, 1, &got) == ESP_ERR_NOT_FOUND);
+
+    flash_mgr_record_file_close(&file);
+}
+
+static void test_geometry(void) {
+    flash_mgr_record_file_t file;
+    file_open(&file, true);
+    append_records(&file, 10);
+    flash_mgr_record_file_close(&file);
+
+    // Another record size is refused, another slot count keeps the file's
+    CHECK(flash_mgr_record_file_open(&file, FILE_PATH, RECORD_SIZE + 1, SLOTS) == ESP_ERR_INVALID_SIZE);
+    CHECK(flash_mgr_record_file_open(&file, FILE_PATH, RECORD_SIZE, SLOTS * 2) == ESP_OK);
+    CHECK(file.slots == SLOTS);
+    expect_records(&file, 3, 10);
+
+    // Reset takes the new geometry and starts the ids over
+    CHECK(flash_mgr_record_file_reset(&file, FILE_PATH, RECORD_SIZE, SLOTS - 2) == ESP_OK);
+    file_reopen(&file);
+    CHECK(file.slots == SLOTS - 2);
+    expect_records(&file, 0, 0);
+
+    flash_mgr_record_file_close(&file);
+}
+
+int main(void) {
+    test_recovery();
+    test_geometry();
+
+    remove(FILE_PATH);
+    printf("record file: all tests passed\n");
+    return 0;
+}